@@ -0,0 +1,47 @@
+"""Steps a headless world on a scene scaled by the given factors, once with
+rotating bodies and once with every body kept upright, and prints the
+per-phase timings of both runs, so the cost of the rotation stays visible.
+
+    python3 bench_physics.py [steps] [factor...]
+"""
+import sys
+
+from game import _game
+
+SEED = 112
+STEP = 1. / 60
+
+
+def run(factor, steps, rotation):
+    opts = _game.Options()
+    # Long enough for the match not to end during the run
+    opts.game_time = 1e6
+    opts.enemy_delay = 1e6
+    opts.scene.seed = SEED
+    opts.scene = opts.scene.scaled(factor)
+    opts.solver.rotation = rotation
+
+    # A single world on the calling thread, the timings are its own
+    worlds = _game.VecWorld(opts, 1, threads=1)
+    worlds.reset()
+    actions = [[0.] * _game.VecWorld.action_size]
+    for _ in range(steps):
+        worlds.step(actions, STEP)
+    return dict((phase.name, phase) for phase in worlds.timings(0))
+
+
+def main():
+    steps = int(sys.argv[1]) if len(sys.argv) > 1 else 600
+    factors = [float(f) for f in sys.argv[2:]] or [1, 10]
+    for factor in factors:
+        upright = run(factor, steps, False)
+        rotating = run(factor, steps, True)
+        print("---- x%g, %d steps ----" % (factor, steps))
+        print("%-12s %12s %12s" % ("", "upright ms", "rotating ms"))
+        for name in ("broadphase", "narrowphase", "solve", "integrate"):
+            print("%-12s %12.3f %12.3f" %
+                  (name, upright[name].avg_ms, rotating[name].avg_ms))
+
+
+if __name__ == '__main__':
+    main()
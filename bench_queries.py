@@ -0,0 +1,75 @@
+"""Casts random rays and sweeps through a headless world on a scene scaled by
+the given factors, one by one and batched, and prints the throughput of
+every kind of query in rays per second.
+
+    python3 bench_queries.py [rays] [factor...]
+"""
+import random
+import sys
+import time
+
+from game import _game
+
+SEED = 112
+STEP = 1. / 60
+# Settling steps before the queries, so that the balls lie where they fall
+SETTLE = 60
+SWEEP_RADIUS = 0.25
+
+
+def world(factor):
+    opts = _game.Options()
+    opts.game_time = 1e6
+    opts.enemy_delay = 1e6
+    opts.scene.seed = SEED
+    opts.scene = opts.scene.scaled(factor)
+    worlds = _game.VecWorld(opts, 1, threads=1)
+    worlds.reset()
+    actions = [[0.] * _game.VecWorld.action_size]
+    for _ in range(SETTLE):
+        worlds.step(actions, STEP)
+    return worlds
+
+
+# From points spread over the arena in every direction
+def rays(count, extent):
+    rng = random.Random(SEED)
+    origins = [[rng.uniform(-extent, extent), rng.uniform(0.5, 6),
+                rng.uniform(-extent, extent)] for _ in range(count)]
+    directions = [[rng.uniform(-1, 1) for _ in range(3)] for _ in range(count)]
+    return origins, directions
+
+
+def rate(count, run):
+    start = time.perf_counter()
+    run()
+    return count / (time.perf_counter() - start)
+
+
+def main():
+    count = int(sys.argv[1]) if len(sys.argv) > 1 else 100000
+    factors = [float(f) for f in sys.argv[2:]] or [1, 10]
+    for factor in factors:
+        worlds = world(factor)
+        queries = worlds.queries(0)
+        origins, directions = rays(count, 14 * factor ** 0.5)
+        single = min(count, 10000)
+
+        def one_by_one():
+            for o, d in zip(origins[:single], directions[:single]):
+                queries.raycast(o, d)
+
+        results = [
+            ("raycast", rate(single, one_by_one)),
+            ("raycast_batch", rate(count, lambda: queries.raycast_batch(
+                origins, directions))),
+            ("sweep_batch", rate(count, lambda: queries.sweep_batch(
+                origins, SWEEP_RADIUS, directions))),
+        ]
+        print("---- x%g, %d objects ----" % (factor, len(queries)))
+        for name, rays_per_second in results:
+            print("%-14s %12.0f rays/s" % (name, rays_per_second))
+
+
+if __name__ == '__main__':
+    main()
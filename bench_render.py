@@ -0,0 +1,56 @@
+"""Renders a fixed scene offscreen for a number of frames, with the camera
+circling the arena, and prints the CPU and GPU frame times and draw calls.
+
+    python3 bench_render.py [frames] [width] [height]
+
+Needs no GPU nor a screen, e.g. on Mesa llvmpipe under Xvfb:
+
+    LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -a python3 bench_render.py 600
+"""
+import sys
+
+from game import _game
+
+SEED = 112
+# Shader compiles and first uploads are not measured
+WARMUP_FRAMES = 30
+
+
+def percentile(values, p):
+    ordered = sorted(values)
+    return ordered[min(len(ordered) - 1, int(p / 100. * len(ordered)))]
+
+
+def report(name, values, unit):
+    print("%-12s avg %9.3f  p50 %9.3f  p95 %9.3f  max %9.3f %s" %
+          (name, sum(values) / len(values), percentile(values, 50),
+           percentile(values, 95), max(values), unit))
+
+
+def run(frames, width, height):
+    opts = _game.Options()
+    opts.offscreen = True
+    opts.width = width
+    opts.height = height
+    opts.frames = frames + WARMUP_FRAMES
+    opts.hot_reload_shaders = False
+    # Long enough for the match not to end during the run
+    opts.game_time = 1e6
+    opts.enemy_delay = 1e6
+    opts.scene.seed = SEED
+    if _game.run(opts) != 0:
+        sys.exit("the offscreen context could not be created")
+
+    measured = _game.frames()[WARMUP_FRAMES:]
+    print("---- %d frames at %dx%d, %d objects ----" %
+          (len(measured), width, height, opts.scene.object_count()))
+    report("cpu", [f.cpu_ms for f in measured], "ms")
+    report("gpu", [f.gpu_ms for f in measured], "ms")
+    report("draw calls", [f.draw_calls for f in measured], "")
+    report("triangles", [f.triangles for f in measured], "")
+    report("allocations", [f.allocations for f in measured], "")
+
+
+if __name__ == '__main__':
+    args = [int(a) for a in sys.argv[1:]]
+    run(*(args + [600, 1280, 720][len(args):]))
@@ -0,0 +1,6 @@
+#version 330
+
+// Depth only, the color writes are masked
+void main()
+{
+}
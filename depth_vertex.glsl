@@ -0,0 +1,14 @@
+#version 330
+
+in vec4 position;
+
+uniform mat4 PVM_matrix;
+
+// Must match vertex.glsl bit for bit, the color pass tests with GL_LEQUAL
+// against the depth written here
+invariant gl_Position;
+
+void main()
+{
+    gl_Position = PVM_matrix * position;
+}
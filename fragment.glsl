@@ -1,5 +1,8 @@
 #version 330
 
+// Specialized by ShaderVariants with TEXTURED, DIFFUSE and SPECULAR, defined
+// after the #version line. Without DIFFUSE only the ambient term is lit.
+
 out vec4 final_color;
 
 in vec3 VS_normal_ws;
@@ -11,48 +14,86 @@ uniform vec3 material_diffuse_color;
 uniform vec3 material_specular_color;
 uniform float material_shininess;
 
-uniform vec4 light1_position;
-uniform vec4 light2_position;
 uniform vec3 light_ambient_color;
 uniform vec3 light_diffuse_color;
 uniform vec3 light_specular_color;
 
 uniform vec3 eye_position;
 
+#ifdef TEXTURED
 uniform sampler2D my_tex;
+#endif
 
-vec3 get_light(vec4 light_position)
-{
-    vec3 tex_color = texture(my_tex, VS_tex_coord).rgb;
-
-    vec3 N = normalize(VS_normal_ws);
-    vec3 Eye = normalize(eye_position - VS_position_ws);
-    vec3 L = normalize(light_position.xyz - VS_position_ws * light_position.w);
-
-    vec3 H = normalize(L + Eye);
+// Lights binned into clusters of the view frustum, see LightClusters.
+// Two texels per light: position and radius, color.
+uniform samplerBuffer light_data;
+// Offset and count of the lights of every cluster in light_indices
+uniform usamplerBuffer cluster_grid;
+uniform usamplerBuffer light_indices;
+uniform mat4 view_matrix;
+// Size of a tile in pixels
+uniform vec2 cluster_tile_size;
+// Slice of a view depth d is log(d) * x + y
+uniform vec2 cluster_depth;
+uniform ivec3 cluster_count;
 
-    float Idiff = max(dot(N, L), 0.0);
-    float Ispec = pow(max(dot(N, H), 0.0), material_shininess) * Idiff;
+vec3 get_light(vec3 tex_color, vec3 N, vec3 Eye, vec4 light_position, vec3 light_color)
+{
+    vec3 L = light_position.xyz - VS_position_ws;
+    float distance = length(L);
 
-    // Attenuation
-    float distance    = length(light_position.xyz - VS_position_ws);
+    // Attenuation, faded out to zero at the radius of the light
     float attenuation = 1.0f / (0.3 + 0.02 * distance +
                  0.01 * (distance * distance));
+    float window = clamp(1.0 - pow(distance / light_position.w, 4.0), 0.0, 1.0);
+    attenuation *= window * window;
 
-    vec3 mat_ambient = material_ambient_color;
-    vec3 mat_diffuse = material_diffuse_color;
-    vec3 mat_specular = material_specular_color;
+    vec3 light = vec3(0.0);
+#ifdef DIFFUSE
+    L /= distance;
+    float Idiff = max(dot(N, L), 0.0);
+    light += material_diffuse_color * light_diffuse_color * Idiff * tex_color;
+#ifdef SPECULAR
+    vec3 H = normalize(L + Eye);
+    float Ispec = pow(max(dot(N, H), 0.0), material_shininess) * Idiff;
+    light += material_specular_color * light_specular_color * Ispec;
+#endif
+#endif
 
-    vec3 light =
-        mat_ambient * light_ambient_color * tex_color * attenuation +
-        mat_diffuse * light_diffuse_color * Idiff * tex_color * attenuation +
-        mat_specular * light_specular_color * Ispec * attenuation;
-    return light;
+    return light * attenuation * light_color;
 }
 
 void main()
 {
-    vec3 light = get_light(light1_position) + get_light(light2_position);
+#ifdef TEXTURED
+    vec3 tex_color = texture(my_tex, VS_tex_coord).rgb;
+#else
+    vec3 tex_color = vec3(1.0);
+#endif
+#ifdef DIFFUSE
+    vec3 N = normalize(VS_normal_ws);
+    vec3 Eye = normalize(eye_position - VS_position_ws);
+#else
+    vec3 N = vec3(0.0);
+    vec3 Eye = vec3(0.0);
+#endif
+
+    float depth = -(view_matrix * vec4(VS_position_ws, 1.0)).z;
+    ivec3 c = ivec3(ivec2(gl_FragCoord.xy / cluster_tile_size),
+        int(log(max(depth, 1e-4)) * cluster_depth.x + cluster_depth.y));
+    c = clamp(c, ivec3(0), cluster_count - 1);
+    int cluster = (c.z * cluster_count.y + c.y) * cluster_count.x + c.x;
+    uvec2 range = texelFetch(cluster_grid, cluster).xy;
+
+    // Once for the fragment, lit by any lamp or none
+    vec3 light = material_ambient_color * light_ambient_color * tex_color;
+    for (uint i = 0u; i < range.y; i++)
+    {
+        int index = int(texelFetch(light_indices, int(range.x + i)).x);
+        vec4 light_position = texelFetch(light_data, 2 * index);
+        vec3 light_color = texelFetch(light_data, 2 * index + 1).rgb;
+        light += get_light(tex_color, N, Eye, light_position, light_color);
+    }
 
     final_color = vec4(light, 1.0);
 }
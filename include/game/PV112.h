@@ -2,6 +2,7 @@
 #ifndef INCLUDED_PV112_H
 #define INCLUDED_PV112_H
 
+#include <memory>
 #include <vector>
 #include <string>
 
@@ -10,6 +11,7 @@
 
 #include <glm/glm.hpp>
 #include "object.hpp"
+#include "gpu_resource.hpp"
 
 
 namespace PV112
@@ -38,6 +40,12 @@ void WaitForEnterAndExit();
 /// Returns shader object on success or 0 if failed.
 GLuint LoadAndCompileShader(GLenum shader_type, const char *file_name);
 
+/// Creates a shader of given type from the source code already in memory, compiles it, and prints
+/// errors if some happens. 'file_name' only names the shader in the errors.
+///
+/// Returns shader object on success or 0 if failed.
+GLuint CompileShader(GLenum shader_type, const std::string &source, const char *file_name);
+
 /// Creates a shader program, loads, compiles and sets the vertex and fragment shaders, links it,
 /// and prints errors if some occur.
 ///
@@ -60,6 +68,24 @@ GLuint CreateAndLinkProgram(const char *vertex_shader, const char *fragment_shad
 //----    SIMPLE PV112 GEOMETRY CLASS    ----
 //-------------------------------------------
 
+/// Copy of the vertices of a geometry kept in the main memory, so that meshes can be merged into
+/// bigger buffers later. Geometries drawn with glDrawArrays have no indices.
+struct MeshData
+{
+    std::vector<glm::vec3> Positions;
+    std::vector<glm::vec3> Normals;
+    std::vector<glm::vec2> TexCoords;
+    std::vector<unsigned int> Indices;
+};
+
+/// Owned GL objects of a geometry, with their sizes in the GpuLedger.
+struct GeometryObjects
+{
+    GpuBuffer VertexBuffers[3];
+    GpuBuffer IndexBuffer;
+    GpuVertexArray VAO;
+};
+
 /// This is a VERY SIMPLE class to contain all buffers and vertex array objects for geometries of
 /// PV112 lectures. It is not a perfect, brilliant, smart, or whatever implementation of a geometry.
 ///
@@ -77,14 +103,9 @@ public:
     PV112Geometry(const PV112Geometry &rhs);
     PV112Geometry &operator =(const PV112Geometry &rhs);
 
-    // Note that there is no destructor, especially no destructor that would automatically destroy
-    // the created objects. When calling functions like glDelete*, the OpenGL rendering context
-    // must exist, however, it is destroyed when the main window is closed. For this reason, calling
-    // a destructor afterwards (for example at the very end of the application when global objects
-    // are destroyed) could lead to an access violation errors and a crash of the application.
-    //
-    // To make it short, all OpenGL objects must be destroyed BEFORE the main window is closed
-    // (or left alive, as in our case).
+    // The GL names below are plain copies, the objects are owned by Objects which is shared by
+    // the copies of the geometry. When the last copy goes away, the objects are queued for
+    // deletion and deleted by GpuLedger::flush() between frames, while the window still exists.
 
     // Up to three buffers with the data of the geometry (positions, normals, texture coordinates).
     // If the data is only in one buffer, other buffers are 0
@@ -103,9 +124,24 @@ public:
     // Number of vertices to be drawn using glDrawElements
     GLsizei DrawElementsCount;
     AABB aabb;
+    // Vertices in the main memory, shared by the copies of the geometry
+    std::shared_ptr<const MeshData> Data;
+    // Owner of the buffers and the vertex array object
+    std::shared_ptr<const GeometryObjects> Objects;
 };
 
-/// Deletes OpenGL objects of the geometry.
+/// Copies the VAO and draw parameters of the geometry into 'item'.
+inline void SetDrawGeometry(DrawItem &item, const PV112Geometry &geom)
+{
+    item.vao = geom.VAO;
+    item.mode = geom.Mode;
+    item.arrays_count = geom.DrawArraysCount;
+    item.elements_count = geom.DrawElementsCount;
+    item.mesh = geom.Data.get();
+}
+
+/// Releases the OpenGL objects of the geometry. They are deleted once no copy of the geometry
+/// uses them, by the next GpuLedger::flush().
 void DeleteGeometry(PV112Geometry &geom);
 
 /// Chooses glDrawArrays or glDrawElements to draw the geometry.
@@ -137,6 +173,13 @@ PV112Geometry CreateSphere(GLint position_location, GLint normal_location = -1,
 /// obtained by glGetAttribLocation. Use -1 if not necessary.
 PV112Geometry CreateTeapot(GLint position_location, GLint normal_location = -1, GLint tex_coord_location = -1);
 
+/// Creates a sphere of radius 1 centered in (0,0,0) out of 'slices' meridians and 'stacks'
+/// parallels, drawn as indexed GL_TRIANGLES. The texture wraps around once along the equator.
+///
+/// Coarser spheres make cheaper levels of detail of the same object.
+PV112Geometry CreateUVSphere(int slices, int stacks, GLint position_location, GLint normal_location = -1,
+        GLint tex_coord_location = -1);
+
 //--------------------------
 //----    OBJ LOADER    ----
 //--------------------------
@@ -159,6 +202,21 @@ bool ParseOBJFile(const char *file_name, std::vector<glm::vec3> &out_vertices, s
 /// obtained by glGetAttribLocation. Use -1 if not necessary.
 PV112Geometry LoadOBJ(const char *file_name, GLint position_location, GLint normal_location = -1, GLint tex_coord_location = -1);
 
+/// Parses an OBJ file and fits its vertices into a unit box like LoadOBJ does, without creating any
+/// OpenGL objects, so it may run on any thread. The bounding box goes to 'out_aabb'.
+///
+/// Returns nullptr if the file cannot be parsed, the error message is printed.
+std::shared_ptr<MeshData> ReadOBJ(const char *file_name, AABB &out_aabb);
+
+/// Creates the buffers and the vertex array of a geometry drawn with glDrawArrays out of the
+/// vertices returned by ReadOBJ. Returns an empty geometry if 'data' is nullptr.
+PV112Geometry CreateOBJGeometry(std::shared_ptr<MeshData> data, const AABB &aabb, GLint position_location,
+        GLint normal_location = -1, GLint tex_coord_location = -1);
+
+/// Parses an OBJ file and returns the bounding box LoadOBJ would give it, without creating any
+/// OpenGL objects.
+AABB LoadOBJBounds(const char *file_name);
+
 //-----------------------------------------
 //----    SIMPLE PV112 CAMERA CLASS    ----
 //-----------------------------------------
@@ -193,7 +251,7 @@ private:
     ///		- Sensitivity of the mouse when changing zoom
     static const float zoom_sensitivity;
 
-    const std::array<std::array<float, 2>, 3> bounds;
+    std::array<std::array<float, 2>, 3> bounds;
     float horizontal_angle = 3.14f;
     // vertical angle : 0, look at the horizon
     float vertical_angle = 0.0f;
@@ -211,6 +269,9 @@ private:
 public:
     PV112Camera(const std::array<std::array<float, 2>, 3>& bounds);
 
+    /// Changes the box the camera is allowed to move in
+    void set_bounds(const std::array<std::array<float, 2>, 3>& new_bounds);
+
     /// Call when the user presses or releases a mouse button (see glutMouseFunc)
     void OnMouseButtonChanged(int button, int state, int x, int y);
 
@@ -218,6 +279,9 @@ public:
     void OnMouseMoved(int x, int y, float time_delta);
     void ProcessArrowKeys(std::array<bool, 4> keys, float time_delta);
 
+    /// Moves the camera to 'position' and turns it by the angles in radians, for scripted flights
+    void SetView(const glm::vec3 &position, float horizontal, float vertical);
+
     /// Returns view matrix
     glm::mat4 get_view_matrix() const;
     glm::vec3 get_position() const {
@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+
+// Counts the heap allocations made through operator new on the calling
+// thread. The replacement operators live in allocation_probe.cpp, they cost
+// a thread-local increment on top of malloc. The profiler scopes record the
+// difference, so a phase that should not allocate in the steady state can be
+// checked in its timings.
+class AllocationProbe {
+public:
+    static uint64_t count();
+};
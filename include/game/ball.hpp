@@ -3,110 +3,97 @@
 #include "libs.hpp"
 #include "helpers.hpp"
 #include "object.hpp"
+#include "PV112.h"
 
 
 class Ball : public Object {
 private:
-    GLuint m_program;
-    GLint  m_loc;
-    GLuint m_tex;
-    GLint m_tex_loc;
-
     PV112::PV112Geometry m_sphere;
-    glm::vec3 m_center;
+    GLuint m_tex;
     float m_radius;
 public:
-    Ball() = default;
-    Ball(const GLuint program, const glm::vec3& center, const float radius)
-     : Object({center, {radius, radius, radius}}),
-       m_program(program), m_center(center), m_radius(radius)
+    Ball(BodyStore& store, const PV112::PV112Geometry& sphere, const GLuint tex,
+        const glm::vec3& center, const float radius)
+     : Object(store, {center, {radius, radius, radius}}),
+       m_sphere(sphere), m_tex(tex), m_radius(radius)
     {
-        this->init();
+        m_store.kind[m_body] = BodyStore::BALL;
     }
-    Ball(const GLuint program, const glm::vec3& center, const float radius,
-        const Motion& motion)
-     : Object({center, {radius, radius, radius}}, motion),
-       m_program(program), m_center(center), m_radius(radius)
+    Ball(BodyStore& store, const PV112::PV112Geometry& sphere, const GLuint tex,
+        const glm::vec3& center, const float radius, const Motion& motion)
+     : Object(store, {center, {radius, radius, radius}}, motion),
+       m_sphere(sphere), m_tex(tex), m_radius(radius)
     {
-        this->init();
+        m_store.kind[m_body] = BodyStore::BALL;
     }
 
     virtual float mass() const final override {
         return 4. * 3.14 * m_radius * m_radius * m_radius / 3.;
     }
     glm::vec3 get_center() const {
-        return m_center;
+        return this->position();
     }
     float get_radius() const {
         return m_radius;
     }
 
-    void init() {
-        int position_loc  = glGetAttribLocation(m_program, "position");
-        int normal_loc    = glGetAttribLocation(m_program, "normal");
-        int tex_coord_loc = glGetAttribLocation(m_program, "tex_coord");
-        m_loc = glGetUniformLocation(m_program, "ball_tex");
-        m_sphere = PV112::CreateSphere(position_loc, normal_loc, tex_coord_loc);
-
-        this->bind_ball_texture();
-    }
-
-    void bind_ball_texture() {
-        m_tex_loc = glGetUniformLocation(m_program, "ball_tex");
-
-        m_tex = PV112::CreateAndLoadTexture("img/metal.jpg");
-        glBindTexture(GL_TEXTURE_2D, m_tex);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        glBindTexture(GL_TEXTURE_2D, 0);
+    virtual glm::vec3 inertia() const final override {
+        return glm::vec3(0.4f * this->mass() * m_radius * m_radius);
     }
 
-    virtual glm::mat4 update_geometry(const float time_delta) final override {
-        // auto tmp_center = m_center;
-        // tmp_center.x = m_center.x + glm::sin(time * m_motion.speed) / 2.;
-        // tmp_center.y = m_center.y + glm::cos(time * m_motion.speed) / 2.;
+    virtual void integrate(const float time_delta,
+            const glm::vec3& velocity) final override {
         if (m_motion.active) {
-            m_motion.account_gravity(time_delta);
-            m_center = m_center + time_delta * m_motion.v;
-            m_aabb.set_center(m_center);
+            this->position() += time_delta * velocity;
+            this->integrate_rotation(time_delta);
         }
-        auto model_matrix = glm::translate(glm::mat4(1.f), m_center);
-        model_matrix = glm::scale(model_matrix, glm::vec3(m_radius));
-
-        return model_matrix;
     }
-
-    void render(const float time) final override {
-        glBindVertexArray(m_sphere.VAO);
-
-        glUniform1i(m_tex_loc, 0); // Choose proper texture unit
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, m_tex);
-        DrawGeometry(m_sphere);
+    virtual void describe_mesh(DrawItem& item) const final override {
+        PV112::SetDrawGeometry(item, m_sphere);
+        item.scale = glm::vec3(m_radius);
+        item.tex = m_tex;
     }
 
     virtual bool check_collision(const Object& other) const final override {
         return other.check_collision_what(*this);
     }
-    virtual glm::vec3 bounce_normal(const Object& other) const final override {
-        return -other.bounce_normal_what(*this);
+    virtual bool penetration(const Object& other, Penetration& out) const final override {
+        if (!other.penetration_what(*this, out)) {
+            return false;
+        }
+        out.normal = -out.normal;
+        return true;
     }
 
     virtual bool check_collision_what(const Ball& other) const final override {
-        return glm::length(m_center - other.m_center) <= m_radius + other.m_radius;
+        return glm::length(this->position() - other.position()) <= m_radius + other.m_radius;
     }
     virtual bool check_collision_what(const Cuboid& other) const final override {
         return other.check_collision_what(*this);
     }
-    virtual glm::vec3 bounce_normal_what(const Ball& other) const final override {
-        // First, find the normalized vector n from the center of
-        // circle1 to the center of circle2
-        return glm::normalize(other.m_center - m_center);
+    virtual bool penetration_what(const Ball& other, Penetration& out) const final override {
+        const glm::vec3 d = other.position() - this->position();
+        const float distance = glm::length(d);
+        if (distance >= m_radius + other.m_radius) {
+            return false;
+        }
+        // Balls at the same spot are pushed apart upwards
+        const float depth = m_radius + other.m_radius - distance;
+        out.normal = distance > 1e-6f ? d / distance : glm::vec3(0, 1, 0);
+        out.count = 0;
+        out.add(this->position() + (m_radius - 0.5f * depth) * out.normal, depth);
+        return true;
+    }
+    virtual bool cast(const glm::vec3& origin, const glm::vec3& direction,
+            const float radius, float& distance, glm::vec3& normal) const final override {
+        return ::cast(this->position(), m_radius, origin, direction, radius,
+            distance, normal);
     }
-    virtual glm::vec3 bounce_normal_what(const Cuboid& other) const final override {
-        return -other.bounce_normal_what(*this);
+    virtual bool penetration_what(const Cuboid& other, Penetration& out) const final override {
+        if (!other.penetration_what(*this, out)) {
+            return false;
+        }
+        out.normal = -out.normal;
+        return true;
     }
 };
@@ -0,0 +1,70 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include "libs.hpp"
+
+// Surface area heuristic over binned centers, shared by MeshBvh and
+// SceneQuery. The items of a node are binned by their centers along one axis
+// at a time, and the boundary between two bins with the least area times
+// count on both sides is the split to take, the cheapest of all axes wins.
+class BinnedSah {
+public:
+    // Along every axis
+    static constexpr uint32_t BINS = 12;
+
+    struct Split {
+        float cost = std::numeric_limits<float>::max();
+        uint32_t axis = 0;
+        // Items in lower bins go to the left
+        uint32_t bin = 0;
+
+        bool found() const {
+            return cost < std::numeric_limits<float>::max();
+        }
+    };
+
+private:
+    struct Bin {
+        glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+        glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+        uint32_t count = 0;
+    };
+
+    glm::vec3 m_low;
+    glm::vec3 m_scale;
+    uint32_t m_axis = 0;
+    std::array<Bin, BINS> m_bins;
+    Split m_best;
+
+public:
+    // 'low' and 'high' bound the centers of the items
+    BinnedSah(const glm::vec3& low, const glm::vec3& high);
+
+    static float area(const glm::vec3& min, const glm::vec3& max) {
+        const glm::vec3 d = glm::max(max - min, glm::vec3(0));
+        return 2 * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    uint32_t bin_of(const float center, const uint32_t axis) const {
+        return std::min(BINS - 1, uint32_t((center - m_low[axis]) * m_scale[axis]));
+    }
+
+    // Empties the bins for the items along 'axis', the centers must not all
+    // be the same along it
+    void begin(const uint32_t axis);
+    void add(const float center, const glm::vec3& min, const glm::vec3& max) {
+        auto& bin = m_bins[this->bin_of(center, m_axis)];
+        bin.min = glm::min(bin.min, min);
+        bin.max = glm::max(bin.max, max);
+        ++bin.count;
+    }
+    // Keeps the cheapest split of the items added since begin() if it beats
+    // the best one so far. Both sides of a split have an item at least.
+    void sweep();
+
+    const Split& get_best() const {
+        return m_best;
+    }
+};
@@ -0,0 +1,109 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "libs.hpp"
+
+class Object;
+
+// Simulation state of all bodies in SoA layout. Every Object owns one row
+// and refers to it by index. Removing a body moves the last row into the
+// hole, so the rows stay dense and can be handed out as arrays (for example
+// to NumPy) without copying.
+//
+// Pointers into the arrays follow the rows until a body is added beyond the
+// reserved capacity. The arrays then move, the old ones are kept as long as
+// the store, so a view taken before keeps reading the rows as they were.
+class BodyStore {
+public:
+    enum Kind : uint8_t {
+        STATIC = 0,
+        BALL = 1,
+        BOX = 2,
+        ENEMY = 3
+    };
+
+    // Center of the body, which is also the center of its AABB
+    std::vector<glm::vec3> position;
+    std::vector<glm::vec3> velocity;
+    // Unit quaternions, turning the body from its own axes to the world ones
+    std::vector<glm::quat> orientation;
+    std::vector<glm::vec3> angular_velocity;
+    // Of the AABB around the body in its orientation
+    std::vector<glm::vec3> halfwidth;
+    // Times an enemy got hit, zero for everything else
+    std::vector<uint32_t> hits;
+    std::vector<uint32_t> id;
+    std::vector<uint8_t> kind;
+    std::vector<Object*> owner;
+
+    size_t size() const {
+        return owner.size();
+    }
+    size_t capacity() const {
+        return owner.capacity();
+    }
+
+    void reserve(const size_t count) {
+        if (count <= this->capacity()) {
+            return;
+        }
+        this->move_column(position, count);
+        this->move_column(velocity, count);
+        this->move_column(orientation, count);
+        this->move_column(angular_velocity, count);
+        this->move_column(halfwidth, count);
+        this->move_column(hits, count);
+        this->move_column(id, count);
+        this->move_column(kind, count);
+        owner.reserve(count);
+    }
+
+    uint32_t add(Object* obj, const uint32_t obj_id, const glm::vec3& center,
+        const glm::vec3& v, const glm::vec3& w, const glm::vec3& halfwidths) {
+        if (this->size() == this->capacity()) {
+            this->reserve(std::max<size_t>(2 * this->capacity(), 64));
+        }
+        position.push_back(center);
+        velocity.push_back(v);
+        orientation.push_back(glm::quat(1, 0, 0, 0));
+        angular_velocity.push_back(w);
+        halfwidth.push_back(halfwidths);
+        hits.push_back(0);
+        id.push_back(obj_id);
+        kind.push_back(STATIC);
+        owner.push_back(obj);
+        return owner.size() - 1;
+    }
+
+    // Defined in object.cpp, it has to fix the index of the moved owner
+    void remove(const uint32_t index);
+
+private:
+    // Arrays replaced by bigger ones, see above
+    std::vector<std::shared_ptr<void>> m_retired;
+
+    template <class T>
+    void move_column(std::vector<T>& column, const size_t count) {
+        std::vector<T> moved;
+        moved.reserve(count);
+        moved.assign(column.begin(), column.end());
+        if (column.capacity() > 0) {
+            m_retired.push_back(std::make_shared<std::vector<T>>(std::move(column)));
+        }
+        column = std::move(moved);
+    }
+};
+
+// Turns 'orientation' by the angular velocity 'w' for 'time_delta'
+inline glm::quat
+turned(const glm::quat& orientation, const glm::vec3& w, const float time_delta) {
+    return glm::normalize(orientation
+        + (0.5f * time_delta) * (glm::quat(0, w) * orientation));
+}
+
+static_assert(sizeof(glm::vec3) == 3 * sizeof(float),
+    "BodyStore arrays are exposed as tightly packed float triplets");
+static_assert(sizeof(glm::quat) == 4 * sizeof(float),
+    "Orientations are exposed as tightly packed x, y, z, w quadruplets");
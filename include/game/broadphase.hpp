@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "object.hpp"
+
+// Sweep-and-prune over the object AABBs. Objects are sorted along the axis
+// with the largest spread of centers and only intervals overlapping on that
+// axis are tested on the other two, so the cost grows with the number of
+// actual neighbours instead of with all pairs.
+class Broadphase {
+public:
+    using Pair = std::pair<uint32_t, uint32_t>;
+private:
+    struct Interval {
+        float min, max;
+        uint32_t index;
+    };
+    std::vector<Interval> m_intervals;
+    std::vector<Pair> m_pairs;
+public:
+    // Pairs (i, j), i < j, of indices into 'objects' whose AABBs overlap and
+    // at least one of which is active. Sorted, so the narrowphase visits
+    // them in the same order as a plain double loop would.
+    const std::vector<Pair>& find_pairs(
+        const std::vector<std::shared_ptr<Object>>& objects);
+};
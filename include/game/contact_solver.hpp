@@ -0,0 +1,107 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "libs.hpp"
+#include "body_store.hpp"
+#include "broadphase.hpp"
+#include "object.hpp"
+
+struct SolverParams {
+    // Passes over the contacts solving the velocities
+    uint32_t velocity_iterations = 8;
+    // Passes solving the split impulses that push overlapping bodies apart
+    uint32_t position_iterations = 3;
+    // Fraction of the penetration removed in one step
+    float baumgarte = 0.2f;
+    // Penetration that is left alone, so resting bodies keep touching
+    float slop = 0.01f;
+    // Share of the approach speed a bounce keeps, times the bounciness
+    float restitution = 0.8f;
+    // Slower approaches do not bounce, piles come to rest instead
+    float restitution_threshold = 1.f;
+    float friction = 0.2f;
+    // Starts every contact from its impulses of the last step
+    bool warm_start = true;
+    // Contacts turn the bodies, off solves them as if nothing could rotate
+    bool rotation = true;
+};
+
+// Sequential impulses over the contact points of the overlapping pairs. A
+// pair touches in up to Penetration::MAX_POINTS points sharing one normal,
+// every point is solved on its own, with the impulses applied off the centers
+// of the bodies so that they turn them.
+//
+// Contacts are kept between steps, keyed by the ids of the two objects, and
+// every point starts from the impulses of the nearest point the same pair had
+// in the last step, so a resting pile needs only a few passes to converge.
+// Penetration is removed by split impulses: they move and turn the bodies
+// apart without adding to their velocities, so the correction does not make
+// them bounce.
+class ContactSolver {
+public:
+    struct Contact {
+        // Ids of the two objects, the smaller one in the high half
+        uint64_t key;
+        // Rows in the BodyStore, the normal points from 'a' to 'b'
+        uint32_t a, b;
+        glm::vec3 normal;
+        // Directions of the friction, orthogonal to the normal
+        glm::vec3 tangents[2];
+        // Of the contact point in the world and from the centers of the bodies
+        glm::vec3 point;
+        glm::vec3 ra, rb;
+        float depth;
+        float inv_mass_a, inv_mass_b;
+        glm::mat3 inv_inertia_a, inv_inertia_b;
+        // Effective masses along the normal and the tangents, zero when
+        // neither body can be pushed
+        float normal_mass;
+        float tangent_mass[2];
+        float restitution;
+        // Normal velocity the contact is solved to, the bounce
+        float target;
+        // Accumulated impulses on 'b', the ones on 'a' are opposite
+        float normal_impulse;
+        float friction_impulse[2];
+        float split_impulse;
+    };
+
+private:
+    SolverParams m_params;
+    // Sorted by the key, the contacts of this step and of the last one
+    std::vector<Contact> m_contacts;
+    std::vector<Contact> m_previous;
+    // Index of the first point of every pair that did not touch in the last
+    // step
+    std::vector<uint32_t> m_began;
+    // Velocity and angular velocity of the split impulses per row of the
+    // BodyStore
+    std::vector<glm::vec3> m_push;
+    std::vector<glm::vec3> m_twist;
+
+public:
+    explicit ContactSolver(const SolverParams& params);
+
+    // Finds the contacts of the broadphase 'pairs' of indices into 'objects'
+    void collide(const std::vector<std::shared_ptr<Object>>& objects,
+        const std::vector<Broadphase::Pair>& pairs);
+    // Changes the velocities in 'bodies' to resolve the contacts and pushes
+    // the overlapping bodies apart, the rows must not change after collide()
+    void solve(BodyStore& bodies, const float time_delta);
+
+    const std::vector<Contact>& get_contacts() const {
+        return m_contacts;
+    }
+    const std::vector<uint32_t>& get_began() const {
+        return m_began;
+    }
+    const SolverParams& get_params() const {
+        return m_params;
+    }
+
+private:
+    void warm_start(BodyStore& bodies);
+    void solve_velocities(BodyStore& bodies);
+    void solve_positions(BodyStore& bodies, const float time_delta);
+};
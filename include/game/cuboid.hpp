@@ -7,60 +7,52 @@
 
 class Cuboid : public Object {
 protected:
-    GLuint m_program;
     GLuint m_tex;
-    GLint m_tex_loc;
 
     PV112::PV112Geometry m_geometry;
-    glm::vec3 m_center;
     glm::vec3 m_scale;
     glm::vec3 m_halfw;
 public:
-    Cuboid() = default;
-    Cuboid(const GLuint program, const PV112::PV112Geometry& geometry,
+    Cuboid(BodyStore& store, const PV112::PV112Geometry& geometry,
         const GLuint tex, const glm::vec3& center, const glm::vec3& scale);
-    Cuboid(const GLuint program, const PV112::PV112Geometry& geometry,
+    Cuboid(BodyStore& store, const PV112::PV112Geometry& geometry,
         const GLuint tex, const glm::vec3& center, const glm::vec3& scale,
         const Motion& motion);
 
-    virtual glm::mat4 update_geometry(const float time);
-    virtual void render(const float time_delta) override;
+    glm::vec3 get_center() const {
+        return this->position();
+    }
+    OBB get_obb() const {
+        return {this->position(), glm::mat3_cast(this->orientation()), m_halfw};
+    }
+    // Turned boxes need the separating axis test, aligned ones only overlap
+    bool is_aligned() const {
+        const auto& q = this->orientation();
+        return q.x == 0 && q.y == 0 && q.z == 0;
+    }
+
+    virtual float get_max_scale() const override {
+        return 2 * std::max(std::max(m_halfw.x, m_halfw.y), m_halfw.z);
+    }
+    virtual glm::vec3 inertia() const final override;
+    virtual void integrate(const float time_delta, const glm::vec3& velocity) override;
+    virtual void describe_mesh(DrawItem& item) const override;
     virtual bool check_collision(const Object& other) const final override;
     virtual float mass() const final override;
 
     virtual bool check_collision_what(const Ball& other) const final override;
     virtual bool check_collision_what(const Cuboid& other) const final override;
 
-    virtual glm::vec3 bounce_normal(const Object& other) const final override;
-    virtual glm::vec3 bounce_normal_what(const Ball& other) const final override;
-    virtual glm::vec3 bounce_normal_what(const Cuboid& other) const final override;
+    virtual bool penetration(const Object& other, Penetration& out) const final override;
+    virtual bool penetration_what(const Ball& other, Penetration& out) const override;
+    virtual bool penetration_what(const Cuboid& other, Penetration& out) const final override;
+    virtual bool cast(const glm::vec3& origin, const glm::vec3& direction,
+        const float radius, float& distance, glm::vec3& normal) const override;
 
 protected:
-    void bind_cube_texture();
-    void init();
+    virtual void fit_bounds() final override;
 
 private:
     static AABB init_aabb(AABB aabb, const glm::vec3& center,
         const glm::vec3& scale);
 };
-
-class Cube : public Cuboid {
-public:
-    Cube() = default;
-    Cube(const GLuint program, const GLuint tex, const glm::vec3& center,
-        const float scale)
-     : Cuboid(program, get_cube_geometry(program), tex, center, glm::vec3(scale))
-    {}
-    Cube(const GLuint program, const GLuint tex, const glm::vec3& center,
-        const float scale, const Motion& motion)
-     : Cuboid(program, get_cube_geometry(program), tex, center, glm::vec3(scale),
-        motion)
-    {}
-
-    static PV112::PV112Geometry get_cube_geometry(const GLuint program) {
-        int position_loc  = glGetAttribLocation(program, "position");
-        int normal_loc    = glGetAttribLocation(program, "normal");
-        int tex_coord_loc = glGetAttribLocation(program, "tex_coord");
-        return PV112::CreateCube(position_loc, normal_loc, tex_coord_loc);
-    }
-};
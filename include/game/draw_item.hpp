@@ -0,0 +1,68 @@
+#pragma once
+#include <cstdint>
+#include "libs.hpp"
+#include "material_properties.hpp"
+
+namespace PV112 {
+struct MeshData;
+}
+
+// Everything the renderer needs to draw one object. Items are captured by the
+// simulation after every tick, so drawing never touches objects the
+// simulation may be changing at the same time.
+struct DrawItem {
+    uint32_t id;
+    glm::vec3 position;
+    glm::quat rotation;
+    // Scale of the unit mesh
+    glm::vec3 scale;
+    float tex_scale;
+
+    GLuint vao;
+    GLenum mode;
+    GLsizei arrays_count;
+    GLsizei elements_count;
+    GLuint tex;
+    MaterialProperties material;
+    // Vertices of the mesh in the main memory, if the geometry kept them
+    const PV112::MeshData* mesh;
+    // Never moves, see StaticBatch
+    bool is_static;
+
+    glm::mat4 model_matrix() const {
+        return glm::scale(glm::translate(glm::mat4(1.f), position)
+            * glm::mat4_cast(rotation), scale);
+    }
+    GLsizei triangles() const {
+        const GLsizei count = elements_count > 0 ? elements_count : arrays_count;
+        if (mode == GL_TRIANGLES) {
+            return count / 3;
+        }
+        return mode == GL_TRIANGLE_STRIP && count > 2 ? count - 2 : 0;
+    }
+};
+
+// Point light the renderer bins into clusters, see LightClusters
+struct PointLight {
+    static constexpr uint32_t NO_OWNER = 0xffffffff;
+
+    glm::vec3 position;
+    // The light fades out completely at this distance
+    float radius;
+    glm::vec3 color;
+    // Id of the object the light follows, or NO_OWNER
+    uint32_t owner;
+};
+
+// One particle as the renderer draws it, a point sprite. The renderer moves
+// it along its velocity to the render time instead of interpolating.
+struct ParticleVertex {
+    glm::vec3 position;
+    // Diameter in world units
+    float size;
+    glm::vec3 velocity;
+    // RGBA, 8 bits each with red in the lowest byte
+    uint32_t color;
+};
+static_assert(sizeof(ParticleVertex) == 8 * sizeof(float),
+    "the vertex array reads it without padding");
@@ -1,83 +1,103 @@
 #pragma once
 #include "cuboid.hpp"
 
-class Enemy : public Cube {
+class Enemy : public Cuboid {
 public:
     struct Textures {
         std::vector<GLuint> texs;
     };
 private:
     static constexpr float DISAPPEAR_AFTER = 2.;
-    size_t m_hits = 0;
     std::vector<GLuint> m_textures;
     irrklang::ISoundEngine *m_sound;
+
+    // Hit counter lives in the body store so it can be inspected in bulk
+    uint32_t& hits() {
+        return m_store.hits[m_body];
+    }
+    uint32_t hits() const {
+        return m_store.hits[m_body];
+    }
 public:
 
-    Enemy() = default;
     template <class... Args>
     Enemy(const std::vector<GLuint>& textures, irrklang::ISoundEngine *sound,
-        Args... args)
-     : Cube(args...), m_textures(textures), m_sound(sound)
-    {}
-
-    void render(const float time) final override {
-        const GLuint tex = m_textures.at(std::min(m_hits, m_textures.size() - 1));
-        glBindVertexArray(m_geometry.VAO);
+        Args&&... args)
+     : Cuboid(std::forward<Args>(args)...), m_textures(textures), m_sound(sound)
+    {
+        m_store.kind[m_body] = BodyStore::ENEMY;
+    }
 
-        glUniform1i(m_tex_loc, 0); // Choose proper texture unit
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, tex);
-        DrawGeometry(m_geometry);
+    void describe_mesh(DrawItem& item) const final override {
+        Cuboid::describe_mesh(item);
+        item.tex = m_textures.at(std::min<size_t>(hits(), m_textures.size() - 1));
     }
 
+    uint32_t get_hits() const {
+        return hits();
+    }
     bool is_alive() const {
-        return m_hits < m_textures.size() - 1;
+        return hits() < m_textures.size() - 1;
     }
 
     bool kills_player(const glm::vec3 positon) {
-        return glm::distance(m_center, positon) < 1.f && is_alive();
+        return glm::distance(this->position(), positon) < 1.f && is_alive();
     }
 
-    virtual glm::mat4 update_geometry(const float) {
-        auto model_matrix = glm::translate(glm::mat4(1.f), m_center);
-        model_matrix = glm::scale(model_matrix, m_scale);
-        return model_matrix;
+    // Enemies are moved by steer() only, gravity included
+    virtual void accelerate(const float) final override {
+    }
+    virtual void integrate(const float, const glm::vec3&) final override {
     }
 
     void maybe_activate(const glm::vec3 dir) {
         if (!m_motion.active) {
-            m_motion = Motion(dir, 2.);
+            // Enemies stay upright, contacts do not turn them
+            Motion motion(dir, 2.);
+            motion.rotates = false;
+            this->set_motion(motion);
         }
     }
 
-    void follow_player(const float time_delta, const glm::vec3 player_position) {
-
+    glm::vec3 get_velocity() const {
+        return this->velocity();
+    }
 
-        m_motion.account_gravity(time_delta);
-        auto to_player = player_position - m_center;
-        this->maybe_activate(to_player);
-        to_player.y = 0;
+    // Moves the enemy with the horizontal velocity chosen by SteeringSystem,
+    // gravity still acts on the vertical component.
+    void steer(const glm::vec3 player_position, const float vx, const float vz,
+        const float time_delta) {
+        this->maybe_activate(player_position - this->position());
+        auto& v = this->velocity();
+        m_motion.account_gravity(v, time_delta);
+        v.x = vx;
+        v.z = vz;
 
-        m_center = m_center + time_delta * m_motion.v;
-        m_aabb.set_center(m_center);
+        this->position() += time_delta * v;
     }
 
 
     virtual void got_hit(const uint32_t other_id, const float time) {
-        if (m_last_contact != other_id) {
-            ++m_hits;
-            if (is_alive()) {
-                // Leaks memory
-                m_sound->play2D("audio/hit.wav", GL_FALSE);
-            } else if (m_hits == m_textures.size() - 1) {
-                m_motion.active = true;
-                // Leaks memory
-                m_sound->play2D("audio/death.wav", GL_FALSE);
-                this->set_expiration_time(time + DISAPPEAR_AFTER);
-            }
+        ++hits();
+        if (is_alive()) {
+            // Leaks memory
+            this->play("audio/hit.wav");
+        } else if (hits() == m_textures.size() - 1) {
+            m_motion.active = true;
+            // Leaks memory
+            this->play("audio/death.wav");
+            this->set_expiration_time(time + DISAPPEAR_AFTER);
         }
     }
     virtual float get_max_scale() const {
         return 1.;
     }
+
+private:
+    // Worlds simulated without a window have no sound
+    void play(const char* sound) {
+        if (m_sound) {
+            m_sound->play2D(sound, GL_FALSE);
+        }
+    }
 };
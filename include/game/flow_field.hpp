@@ -0,0 +1,116 @@
+#pragma once
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "libs.hpp"
+#include "object.hpp"
+
+// Grid flow field over the XZ plane of the arena. Every cell stores the
+// direction of the shortest obstacle-free path towards the target, so any
+// number of enemies can look their heading up in O(1).
+//
+// The field is rebuilt on a worker thread whenever the target moves to
+// another cell or an obstacle, e.g. a pushed box, covers other cells than
+// at the last rebuild. Every rebuild is a full Dijkstra over the grid, so a
+// box rolling across the arena costs one per tick, the worker drops the
+// requests it has not started yet. The finished field is published as an immutable snapshot and
+// the worker fills a second buffer for the next rebuild, so the frame never
+// waits for it. Without the worker the rebuild happens inside update(),
+// which keeps batch simulations deterministic.
+class FlowField {
+public:
+    struct Field {
+        float min_x = 0, min_z = 0;
+        float cell_size = 1;
+        uint32_t dim_x = 0, dim_z = 0;
+        int32_t target_cell = -1;
+
+        std::vector<uint8_t> blocked;
+        std::vector<float> cost;
+        // Unit direction towards the target, zero if there is no path
+        std::vector<float> dir_x, dir_z;
+
+        // Returns false if (x, z) is outside the field or has no path
+        bool sample(const float x, const float z, float& out_x, float& out_z) const {
+            const int32_t cell = cell_of(x, z);
+            if (cell < 0) {
+                return false;
+            }
+            out_x = dir_x[cell];
+            out_z = dir_z[cell];
+            return out_x != 0 || out_z != 0;
+        }
+        int32_t cell_of(const float x, const float z) const {
+            const float fx = (x - min_x) / cell_size;
+            const float fz = (z - min_z) / cell_size;
+            if (fx < 0 || fz < 0 || fx >= dim_x || fz >= dim_z) {
+                return -1;
+            }
+            return uint32_t(fz) * dim_x + uint32_t(fx);
+        }
+    };
+    using Bounds = std::array<std::array<float, 2>, 3>;
+
+private:
+    // Cells an inflated obstacle covers, x0, x1, z0, z1 inclusive
+    using Footprint = std::array<int32_t, 4>;
+    struct Job {
+        glm::vec3 target;
+        std::vector<Footprint> footprints;
+        // Open list of the Dijkstra, kept for the next job
+        std::vector<std::pair<float, int32_t>> open;
+    };
+
+    Bounds m_bounds;
+    float m_cell_size;
+    // Obstacles are inflated by this much so enemies do not scrape them
+    float m_margin;
+    uint32_t m_dim_x, m_dim_z;
+    int32_t m_requested_cell = -1;
+    // Of the obstacles at the last request, and as they are now
+    std::vector<Footprint> m_requested_footprints;
+    std::vector<Footprint> m_footprints;
+    bool m_threaded;
+
+    std::shared_ptr<const Field> m_front;
+    std::shared_ptr<Field> m_back;
+
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::unique_ptr<Job> m_pending;
+    // A finished job, the next request reuses its buffers
+    std::unique_ptr<Job> m_spare;
+    bool m_stop = false;
+    std::thread m_worker;
+
+public:
+    FlowField(const Bounds& bounds, const float cell_size = 0.5f,
+        const float margin = 0.3f, const bool threaded = true);
+    ~FlowField();
+    FlowField(const FlowField&) = delete;
+    FlowField& operator=(const FlowField&) = delete;
+
+    // Schedules a rebuild if the target left the cell of the last request or
+    // the obstacles cover other cells. Never blocks on the worker, builds the
+    // field right away without one.
+    void update(const glm::vec3& target,
+        const std::vector<std::shared_ptr<Object>>& obstacles);
+
+    // Latest finished field or nullptr before the first rebuild is done
+    std::shared_ptr<const Field> get() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_front;
+    }
+
+private:
+    int32_t target_cell(const glm::vec3& target) const;
+    Footprint footprint(const AABB& aabb) const;
+    void run();
+    void publish();
+    void build(Job& job, Field& field) const;
+};
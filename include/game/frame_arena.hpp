@@ -0,0 +1,94 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Bump allocator for data that lives within one frame or one world step.
+// allocate() moves a pointer, deallocate() does nothing and reset() rewinds
+// the whole arena at once. When a frame needs more than the arena holds,
+// further blocks are chained and the next reset() replaces them all by one
+// block big enough for the whole frame, so after a frame or two of warm-up
+// the arena stops allocating altogether.
+//
+// An arena belongs to one thread, like the world or the renderer using it.
+class FrameArena {
+private:
+    struct Block {
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+    std::vector<Block> m_blocks;
+    // Offset of the free space in the last block
+    size_t m_offset = 0;
+    // Bytes used in the blocks before the last one
+    size_t m_used_before = 0;
+    size_t m_high_water = 0;
+    uint64_t m_block_allocations = 0;
+
+public:
+    explicit FrameArena(const size_t capacity = 64 << 10);
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    void* allocate(const size_t size, const size_t alignment);
+    // Frees everything allocated since the last reset
+    void reset();
+
+    size_t get_used() const {
+        return m_used_before + m_offset;
+    }
+    size_t get_capacity() const;
+    // Most bytes a frame used so far
+    size_t get_high_water() const {
+        return m_high_water;
+    }
+    // Blocks taken from the heap, stays put in the steady state
+    uint64_t get_block_allocations() const {
+        return m_block_allocations;
+    }
+
+private:
+    void add_block(const size_t size);
+};
+
+// Standard allocator on top of a FrameArena, for the containers that are
+// filled and dropped within a frame. The containers must not outlive the
+// next reset() of their arena.
+template <typename T>
+class ArenaAllocator {
+public:
+    using value_type = T;
+
+private:
+    FrameArena* m_arena;
+
+    template <typename U>
+    friend class ArenaAllocator;
+
+public:
+    explicit ArenaAllocator(FrameArena& arena)
+     : m_arena(&arena)
+    {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other)
+     : m_arena(other.m_arena)
+    {}
+
+    T* allocate(const size_t count) {
+        return static_cast<T*>(m_arena->allocate(count * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U>& other) const {
+        return m_arena == other.m_arena;
+    }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U>& other) const {
+        return m_arena != other.m_arena;
+    }
+};
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
@@ -1,9 +1,116 @@
 #pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "game/body_store.hpp"
+#include "game/contact_solver.hpp"
+#include "game/integrator.hpp"
+#include "game/particle_system.hpp"
+#include "game/profiler.hpp"
+#include "game/scene_generator.hpp"
+
+class World;
 
 struct GameOptions {
     bool machine_gun = true;
     float game_time = 35;
     float ball_time = 10;
+    // Enemies start chasing the player after this many seconds
+    float enemy_delay = 30;
+    SceneParams scene;
+    // Iterations and tolerances of the contact solver
+    SolverParams solver;
+    // Substeps and the longest step, see Integrator
+    IntegratorParams integrator;
+    // Sparks and debris of the enemies
+    ParticleParams particles;
+    // Simulation ticks per second, independent of the frame rate
+    float tick_rate = 60;
+    // Frames per second the rendering is capped at, 0 means no cap
+    float render_rate = 0;
+    // Steps the simulation on a thread of its own rather than in the frame loop
+    bool threaded_simulation = true;
+    // Lays down the depth of the scene with a trivial shader first, so the
+    // lighting shader runs once per visible pixel
+    bool depth_prepass = true;
+    // Skips drawing the objects hidden behind the static scene, determined
+    // by occlusion queries in the depth prepass. Needs depth_prepass.
+    bool occlusion_culling = true;
+    // Rebuilds the shader programs whenever their files change
+    bool hot_reload_shaders = true;
+    // Prints the timeline of the startup and the shader cache hits to
+    // stdout, and the phase timings, the frame graph and the live GL objects
+    // when the game ends
+    bool verbose = false;
+    // Renders into a framebuffer of a hidden window instead of the screen,
+    // without sound and with the camera circling the arena, for benchmarks.
+    // Works on software rasterizers such as Mesa llvmpipe.
+    bool offscreen = false;
+    // Size of the window or the framebuffer, 0 takes the primary monitor,
+    // or 1280x720 offscreen
+    uint32_t width = 0;
+    uint32_t height = 0;
+    // Stops after this many frames, 0 plays until the game is over
+    uint32_t frames = 0;
+    // Called after every simulation tick, with the tick length in seconds and
+    // on the simulation thread. It is the place to inspect the bodies and to
+    // spawn or despawn objects.
+    std::function<void(float)> on_frame;
+};
+
+// Counters of the last rendered frame, the samples lag a frame or two
+struct RenderStats {
+    uint64_t triangles = 0;
+    // Pixels of the window
+    uint64_t pixels = 0;
+    // Samples that ran the lighting shader, over 'pixels' it is the overdraw
+    uint64_t shaded_samples = 0;
+    // Samples the depth prepass wrote, 0 without it
+    uint64_t prepass_samples = 0;
+    // Program, texture and vertex array switches between the dynamic objects
+    uint32_t state_changes = 0;
+    // Lighting program variants switched to, the static scene included
+    uint32_t program_switches = 0;
+    // Draw calls of all passes, without the overlay
+    uint32_t draw_calls = 0;
+    // Dynamic objects the occlusion queries found visible and hidden
+    uint32_t visible_objects = 0;
+    uint32_t occluded_objects = 0;
+};
+
+// One frame of a run with GameOptions::frames set
+struct FrameRecord {
+    // Wall time of the frame loop iteration
+    double cpu_ms = 0;
+    // GPU time of drawing, lags a frame or two like RenderStats
+    double gpu_ms = 0;
+    uint32_t draw_calls = 0;
+    uint64_t triangles = 0;
+    // Heap allocations of the render thread in the frame, 0 once warm
+    uint64_t allocations = 0;
 };
 
 int run_game(const GameOptions& opts);
+// Per-phase timings of the current or the last finished game
+const std::vector<PhaseTiming>& last_timings();
+const RenderStats& last_render_stats();
+// Every frame of the current or the last finished run that had a frame limit
+const std::vector<FrameRecord>& last_frames();
+
+// World of the running game, shared so that whoever holds it may keep it
+// past the end of the game. Its bodies are the state of every object, the
+// rows are reordered by despawn and the arrays may move once more bodies are
+// spawned than the reserved capacity. Its queries cast into the game as it
+// is now.
+std::shared_ptr<World> game_world();
+// Batch spawning into the running game, see World for the details.
+// 'positions' and 'velocities' hold 'count' xyz triplets.
+std::vector<uint32_t> spawn_balls(const float* positions,
+    const float* velocities, const float* radii, const size_t count);
+std::vector<uint32_t> spawn_boxes(const float* positions,
+    const float* velocities, const size_t count);
+std::vector<uint32_t> spawn_enemies(const float* positions,
+    const float* scales, const size_t count);
+// Removes objects with the given ids, returns how many were found
+size_t despawn(const uint32_t* ids, const size_t count);
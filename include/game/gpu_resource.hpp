@@ -0,0 +1,164 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <vector>
+#include "libs.hpp"
+
+enum class GpuKind : uint8_t {
+    BUFFER,
+    VERTEX_ARRAY,
+    TEXTURE,
+    RENDERBUFFER,
+    PROGRAM,
+    COUNT
+};
+
+// Live GL objects and their estimated memory per kind, and the objects whose
+// handles went away but are not deleted yet. Handles may go away on any
+// thread and with or without a current context, the objects are deleted by
+// flush(), on the GL thread between frames.
+class GpuLedger {
+public:
+    struct Entry {
+        int64_t objects = 0;
+        int64_t bytes = 0;
+    };
+
+private:
+    struct Garbage {
+        GpuKind kind;
+        GLuint id;
+        size_t bytes;
+    };
+
+    static std::array<Entry, size_t(GpuKind::COUNT)> s_entries;
+    static std::mutex s_mutex;
+    static std::vector<Garbage> s_garbage;
+
+public:
+    static const char* name(const GpuKind kind);
+    static const Entry& get(const GpuKind kind) {
+        return s_entries[size_t(kind)];
+    }
+    static int64_t total_bytes();
+    static int64_t total_objects();
+
+    // Called by the handles
+    static void created(const GpuKind kind, const size_t bytes);
+    static void resized(const GpuKind kind, const size_t from, const size_t to);
+    static void release(const GpuKind kind, const GLuint id, const size_t bytes);
+
+    // Deletes the released objects, with the context current
+    static void flush();
+    static void dump(std::ostream& out);
+};
+
+// Move-only owner of a GL object. It is created by create() or adopts an
+// existing name, the object is deleted by GpuLedger::flush() after the
+// handle is reset or destroyed. Sizes are estimates the owner keeps up to
+// date with set_bytes(), they only feed the ledger.
+template <GpuKind KIND>
+class GpuHandle {
+private:
+    GLuint m_id = 0;
+    size_t m_bytes = 0;
+
+public:
+    GpuHandle() = default;
+    explicit GpuHandle(const GLuint id, const size_t bytes = 0)
+     : m_id(id), m_bytes(bytes)
+    {
+        if (m_id != 0) {
+            GpuLedger::created(KIND, m_bytes);
+        }
+    }
+    GpuHandle(GpuHandle&& other)
+     : m_id(other.m_id), m_bytes(other.m_bytes)
+    {
+        other.m_id = 0;
+        other.m_bytes = 0;
+    }
+    GpuHandle& operator=(GpuHandle&& other) {
+        if (this != &other) {
+            this->reset();
+            m_id = other.m_id;
+            m_bytes = other.m_bytes;
+            other.m_id = 0;
+            other.m_bytes = 0;
+        }
+        return *this;
+    }
+    GpuHandle(const GpuHandle&) = delete;
+    GpuHandle& operator=(const GpuHandle&) = delete;
+    ~GpuHandle() {
+        this->reset();
+    }
+
+    // Generates a new object, programs are adopted from glCreateProgram
+    static GpuHandle create();
+
+    void reset() {
+        if (m_id != 0) {
+            GpuLedger::release(KIND, m_id, m_bytes);
+        }
+        m_id = 0;
+        m_bytes = 0;
+    }
+    void set_bytes(const size_t bytes) {
+        if (m_id != 0) {
+            GpuLedger::resized(KIND, m_bytes, bytes);
+        }
+        m_bytes = bytes;
+    }
+
+    GLuint get() const {
+        return m_id;
+    }
+    size_t get_bytes() const {
+        return m_bytes;
+    }
+    explicit operator bool() const {
+        return m_id != 0;
+    }
+};
+
+using GpuBuffer = GpuHandle<GpuKind::BUFFER>;
+using GpuVertexArray = GpuHandle<GpuKind::VERTEX_ARRAY>;
+using GpuTexture = GpuHandle<GpuKind::TEXTURE>;
+using GpuRenderbuffer = GpuHandle<GpuKind::RENDERBUFFER>;
+using GpuProgram = GpuHandle<GpuKind::PROGRAM>;
+
+template <>
+inline GpuBuffer
+GpuBuffer::create() {
+    GLuint id;
+    glGenBuffers(1, &id);
+    return GpuBuffer(id);
+}
+
+template <>
+inline GpuVertexArray
+GpuVertexArray::create() {
+    GLuint id;
+    glGenVertexArrays(1, &id);
+    return GpuVertexArray(id);
+}
+
+template <>
+inline GpuTexture
+GpuTexture::create() {
+    GLuint id;
+    glGenTextures(1, &id);
+    return GpuTexture(id);
+}
+
+template <>
+inline GpuRenderbuffer
+GpuRenderbuffer::create() {
+    GLuint id;
+    glGenRenderbuffers(1, &id);
+    return GpuRenderbuffer(id);
+}
@@ -1,16 +1,44 @@
 #pragma once
 
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <vector>
 #include "libs.hpp"
 // Include the most important GLM functions
 
 namespace PV112 {
 
 
-// Loads a texture from file and calls glTexImage2D to se its data.
+/// Pixels of an image in the main memory, in the format DevIL decoded them to.
+struct ImageData
+{
+    int Width = 0;
+    int Height = 0;
+    GLint InternalFormat = 0;
+    GLenum Format = 0;
+    GLenum Type = 0;
+    std::vector<unsigned char> Pixels;
+};
+
+// Reads and decodes an image file without any OpenGL call, so it may run on any thread.
+// DevIL decodes into an image bound globally, so only the reading of the files runs in
+// parallel, the decoding takes a lock.
 // Returns true on success or false on failure.
-// NOTE 1a) Describe
-inline bool LoadAndSetTexture(const maybewchar *filename, GLenum target)
+inline bool ReadImage(const maybewchar *filename, ImageData &out)
 {
+    std::ifstream file(filename, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Couldn't load texture: " << filename << std::endl;
+        return false;
+    }
+    const std::vector<char> bytes((std::istreambuf_iterator<char>(file)),
+        std::istreambuf_iterator<char>());
+
+    static std::mutex devil_mutex;
+    std::lock_guard<std::mutex> lock(devil_mutex);
+
     // Create IL image
     ILuint IL_tex;
     ilGenImages(1, &IL_tex);
@@ -21,8 +49,9 @@ inline bool LoadAndSetTexture(const maybewchar *filename, GLenum target)
     ilEnable(IL_ORIGIN_SET);
     ilOriginFunc(IL_ORIGIN_LOWER_LEFT);
 
-    // Load IL image
-    ILboolean success = ilLoadImage(filename);
+    // Load IL image, the type is told by the contents
+    ILboolean success = !bytes.empty()
+        && ilLoadL(IL_TYPE_UNKNOWN, bytes.data(), ILuint(bytes.size()));
     if (!success)
     {
         ilBindImage(0);
@@ -32,21 +61,18 @@ inline bool LoadAndSetTexture(const maybewchar *filename, GLenum target)
     }
 
     // Get IL image parameters
-    int img_width = ilGetInteger(IL_IMAGE_WIDTH);
-    int img_height = ilGetInteger(IL_IMAGE_HEIGHT);
+    out.Width = ilGetInteger(IL_IMAGE_WIDTH);
+    out.Height = ilGetInteger(IL_IMAGE_HEIGHT);
     int img_format = ilGetInteger(IL_IMAGE_FORMAT);
-    int img_type = ilGetInteger(IL_IMAGE_TYPE);
+    out.Type = ilGetInteger(IL_IMAGE_TYPE); // IL constants matches GL constants
 
-    // Choose internal format, format, and type for glTexImage2D
-    GLint internal_format = 0;
-    GLenum format = 0;
-    GLenum type = img_type; // IL constants matches GL constants
+    // Choose internal format and format for glTexImage2D
     switch (img_format)
     {
-    case IL_RGB:  internal_format = GL_RGB;  format = GL_RGB;  break;
-    case IL_RGBA: internal_format = GL_RGBA; format = GL_RGBA; break;
-    case IL_BGR:  internal_format = GL_RGB;  format = GL_BGR;  break;
-    case IL_BGRA: internal_format = GL_RGBA; format = GL_BGRA; break;
+    case IL_RGB:  out.InternalFormat = GL_RGB;  out.Format = GL_RGB;  break;
+    case IL_RGBA: out.InternalFormat = GL_RGBA; out.Format = GL_RGBA; break;
+    case IL_BGR:  out.InternalFormat = GL_RGB;  out.Format = GL_BGR;  break;
+    case IL_BGRA: out.InternalFormat = GL_RGBA; out.Format = GL_BGRA; break;
     case IL_COLOR_INDEX:
     case IL_ALPHA:
     case IL_LUMINANCE:
@@ -58,10 +84,8 @@ inline bool LoadAndSetTexture(const maybewchar *filename, GLenum target)
         return false;
     }
 
-    // Set the data to OpenGL (assumes texture object is already bound)
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-    glTexImage2D(target, 0, internal_format, img_width, img_height, 0, format,
-            type, ilGetData());
+    const ILubyte *data = ilGetData();
+    out.Pixels.assign(data, data + ilGetInteger(IL_IMAGE_SIZE_OF_DATA));
 
     // Unset and delete IL texture
     ilBindImage(0);
@@ -70,6 +94,28 @@ inline bool LoadAndSetTexture(const maybewchar *filename, GLenum target)
     return true;
 }
 
+// Calls glTexImage2D to set the data of the image (assumes texture object is already bound).
+inline void SetTextureImage(const ImageData &image, GLenum target)
+{
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(target, 0, image.InternalFormat, image.Width, image.Height, 0, image.Format,
+            image.Type, image.Pixels.data());
+}
+
+// Loads a texture from file and calls glTexImage2D to se its data.
+// Returns true on success or false on failure.
+// NOTE 1a) Describe
+inline bool LoadAndSetTexture(const maybewchar *filename, GLenum target)
+{
+    ImageData image;
+    if (!ReadImage(filename, image))
+    {
+        return false;
+    }
+    SetTextureImage(image, target);
+    return true;
+}
+
 inline GLuint CreateAndLoadTexture(const maybewchar *filename)
 {
     // Create OpenGL texture object
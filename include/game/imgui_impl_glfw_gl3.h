@@ -7,10 +7,14 @@
 // https://github.com/ocornut/imgui
 
 struct GLFWwindow;
+class StreamBuffer;
 
 IMGUI_API bool        ImGui_ImplGlfwGL3_Init(GLFWwindow* window, bool install_callbacks);
 IMGUI_API void        ImGui_ImplGlfwGL3_Shutdown();
 IMGUI_API void        ImGui_ImplGlfwGL3_NewFrame();
+// Draw lists are written to 'stream' instead of the own buffers, NULL goes back to them.
+// Its frame has to be begun before ImGui::Render().
+IMGUI_API void        ImGui_ImplGlfwGL3_SetStreamBuffer(StreamBuffer* stream);
 
 // Use if you want to reset your rendering device without losing ImGui state.
 IMGUI_API void        ImGui_ImplGlfwGL3_InvalidateDeviceObjects();
@@ -0,0 +1,73 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "libs.hpp"
+#include "body_store.hpp"
+
+class Object;
+
+struct IntegratorParams {
+    enum Method : uint8_t {
+        // Moves the bodies by their velocities after the step
+        SEMI_IMPLICIT_EULER = 0,
+        // Moves them by the mean of the velocities before and after the
+        // step, which is exact for a free fall
+        VELOCITY_VERLET = 1
+    };
+    Method method = SEMI_IMPLICIT_EULER;
+    // Longer steps are cut to this, a hitch slows the world down for a moment
+    // instead of letting the bodies jump through each other
+    float max_time_delta = 1.f / 20;
+    // Share of its smallest width a body may move in one substep
+    float max_travel = 1.f;
+    // Substeps a step is split into at most, 1 turns the substeps off
+    uint32_t max_substeps = 8;
+};
+
+// Splits the steps of a world into substeps short enough for its fastest
+// body, relative to its size, so that a small fast ball does not pass
+// through a wall between two steps. Every substep applies the forces,
+// solves the contacts and then moves the bodies, the integrator decides by
+// which velocity.
+class Integrator {
+public:
+    struct Stats {
+        // Of the last step
+        uint32_t substeps = 0;
+        // Bodies that needed more than one substep in the last step
+        uint32_t fast_bodies = 0;
+        // Steps that needed more than max_substeps
+        uint64_t capped_steps = 0;
+        // Seconds cut off the steps by max_time_delta
+        double clamped_time = 0;
+    };
+
+private:
+    IntegratorParams m_params;
+    // Per row of the BodyStore at the start of the substep, for the Verlet
+    std::vector<glm::vec3> m_start_velocity;
+    Stats m_stats;
+
+public:
+    explicit Integrator(const IntegratorParams& params = IntegratorParams());
+
+    // Length of the step to simulate in place of 'time_delta'
+    float clamp(const float time_delta);
+    // Substeps the step needs for none of 'bodies' to move further than
+    // max_travel of its width in one, at most max_substeps
+    uint32_t substeps(const BodyStore& bodies, const float time_delta);
+    // Before the forces of every substep
+    void begin(const BodyStore& bodies);
+    // Moves the 'objects' once the contacts of the substep are solved, the
+    // rows of 'bodies' must not change after begin()
+    void integrate(const std::vector<std::shared_ptr<Object>>& objects,
+        const BodyStore& bodies, const float time_delta) const;
+
+    const IntegratorParams& get_params() const {
+        return m_params;
+    }
+    const Stats& get_stats() const {
+        return m_stats;
+    }
+};
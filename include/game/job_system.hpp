@@ -0,0 +1,146 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "profiler.hpp"
+
+// Tasks of a frame and the order they depend on each other in. The graph is
+// declared once and run by a JobSystem every frame. A task runs when all the
+// tasks it depends on are done, tasks with no path between them may run at
+// the same time on different threads. MAIN tasks always run on the thread
+// calling JobSystem::run(), which is the one owning the GL context and the
+// window. A parallel task is split into 'count' jobs taking an index each.
+//
+// Timings are kept per task: the wall time from the first job starting to
+// the last one finishing, and the heap allocations of all of its jobs. The
+// times of the last run relative to its start make a timeline.
+class TaskGraph {
+public:
+    using TaskId = uint32_t;
+    enum class Affinity : uint8_t {
+        ANY,
+        MAIN
+    };
+
+private:
+    friend class JobSystem;
+
+    struct Task {
+        std::string name;
+        std::function<void(size_t)> function;
+        size_t count;
+        Affinity affinity;
+        std::vector<TaskId> successors;
+        uint32_t dependencies = 0;
+
+        // State of the running frame
+        std::atomic<uint32_t> waiting_for{0};
+        std::atomic<size_t> jobs_left{0};
+        std::atomic<int64_t> start_ns{0};
+        // Only written by the last job
+        int64_t end_ns = 0;
+        std::atomic<uint64_t> allocations{0};
+    };
+
+    std::vector<std::unique_ptr<Task>> m_tasks;
+    Profiler m_timings;
+    int64_t m_run_ns = 0;
+
+public:
+    TaskGraph() = default;
+    TaskGraph(const TaskGraph&) = delete;
+    TaskGraph& operator=(const TaskGraph&) = delete;
+
+    TaskId add(const char* name, std::function<void()> function,
+        const std::vector<TaskId>& dependencies = {},
+        const Affinity affinity = Affinity::ANY);
+    TaskId add_parallel(const char* name, const size_t count,
+        std::function<void(size_t)> function,
+        const std::vector<TaskId>& dependencies = {});
+
+    size_t size() const {
+        return m_tasks.size();
+    }
+    // In the order the tasks were added
+    const std::vector<PhaseTiming>& get_timings() const {
+        return m_timings.get_phases();
+    }
+    // Every task with the tasks it waits for
+    void dump(std::ostream& out) const;
+    // When every task of the last run started and ended, with a bar each
+    void dump_timeline(std::ostream& out) const;
+};
+
+// Workers that run task graphs, with the thread calling run() as one of
+// them. Every thread has its own queue of jobs: the jobs a thread makes
+// ready go to its own queue and it takes the newest one first, while an idle
+// thread steals the oldest job of another one. MAIN jobs have a queue of
+// their own only the calling thread takes from.
+//
+// A thread that finds no job spins for a little while and then sleeps until
+// a job is ready or the graph is done, the workers sleep between frames.
+class JobSystem {
+private:
+    struct Job {
+        TaskGraph::TaskId task;
+        uint32_t index;
+    };
+    // Every job goes to a queue once per run, so the queues never wrap
+    struct Queue {
+        std::mutex mutex;
+        std::vector<Job> jobs;
+        size_t front = 0;
+    };
+
+    std::vector<std::thread> m_workers;
+    // One per thread, the calling thread's is the first, then the MAIN jobs
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::mutex m_mutex;
+    std::condition_variable m_start_cv;
+    std::condition_variable m_ready_cv;
+    uint64_t m_generation = 0;
+    bool m_stop = false;
+
+    TaskGraph* m_graph = nullptr;
+    std::atomic<uint32_t> m_tasks_left{0};
+    // Jobs in the queues, any thread can take the first, only the calling
+    // thread the second
+    std::atomic<size_t> m_ready{0};
+    std::atomic<size_t> m_main_ready{0};
+
+public:
+    // 'threads' == 0 uses all cores, the calling thread included
+    explicit JobSystem(const uint32_t threads = 0);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Runs every task of 'graph' once and returns when all are done. Only
+    // one graph runs at a time, always from the same thread.
+    void run(TaskGraph& graph);
+
+    uint32_t size() const {
+        return m_workers.size() + 1;
+    }
+
+private:
+    Queue& main_queue() {
+        return *m_queues.back();
+    }
+    void push(const size_t thread, const TaskGraph::TaskId task);
+    bool pop(const size_t thread, Job& job);
+    bool steal(const size_t thread, Job& job);
+    void execute(const size_t thread, const Job& job);
+    void wake();
+    bool has_work(const size_t thread) const;
+    // Takes jobs until the graph is done
+    void work(const size_t thread);
+    void worker(const size_t thread);
+};
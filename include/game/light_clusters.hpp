@@ -0,0 +1,104 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "libs.hpp"
+#include "draw_item.hpp"
+#include "gpu_resource.hpp"
+
+// Clustered forward lighting. The view frustum is split into TILES_X x
+// TILES_Y tiles on the screen and SLICES exponential depth slices. Every
+// frame the lights are binned into the clusters they reach on the CPU, and
+// the lights, the per-cluster ranges and the light indices go to buffer
+// textures. The fragment shader finds its cluster from gl_FragCoord and its
+// view depth and loops over its lights only.
+//
+// An update is split into stages for the frame task graph: prepare(), then
+// bin_slice() for every slice in any order and on any threads, finish() and
+// upload(), the only one that needs the GL context.
+class LightClusters {
+public:
+    static constexpr uint32_t TILES_X = 16;
+    static constexpr uint32_t TILES_Y = 9;
+    static constexpr uint32_t SLICES = 24;
+    static constexpr uint32_t CLUSTERS = TILES_X * TILES_Y * SLICES;
+    // Lights beyond are dropped
+    static constexpr uint32_t MAX_LIGHTS = 1024;
+    // Texture units of the buffer textures, unit 0 is the albedo
+    static constexpr GLint LIGHTS_UNIT = 1;
+    static constexpr GLint GRID_UNIT = 2;
+    static constexpr GLint INDICES_UNIT = 3;
+
+    // Locations of the cluster uniforms in a program
+    struct Uniforms {
+        GLint view_matrix = -1;
+        GLint tile_size = -1;
+        GLint depth = -1;
+        GLint count = -1;
+    };
+
+private:
+    // The texture has no storage of its own, the buffer is counted
+    struct BufferTexture {
+        GpuBuffer buffer;
+        GpuTexture texture;
+    };
+    // View-space bounds of a cluster
+    struct Bounds {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    BufferTexture m_lights_tex;
+    BufferTexture m_grid_tex;
+    BufferTexture m_indices_tex;
+
+    // Frustum the bounds were computed for
+    float m_fov = 0;
+    float m_aspect = 0;
+    float m_near = 0;
+    float m_far = 0;
+    std::vector<Bounds> m_bounds;
+
+    // Two texels per light: position and radius, color
+    std::vector<glm::vec4> m_lights;
+    // View-space position and radius
+    std::vector<glm::vec4> m_view_lights;
+    std::vector<std::vector<uint32_t>> m_cluster_lights;
+    // Offset and count of every cluster in m_indices
+    std::vector<uint32_t> m_grid;
+    std::vector<uint32_t> m_indices;
+    uint32_t m_max_per_cluster = 0;
+
+public:
+    LightClusters();
+    LightClusters(const LightClusters&) = delete;
+    LightClusters& operator=(const LightClusters&) = delete;
+
+    // Points the samplers of 'program' to the units and returns the
+    // locations of its cluster uniforms
+    Uniforms set_program(const GLuint program) const;
+    void prepare(const std::vector<PointLight>& lights, const glm::mat4& view,
+        const float fov, const float aspect, const float near, const float far);
+    // Bins the lights into the clusters of one depth slice
+    void bin_slice(const uint32_t slice);
+    // Builds the cluster ranges and the light indices
+    void finish();
+    void upload();
+    // Binds the buffer textures to their units, once per frame
+    void bind_textures() const;
+    // Sets the uniforms of the program in use, every program once per frame
+    void set_uniforms(const Uniforms& uniforms, const glm::mat4& view,
+        const int width, const int height) const;
+
+    size_t get_light_count() const {
+        return m_view_lights.size();
+    }
+    // Most lights a cluster had to shade last update
+    uint32_t get_max_per_cluster() const {
+        return m_max_per_cluster;
+    }
+
+private:
+    void compute_bounds();
+    uint32_t slice_of(const float depth) const;
+};
@@ -0,0 +1,146 @@
+#pragma once
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+#include "libs.hpp"
+#include "obb.hpp"
+#include "thread_pool.hpp"
+
+// Bounding volume hierarchy over the triangles of a static mesh, for
+// colliding spheres with its actual surface instead of its bounds. Splits
+// minimize the surface area heuristic over binned triangle centroids.
+//
+// The nodes are flattened in depth first order: an inner node is followed by
+// its first child and keeps the index of the second one, a leaf keeps its
+// first triangle and their count. Two nodes fit in a cache line and the
+// array starts at one. The triangles are stored in the order of the leaves.
+class MeshBvh {
+public:
+    struct Node {
+        glm::vec3 min;
+        // Second child of an inner node, first triangle of a leaf
+        uint32_t offset;
+        glm::vec3 max;
+        // Zero for an inner node
+        uint32_t count;
+
+        bool is_leaf() const {
+            return count != 0;
+        }
+    };
+    static_assert(sizeof(Node) == 32, "two nodes per cache line");
+
+    static constexpr uint32_t MAX_LEAF = 4;
+    static constexpr uint32_t MAX_DEPTH = 64;
+
+    class Builder;
+
+private:
+    struct Free {
+        void operator()(Node* nodes) const {
+            std::free(nodes);
+        }
+    };
+
+    std::unique_ptr<Node[], Free> m_nodes;
+    uint32_t m_node_count = 0;
+    // Three corners per triangle
+    std::vector<glm::vec3> m_corners;
+    // Hash of the positions the tree was built from
+    uint64_t m_key = 0;
+
+public:
+    // Builds the tree over 'positions', three per triangle, spread over
+    // 'pool' when there is one. 'cache' is a file next to the mesh the tree
+    // is loaded from when it was built from the same positions, and saved to
+    // otherwise. An empty 'cache' always builds. Null without triangles.
+    static std::shared_ptr<const MeshBvh> build(
+        const std::vector<glm::vec3>& positions, const std::string& cache,
+        ThreadPool* pool = nullptr);
+
+    uint32_t node_count() const {
+        return m_node_count;
+    }
+    uint32_t triangle_count() const {
+        return m_corners.size() / 3;
+    }
+
+    // Deepest touch of the sphere with the mesh scaled by the positive
+    // 'scale' and moved to 'position'. The normal points from the mesh to
+    // the sphere.
+    bool collide(const glm::vec3& position, const glm::vec3& scale,
+        const glm::vec3& center, const float radius, Penetration& out) const;
+    // First touch of a ray or a moving sphere with the mesh placed the same
+    // way, see cast() in obb.hpp
+    bool cast(const glm::vec3& position, const glm::vec3& scale,
+        const glm::vec3& origin, const glm::vec3& direction, const float radius,
+        float& distance, glm::vec3& normal) const;
+
+private:
+    MeshBvh() = default;
+    void allocate(const uint32_t nodes);
+    bool load(const std::string& path, const uint64_t key, const uint32_t triangles);
+    void save(const std::string& path) const;
+};
+
+// Building in three steps, so that the middle one can run as a parallel task:
+// start() splits the top of the tree into SUBTREES independent ranges of
+// triangles, build() makes the subtree of one of them and finish() joins
+// them. A tree found in the cache skips the last two.
+class MeshBvh::Builder {
+public:
+    static constexpr uint32_t SUBTREES = 16;
+
+private:
+    struct Bounds {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+    struct Range {
+        uint32_t first;
+        uint32_t count;
+    };
+    // Node of the top of the tree, either split further or a subtree
+    struct Top {
+        Bounds bounds;
+        Range range;
+        uint32_t depth;
+        int32_t left = -1;
+        int32_t right = -1;
+        int32_t subtree = -1;
+    };
+
+    std::string m_cache;
+    std::vector<glm::vec3> m_positions;
+    uint64_t m_key = 0;
+    std::shared_ptr<MeshBvh> m_cached;
+
+    std::vector<Bounds> m_bounds;
+    std::vector<glm::vec3> m_centroids;
+    // Triangles in the order of the leaves, every range is sorted on its own
+    std::vector<uint32_t> m_order;
+    std::vector<Top> m_top;
+    // Index into m_top of every subtree, and the nodes built for it
+    std::vector<uint32_t> m_roots;
+    std::vector<std::vector<Node>> m_subtrees;
+
+public:
+    Builder(const std::vector<glm::vec3>& positions, const std::string& cache);
+
+    void start();
+    // Does nothing for an index without a subtree
+    void build(const size_t subtree);
+    // Null without triangles
+    std::shared_ptr<const MeshBvh> finish();
+
+private:
+    Bounds bounds(const Range& range) const;
+    // Partitions a range that is better split, 'middle' is the first
+    // triangle of the second half
+    bool split(const Range& range, const Bounds& bounds, uint32_t& middle);
+    void build(const Range& range, std::vector<Node>& nodes, const uint32_t depth);
+    int32_t build_top(const Range& range, const uint32_t depth);
+    void emit(const Top& top, MeshBvh& bvh, uint32_t& next) const;
+};
@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <utility>
+#include <vector>
+#include "libs.hpp"
+#include "PV112.h"
+#include "draw_item.hpp"
+
+// Levels of detail of one mesh, picked per object from how many pixels its
+// radius covers on the screen. An object keeps its level until its size
+// leaves the level's band by HYSTERESIS, so objects at a threshold do not
+// flicker between two meshes.
+class MeshLod {
+public:
+    struct Level {
+        PV112::PV112Geometry geometry;
+        // Projected radius from which the level is used
+        float min_pixels;
+    };
+
+private:
+    static constexpr float HYSTERESIS = 0.2f;
+
+    // Finest first, the last one has min_pixels 0
+    std::vector<Level> m_levels;
+    // Level of every object drawn last frame, sorted by id
+    std::vector<std::pair<uint32_t, uint8_t>> m_current;
+    std::vector<std::pair<uint32_t, uint8_t>> m_next;
+    size_t m_cursor = 0;
+
+    std::vector<uint32_t> m_objects;
+    std::vector<uint64_t> m_triangles;
+
+public:
+    explicit MeshLod(std::vector<Level> levels);
+
+    // Objects drawn with the finest level, the one the simulation hands out
+    bool applies(const DrawItem& item) const {
+        return item.vao == m_levels.front().geometry.VAO;
+    }
+    const PV112::PV112Geometry& get_finest() const {
+        return m_levels.front().geometry;
+    }
+
+    void begin_frame();
+    // Swaps the mesh of 'item' for its level. Items have to come in the
+    // order of their ids within a frame.
+    void select(DrawItem& item, const float pixels);
+    void end_frame();
+
+    size_t get_level_count() const {
+        return m_levels.size();
+    }
+    // Objects and triangles drawn with each level last frame
+    const std::vector<uint32_t>& get_objects() const {
+        return m_objects;
+    }
+    const std::vector<uint64_t>& get_triangles() const {
+        return m_triangles;
+    }
+
+private:
+    uint8_t level_of(const float pixels) const;
+};
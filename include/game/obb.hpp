@@ -0,0 +1,84 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include "libs.hpp"
+
+// How two objects overlap, the normal points from the first one to the other.
+// A face lying on a face touches in up to MAX_POINTS points, spread over the
+// area the two faces share, so a box resting on another one cannot tip over
+// one of them.
+struct Penetration {
+    static constexpr uint32_t MAX_POINTS = 4;
+
+    glm::vec3 normal;
+    // In the world space, halfway between the two surfaces
+    std::array<glm::vec3, MAX_POINTS> points;
+    // Overlap along the normal at every point
+    std::array<float, MAX_POINTS> depths;
+    uint32_t count = 0;
+
+    void add(const glm::vec3& point, const float depth) {
+        points[count] = point;
+        depths[count] = depth;
+        ++count;
+    }
+};
+
+// Box of any orientation, the shape of the cuboids
+struct OBB {
+    glm::vec3 center;
+    // Columns are the axes of the box in the world space
+    glm::mat3 axes;
+    glm::vec3 halfwidths;
+
+    // Halfwidths of the smallest AABB around the box
+    glm::vec3 fitted_halfwidths() const {
+        glm::vec3 fitted(0);
+        for (uint32_t i = 0; i < 3; ++i) {
+            fitted += halfwidths[i] * glm::abs(axes[i]);
+        }
+        return fitted;
+    }
+};
+
+// Separating axis test over the 3 face axes of both boxes and the 9 crosses
+// of their edges. On an overlap 'out' gets the normal from 'a' to 'b' along
+// the axis of the least overlap: a face axis clips the closest face of the
+// other box to the face it belongs to, an edge axis gives the single point
+// where the two edges come closest.
+bool collide(const OBB& a, const OBB& b, Penetration& out);
+// Same for boxes that both keep their axes along the world ones, which is
+// only an overlap of two AABBs
+bool collide_aligned(const OBB& a, const OBB& b, Penetration& out);
+// Normal from the box to the sphere
+bool collide(const OBB& box, const glm::vec3& center, const float radius,
+    Penetration& out);
+
+// Where a ray enters the box between 'min' and 'max', 'inverse' is one over
+// its direction. Zero when it starts inside, false when it misses the box or
+// only enters it past 'limit'.
+inline bool
+enters(const glm::vec3& min, const glm::vec3& max, const glm::vec3& origin,
+        const glm::vec3& inverse, const float limit, float& entry) {
+    const glm::vec3 t0 = (min - origin) * inverse;
+    const glm::vec3 t1 = (max - origin) * inverse;
+    const glm::vec3 in = glm::min(t0, t1);
+    const glm::vec3 out = glm::max(t0, t1);
+    entry = std::max(std::max(in.x, in.y), std::max(in.z, 0.f));
+    return entry <= std::min(std::min(out.x, out.y), std::min(out.z, limit));
+}
+
+// A sphere of 'radius' moved from 'origin' along the unit 'direction', a ray
+// for a zero radius. The casts find where it first touches a shape closer
+// than 'distance', shorten 'distance' to there and set the normal of the
+// shape at the touch. A cast starting in the shape touches it at zero,
+// against its direction.
+//
+// The box grows by 'radius' along its axes, its rounded edges are taken for
+// square ones.
+bool cast(const OBB& box, const glm::vec3& origin, const glm::vec3& direction,
+    const float radius, float& distance, glm::vec3& normal);
+bool cast(const glm::vec3& center, const float sphere_radius,
+    const glm::vec3& origin, const glm::vec3& direction, const float radius,
+    float& distance, glm::vec3& normal);
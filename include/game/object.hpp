@@ -1,10 +1,14 @@
 #pragma once
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <limits>
 #include <vector>
 #include "libs.hpp"
+#include "game/body_store.hpp"
+#include "game/draw_item.hpp"
 #include "game/material_properties.hpp"
+#include "game/obb.hpp"
 
 class Ball;
 class Cuboid;
@@ -60,54 +64,126 @@ public:
 };
 
 struct Motion {
+    // Downwards acceleration of every active body, and of the particles
+    static constexpr float GRAVITY = 3.f;
+
     Motion(const glm::vec3& dir, const float speed)
-     : v(speed * glm::normalize(dir)), bounciness(1.), active(true)
+     : v(speed * glm::normalize(dir)), w(0), bounciness(1.), active(true),
+       rotates(true)
     {}
     Motion(const glm::vec3& dir, const float speed, const float bounciness)
-     : v(speed * glm::normalize(dir)), bounciness(bounciness), active(true)
+     : v(speed * glm::normalize(dir)), w(0), bounciness(bounciness),
+       active(true), rotates(true)
     {}
     Motion(const bool is_active)
-     : v(0), bounciness(0), active(is_active)
+     : v(0), w(0), bounciness(0), active(is_active), rotates(false)
     {
         assert(!active);
     }
-    void account_gravity(const float time_delta) {
+    // Motion that starts with the given velocity, which may be zero
+    static Motion with_velocity(const glm::vec3& velocity) {
+        Motion motion(glm::vec3(0, 1, 0), 0.);
+        motion.v = velocity;
+        return motion;
+    }
+    void account_gravity(glm::vec3& velocity, const float time_delta) const {
         if (this->active) {
-            this->v += time_delta * 3.f * glm::normalize(glm::vec3(0, -1., 0.));
+            velocity.y -= time_delta * GRAVITY;
         }
     }
+    // Initial velocity and angular velocity, once the body is created they
+    // live in its BodyStore
     glm::vec3 v;
+    glm::vec3 w;
     float bounciness;
     bool active;
+    // Contacts may turn the body, off keeps it upright
+    bool rotates;
 };
 
 class Object {
+    friend class BodyStore;
 private:
-    static uint32_t COUNT;
+    // Ids are unique across all worlds, which may be built concurrently
+    static std::atomic<uint32_t> COUNT;
     MaterialProperties m_mat_properties;
 protected:
     const uint32_t m_id;
-    uint32_t m_last_contact = -1;
-    AABB m_aabb;
+    BodyStore& m_store;
+    // Row of this object in m_store
+    uint32_t m_body;
     Motion m_motion;
     float m_expiration_time;
 
 public:
-    Object() = default;
-    Object(const AABB& aabb)
-     : m_id(COUNT++), m_aabb(aabb), m_motion(glm::vec3(1), 0),
-       m_expiration_time(std::numeric_limits<float>::max())
+    Object(BodyStore& store, const AABB& aabb)
+     : Object(store, aabb, Motion(glm::vec3(1), 0))
     { }
-    Object(const AABB& aabb, const Motion& motion)
-     : m_id(COUNT++), m_aabb(aabb), m_motion(motion),
+    Object(BodyStore& store, const AABB& aabb, const Motion& motion)
+     : m_id(COUNT++), m_store(store), m_motion(motion),
        m_expiration_time(std::numeric_limits<float>::max())
-    { }
-    const AABB& get_aabb() const {
-        return m_aabb;
+    {
+        m_body = m_store.add(this, m_id, aabb.get_center(), motion.v, motion.w,
+            aabb.get_halfwidths());
+    }
+    Object(const Object&) = delete;
+    Object& operator=(const Object&) = delete;
+    virtual ~Object() {
+        m_store.remove(m_body);
+    }
+
+    uint32_t get_id() const {
+        return m_id;
+    }
+    // Row of the body in the BodyStore, changes when others are removed
+    uint32_t get_row() const {
+        return m_body;
+    }
+    AABB get_aabb() const {
+        return AABB(position(), m_store.halfwidth[m_body]);
+    }
+    const glm::vec3& position() const {
+        return m_store.position[m_body];
+    }
+    glm::vec3& position() {
+        return m_store.position[m_body];
+    }
+    const glm::vec3& velocity() const {
+        return m_store.velocity[m_body];
+    }
+    glm::vec3& velocity() {
+        return m_store.velocity[m_body];
+    }
+    const glm::quat& orientation() const {
+        return m_store.orientation[m_body];
+    }
+    glm::quat& orientation() {
+        return m_store.orientation[m_body];
+    }
+    const glm::vec3& angular_velocity() const {
+        return m_store.angular_velocity[m_body];
+    }
+    glm::vec3& angular_velocity() {
+        return m_store.angular_velocity[m_body];
+    }
+    void set_orientation(const glm::quat& orientation) {
+        this->orientation() = glm::normalize(orientation);
+        this->fit_bounds();
+    }
+    void set_motion(const Motion& motion) {
+        m_motion = motion;
+        this->velocity() = motion.v;
+        this->angular_velocity() = motion.w;
+    }
+    BodyStore::Kind get_kind() const {
+        return BodyStore::Kind(m_store.kind[m_body]);
     }
     const bool is_active() const {
         return m_motion.active;
     }
+    float get_bounciness() const {
+        return m_motion.bounciness;
+    }
     const MaterialProperties& get_material_properties() const {
         return m_mat_properties;
     }
@@ -122,72 +198,58 @@ public:
     }
 
     virtual float get_max_scale() const {
-        auto widths = m_aabb.get_halfwidths();
+        auto widths = m_store.halfwidth[m_body];
         widths *= 2.;
         return std::max(std::max(widths[0], widths[1]), widths[2]);
     }
-    virtual glm::mat4 update_geometry(const float time_delta) = 0;
-    virtual void render(const float time) = 0;
+    // Adds the gravity of a step to the velocity, before the contacts are
+    // solved so that resting bodies do not sink
+    virtual void accelerate(const float time_delta) {
+        m_motion.account_gravity(this->velocity(), time_delta);
+    }
+    // Moves the body by 'velocity' once the contacts are solved, the
+    // Integrator picks it from the velocities before and after the step
+    virtual void integrate(const float time_delta, const glm::vec3& velocity) = 0;
+    void describe(DrawItem& item) const {
+        item.id = m_id;
+        item.position = this->position();
+        item.rotation = this->orientation();
+        item.tex_scale = this->get_max_scale();
+        item.material = m_mat_properties;
+        item.is_static = m_store.kind[m_body] == BodyStore::STATIC;
+        this->describe_mesh(item);
+    }
+    // Fills the mesh, scale and texture of 'item'
+    virtual void describe_mesh(DrawItem& item) const = 0;
     virtual bool check_collision(const Object&) const = 0;
     virtual bool check_collision_what(const Ball&) const = 0;
     virtual bool check_collision_what(const Cuboid&) const = 0;
 
     virtual float mass() const = 0;
-    virtual void bounce(Object& other, const float time) {
-        if (!this->is_active() && !other.is_active()) {
-            return;
-        } else if (m_last_contact == other.m_id && other.m_last_contact == m_id) {
-            if (m_motion.active && other.m_motion.active) {
-                return;
-            }
-        }
-
-        auto n = glm::normalize(this->bounce_normal(other));
-        // std::cout << "Normal loaded: " << n.x << " " << n.y << " " << n.z << std::endl;
-        auto update_motion = [](auto& v, glm::vec3 n) {
-            v = v - 2 * std::min(0.f, glm::dot(v, n)) * n;
-        };
-        if (!m_motion.active) {
-            // std::cout << "This is static\n";
-            update_motion(other.m_motion.v, n);
-        } else if (!other.m_motion.active) {
-            // std::cout << "Other is static\n";
-            update_motion(m_motion.v, -n);
-        } else {
-            // Find the length of the component of each of the movement
-            // vectors along n.
-            // a1 = v1 . n
-            // a2 = v2 . n
-            // std::cout << "this: " << m_motion.v.x << " " << m_motion.v.y << " " << m_motion.v.z << std::endl;
-            // std::cout << "other: " << other.m_motion.v.x << " " << other.m_motion.v.y << " " <<other.m_motion.v.z << std::endl;
-            float a1 = glm::dot(m_motion.v, n);
-            float a2 = glm::dot(other.m_motion.v, n);
-            // std::cout << "a1 = " << a1 << ", a2 = " << a2 << std::endl;
-
-            // Using the optimized version,
-            float optimizedP = (2.0 * (a1 - a2)) / (this->mass() + other.mass());
-
-            m_motion.v = m_motion.v - optimizedP * other.mass() * n;
-            other.m_motion.v = other.m_motion.v + optimizedP * this->mass() * n;
-        }
-
-        if (m_last_contact != other.m_id || other.m_last_contact != m_id) {
-            float bounciness = std::max(m_motion.bounciness, other.m_motion.bounciness);
-            m_motion.v *= bounciness;
-            other.m_motion.v *= bounciness;
-        }
-        if (other.is_active()) {
-            this->got_hit(other.m_id, time);
-        }
-        if (this->is_active()) {
-            other.got_hit(m_id, time);
-        }
-        m_last_contact = other.m_id;
-        other.m_last_contact = m_id;
-    }
-    virtual glm::vec3 bounce_normal(const Object&) const = 0;
-    virtual glm::vec3 bounce_normal_what(const Ball&) const = 0;
-    virtual glm::vec3 bounce_normal_what(const Cuboid&) const = 0;
+    // Static and sleeping bodies cannot be pushed
+    float inverse_mass() const {
+        return m_motion.active ? 1.f / this->mass() : 0.f;
+    }
+    // Principal moments of inertia, along the axes of the body
+    virtual glm::vec3 inertia() const = 0;
+    // In the world space, zero for bodies that cannot be turned
+    glm::mat3 inverse_inertia() const;
+    // Whether the objects overlap, 'out' gets the normal from this object
+    virtual bool penetration(const Object& other, Penetration& out) const = 0;
+    virtual bool penetration_what(const Ball&, Penetration& out) const = 0;
+    virtual bool penetration_what(const Cuboid&, Penetration& out) const = 0;
+    // First touch of a ray or a moving sphere with the object, see cast() in
+    // obb.hpp
+    virtual bool cast(const glm::vec3& origin, const glm::vec3& direction,
+        const float radius, float& distance, glm::vec3& normal) const = 0;
+    // Called once when a contact with an active object begins
     virtual void got_hit(const uint32_t other_id, const float time) {
     }
+
+protected:
+    // Turns the body by its angular velocity, the AABB is not refitted
+    void integrate_rotation(const float time_delta);
+    // Refits the AABB in the store to the orientation
+    virtual void fit_bounds() {
+    }
 };
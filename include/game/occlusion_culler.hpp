@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include "libs.hpp"
+#include "draw_item.hpp"
+#include "gpu_resource.hpp"
+
+// Occlusion culling of the dynamic objects with hardware queries, run in the
+// depth prepass after the static scene so the table and the boxes occlude.
+//
+// Every object has a GL_ANY_SAMPLES_PASSED query. Results are only read a
+// frame later, when they are available, so the CPU never waits for the GPU:
+// - an object visible last time draws its depth inside its query, which
+//   tells whether it is still visible,
+// - an object occluded last time only draws its bounding box inside the
+//   query, with the depth writes off, and its depth under conditional
+//   rendering on that query.
+// The lighting pass draws every queried object under conditional rendering
+// again, the GPU skips those that were hidden.
+//
+// Culling only affects drawing, hidden objects are simulated as usual.
+class OcclusionCuller {
+private:
+    struct State {
+        GLuint query = 0;
+        // Last result read back
+        bool visible = true;
+        // Issued and not read back yet
+        bool pending = false;
+        // Issued this frame, the lighting pass can render on it
+        bool issued = false;
+        uint64_t frame = 0;
+    };
+
+    GpuVertexArray m_box_vao;
+    GpuBuffer m_box_vertices;
+    GpuBuffer m_box_indices;
+    GLint m_pvm_loc;
+
+    std::unordered_map<uint32_t, State> m_states;
+    // Bounding box of every mesh seen, in the mesh space
+    std::unordered_map<const PV112::MeshData*, std::pair<glm::vec3, glm::vec3>> m_mesh_bounds;
+    uint64_t m_frame = 0;
+    uint32_t m_visible = 0;
+    uint32_t m_occluded = 0;
+    uint32_t m_boxes = 0;
+
+public:
+    // 'position_loc' and 'pvm_loc' are the position attribute and the
+    // PVM_matrix uniform of the depth program
+    OcclusionCuller(const GLint position_loc, const GLint pvm_loc);
+    ~OcclusionCuller();
+    OcclusionCuller(const OcclusionCuller&) = delete;
+    OcclusionCuller& operator=(const OcclusionCuller&) = delete;
+
+    // After the depth program was reloaded
+    void set_pvm_loc(const GLint pvm_loc) {
+        m_pvm_loc = pvm_loc;
+    }
+    // Reads back the results that are available
+    void begin_frame();
+    // Draws the depth of 'item' with 'draw', in the prepass with the depth
+    // program in use and the color writes off. Objects without mesh data
+    // or with the eye inside their box are drawn without testing.
+    void draw_depth(const DrawItem& item, const glm::mat4& projection_view,
+        const glm::vec3& eye, const std::function<void()>& draw);
+    // Wraps the lighting pass draw of 'item' in conditional rendering
+    void draw_color(const DrawItem& item, const std::function<void()>& draw) const;
+    // Forgets the objects not drawn this frame
+    void end_frame();
+
+    // Objects found visible and hidden by the latest results
+    uint32_t get_visible() const {
+        return m_visible;
+    }
+    uint32_t get_occluded() const {
+        return m_occluded;
+    }
+    // Bounding boxes drawn this frame
+    uint32_t get_boxes() const {
+        return m_boxes;
+    }
+
+private:
+    bool bounds(const DrawItem& item, glm::vec3& min, glm::vec3& max);
+};
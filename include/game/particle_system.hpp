@@ -0,0 +1,108 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+#include "libs.hpp"
+#include "draw_item.hpp"
+
+struct ParticleParams {
+    // Particles alive at once, whatever is emitted beyond is dropped. 0
+    // turns the particles off.
+    uint32_t budget = 100000;
+    // Share of the speed a particle keeps when it bounces off a bound
+    float restitution = 0.35f;
+    // Share of the sliding speed the floor takes per second
+    float friction = 3.f;
+    // Sparks off an enemy when a ball hits it, and its debris when it dies
+    uint32_t sparks_per_hit = 64;
+    uint32_t debris_per_death = 1000;
+};
+
+// Sparks and debris, too many and too short-lived to be objects. They fall
+// like the bodies do and bounce off the planes of the arena bounds, but
+// nothing else. Every attribute is an array of its own, integrated four
+// particles at a time, and a dead particle is replaced by the last one, so
+// the live ones always fill the front of the arrays.
+//
+// The arrays grow when a burst does not fit, up to the budget, and are never
+// shrunk, so once warmed up a step does not allocate.
+class ParticleSystem {
+public:
+    // Particles sprayed from one point
+    struct Burst {
+        glm::vec3 position;
+        // The particles scatter around it by 'spread' along every axis
+        glm::vec3 velocity;
+        float spread;
+        // Seconds, every particle lives between half of it and all of it
+        float life;
+        // Diameter in world units
+        float size;
+        // RGBA, see ParticleVertex
+        uint32_t color;
+        uint32_t count;
+    };
+
+    struct Stats {
+        uint32_t count = 0;
+        // Particles the arrays hold without growing
+        uint32_t capacity = 0;
+        uint32_t budget = 0;
+        uint64_t emitted = 0;
+        // Over the budget
+        uint64_t dropped = 0;
+    };
+
+private:
+    // The particles shrink away over their last moments
+    static constexpr float FADE_TIME = 0.3f;
+
+    ParticleParams m_params;
+    glm::vec3 m_min = glm::vec3(std::numeric_limits<float>::lowest());
+    glm::vec3 m_max = glm::vec3(std::numeric_limits<float>::max());
+    std::minstd_rand m_rng;
+
+    std::vector<float> m_px, m_py, m_pz;
+    std::vector<float> m_vx, m_vy, m_vz;
+    // Seconds left
+    std::vector<float> m_life;
+    std::vector<float> m_size;
+    std::vector<uint32_t> m_color;
+    size_t m_count = 0;
+    uint64_t m_emitted = 0;
+    uint64_t m_dropped = 0;
+
+public:
+    explicit ParticleSystem(const ParticleParams& params = ParticleParams(),
+        const uint32_t seed = 0);
+
+    // Planes the particles bounce off
+    void set_bounds(const glm::vec3& min, const glm::vec3& max) {
+        m_min = min;
+        m_max = max;
+    }
+
+    // Returns how many particles fit into the budget
+    size_t emit(const Burst& burst);
+    void step(const float time_delta);
+    void clear() {
+        m_count = 0;
+    }
+
+    // Appends a vertex for every live particle
+    void describe(std::vector<ParticleVertex>& vertices) const;
+
+    size_t size() const {
+        return m_count;
+    }
+    Stats get_stats() const;
+    const ParticleParams& get_params() const {
+        return m_params;
+    }
+
+private:
+    void grow(const size_t count);
+    void integrate(const float time_delta);
+    void remove_dead();
+};
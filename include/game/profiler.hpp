@@ -0,0 +1,115 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "allocation_probe.hpp"
+
+struct PhaseTiming {
+    std::string name;
+    double last_ms = 0;
+    double avg_ms = 0;
+    double max_ms = 0;
+    uint64_t samples = 0;
+    // Heap allocations of the last sample, 0 in the steady state for the
+    // phases that only use reserved memory and arenas
+    uint64_t last_allocations = 0;
+};
+
+// Accumulates wall-clock time of named phases. Phases are created on first
+// use and keep their order, the average is an exponential moving one so the
+// overlay settles within a second or so.
+class Profiler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    class Scope {
+    private:
+        Profiler* m_profiler;
+        size_t m_phase;
+        Clock::time_point m_start;
+        uint64_t m_allocations;
+    public:
+        Scope(Profiler& profiler, const size_t phase)
+         : m_profiler(&profiler), m_phase(phase), m_start(Clock::now()),
+           m_allocations(AllocationProbe::count())
+        {}
+        Scope(Scope&& other)
+         : m_profiler(other.m_profiler), m_phase(other.m_phase),
+           m_start(other.m_start), m_allocations(other.m_allocations)
+        {
+            other.m_profiler = nullptr;
+        }
+        Scope(const Scope&) = delete;
+        ~Scope() {
+            if (m_profiler) {
+                std::chrono::duration<double, std::milli> ms = Clock::now() - m_start;
+                m_profiler->record(m_phase, ms.count(),
+                    AllocationProbe::count() - m_allocations);
+            }
+        }
+    };
+
+private:
+    static constexpr double SMOOTHING = 0.05;
+    std::vector<PhaseTiming> m_phases;
+
+public:
+    Scope scope(const char* name) {
+        return Scope(*this, this->phase_index(name));
+    }
+
+    void record(const size_t phase, const double ms,
+            const uint64_t allocations = 0) {
+        auto& p = m_phases[phase];
+        p.last_ms = ms;
+        p.last_allocations = allocations;
+        p.avg_ms = p.samples == 0 ? ms : p.avg_ms + SMOOTHING * (ms - p.avg_ms);
+        p.max_ms = std::max(p.max_ms, ms);
+        ++p.samples;
+    }
+    void record(const char* name, const double ms) {
+        this->record(this->phase_index(name), ms);
+    }
+
+    const std::vector<PhaseTiming>& get_phases() const {
+        return m_phases;
+    }
+    void clear() {
+        m_phases.clear();
+    }
+    // Adds the phases of a profiler that ran elsewhere, e.g. on another thread
+    void append(const std::vector<PhaseTiming>& phases) {
+        for (const auto& p : phases) {
+            m_phases[this->phase_index(p.name.c_str())] = p;
+        }
+    }
+
+    void dump(std::ostream& out) const {
+        out << std::left << std::setw(16) << "phase"
+            << std::right << std::setw(10) << "avg ms"
+            << std::setw(10) << "max ms" << std::setw(10) << "samples"
+            << std::setw(10) << "allocs" << "\n";
+        for (const auto& p : m_phases) {
+            out << std::left << std::setw(16) << p.name << std::right << std::fixed
+                << std::setprecision(3) << std::setw(10) << p.avg_ms
+                << std::setw(10) << p.max_ms << std::setw(10) << p.samples
+                << std::setw(10) << p.last_allocations << "\n";
+        }
+    }
+
+private:
+    size_t phase_index(const char* name) {
+        for (size_t i = 0; i < m_phases.size(); ++i) {
+            if (m_phases[i].name == name) {
+                return i;
+            }
+        }
+        m_phases.push_back(PhaseTiming());
+        m_phases.back().name = name;
+        return m_phases.size() - 1;
+    }
+};
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "libs.hpp"
+#include "gpu_resource.hpp"
+
+// Shader programs built from a vertex and a fragment shader file, optionally
+// specialized by #define lines inserted after the #version line.
+//
+// Linked binaries are kept in a cache directory, keyed by a hash of the
+// sources, the attribute bindings and the GL vendor, renderer and version
+// strings, so an unchanged program skips compiling on the next launch. The
+// cache needs GL 4.1 or ARB_get_program_binary, without it every program is
+// compiled as before.
+//
+// With watch() the directory of the shaders is watched with inotify and a
+// program whose source changes is rebuilt while the old one keeps drawing.
+// The new program is linked in one update() and swapped in the next, the
+// driver gets a frame to link it, so the frame loop never waits for it. A
+// program that fails to build is reported and the old one stays.
+class ProgramCache {
+public:
+    // Attribute locations bound before linking, the vertex arrays of the
+    // reloaded program must keep working
+    using Attributes = std::vector<std::pair<GLint, std::string>>;
+    // Called with the new program after a reload, before the old one is
+    // deleted. It is the place to look up the uniform locations again.
+    using ReloadCallback = std::function<void(GLuint)>;
+
+private:
+    struct Program {
+        std::string vertex;
+        std::string fragment;
+        Attributes attributes;
+        std::string defines;
+        ReloadCallback on_reload;
+        GpuProgram id;
+        // Linking after a change, swapped in on the next update()
+        GpuProgram pending;
+        uint64_t pending_key = 0;
+        bool changed = false;
+    };
+
+    std::string m_directory;
+    bool m_binaries;
+    std::string m_driver;
+    std::vector<std::unique_ptr<Program>> m_programs;
+    int m_inotify = -1;
+    uint32_t m_hits = 0;
+    uint32_t m_misses = 0;
+    uint32_t m_reloads = 0;
+
+public:
+    // 'directory' holds the cached binaries, it is created when missing
+    explicit ProgramCache(const std::string& directory);
+    ~ProgramCache();
+    ProgramCache(const ProgramCache&) = delete;
+    ProgramCache& operator=(const ProgramCache&) = delete;
+
+    // Returns the program, or 0 when it failed to build. The cache owns it.
+    GLuint load(const std::string& vertex, const std::string& fragment,
+        const Attributes& attributes = Attributes(),
+        const std::string& defines = std::string(),
+        ReloadCallback on_reload = ReloadCallback());
+    // Starts watching 'directory' for changed shaders, returns false when
+    // inotify is not available
+    bool watch(const std::string& directory);
+    // Picks up the changed files and swaps in the reloaded programs, once
+    // per frame
+    void update();
+
+    // Programs loaded from the cache and built from the sources
+    uint32_t get_hits() const {
+        return m_hits;
+    }
+    uint32_t get_misses() const {
+        return m_misses;
+    }
+    uint32_t get_reloads() const {
+        return m_reloads;
+    }
+
+private:
+    // Reads the sources of 'program' with its defines, false if one is missing
+    bool read(const Program& program, std::string& vertex_source,
+        std::string& fragment_source) const;
+    uint64_t key(const Program& program, const std::string& vertex_source,
+        const std::string& fragment_source) const;
+    std::string path(const uint64_t key) const;
+    GLuint load_binary(const uint64_t key);
+    void store_binary(const uint64_t key, const GLuint program) const;
+    // Compiles and starts linking, the link status is not queried
+    GLuint compile(const Program& program, const std::string& vertex_source,
+        const std::string& fragment_source) const;
+    // Waits for the link and prints the log of a program that failed
+    bool linked(const GLuint program, const Program& source) const;
+    // Size of the linked binary for the GpuLedger, 0 without binaries
+    size_t binary_size(const GLuint program) const;
+    void start_reload(Program& program);
+    void poll_watcher();
+};
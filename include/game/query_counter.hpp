@@ -0,0 +1,35 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include "libs.hpp"
+
+// Accumulates a query between begin() and end(), e.g. the samples passing
+// the depth test with GL_SAMPLES_PASSED or the GPU time in nanoseconds with
+// GL_TIME_ELAPSED. The queries rotate over FRAMES frames and a result is
+// only read once it is available, so the counter never stalls the pipeline
+// and lags a frame or two behind.
+class QueryCounter {
+public:
+    static constexpr size_t FRAMES = 3;
+
+private:
+    GLenum m_target;
+    std::array<GLuint, FRAMES> m_queries;
+    std::array<bool, FRAMES> m_pending;
+    size_t m_frame = 0;
+    uint64_t m_result = 0;
+
+public:
+    explicit QueryCounter(const GLenum target);
+    ~QueryCounter();
+    QueryCounter(const QueryCounter&) = delete;
+    QueryCounter& operator=(const QueryCounter&) = delete;
+
+    void begin();
+    void end();
+
+    // Result of the latest frame the GPU has finished
+    uint64_t get_result() const {
+        return m_result;
+    }
+};
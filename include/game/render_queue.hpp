@@ -0,0 +1,53 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "libs.hpp"
+
+// Order of the opaque objects that are drawn one by one. Every draw gets a 64
+// bit key and sorting by it draws front to back, so the depth test rejects
+// hidden fragments before they are shaded. Draws in the same depth bucket
+// are grouped by program, texture and mesh to save state changes:
+//
+//   depth DEPTH_BITS | program PROGRAM_BITS | texture ID_BITS | mesh ID_BITS
+//
+// Depth buckets are logarithmic between the near and the far plane, like
+// the precision of the depth buffer. After a depth prepass the order of the
+// lighting pass does not change what gets shaded, it takes the entries
+// sorted by the state first and the depth last instead.
+class RenderQueue {
+public:
+    static constexpr uint32_t DEPTH_BITS = 12;
+    static constexpr uint32_t PROGRAM_BITS = 8;
+    static constexpr uint32_t ID_BITS = 22;
+
+    struct Entry {
+        uint64_t key;
+        // Index of the item in the caller's array
+        uint32_t item;
+    };
+
+private:
+    float m_near = 0.1f;
+    float m_far = 100.f;
+    std::vector<Entry> m_entries;
+    std::vector<Entry> m_by_state;
+
+public:
+    // Clears the queue, 'near' and 'far' bound the depth buckets
+    void begin(const float near, const float far);
+    // 'depth' is the distance of the item from the camera
+    void push(const uint32_t item, const float depth, const GLuint program,
+        const GLuint tex, const GLuint vao);
+    void sort();
+
+    // Front to back
+    const std::vector<Entry>& get_entries() const {
+        return m_entries;
+    }
+    // By program, texture and mesh, then front to back
+    const std::vector<Entry>& get_by_state() const {
+        return m_by_state;
+    }
+    // Program, texture and vertex array switches drawing 'entries' in order
+    static uint32_t count_state_changes(const std::vector<Entry>& entries);
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "libs.hpp"
+
+struct SceneParams {
+    // 0 picks a fresh seed every run, the one used is stored in the scene
+    uint32_t seed = 0;
+    // Half of the arena width along X and Z
+    float arena_half_extent = 15;
+    uint32_t box_count = 20;
+    uint32_t enemy_count = 20;
+    uint32_t ball_count = 4;
+
+    // Multiplies every object count by 'factor' and grows the arena so the
+    // object density stays the same as in the default scene.
+    SceneParams scaled(const float factor) const;
+    uint32_t object_count() const;
+};
+
+// Plain description of an arena, no OpenGL objects are created here so the
+// same scene can be generated, inspected and rebuilt deterministically.
+struct SceneDescription {
+    using Bound = std::array<float, 2>;
+
+    struct Placement {
+        glm::vec3 center;
+        // Scale of the mesh (boxes, walls) or radius (balls, enemies)
+        glm::vec3 size;
+        glm::vec3 direction;
+        float speed;
+    };
+
+    uint32_t seed;
+    std::array<Bound, 3> bounds;
+    std::array<glm::vec4, 2> lights;
+
+    std::vector<Placement> walls;
+    Placement table;
+    std::vector<Placement> boxes;
+    std::vector<Placement> balls;
+    std::vector<Placement> enemies;
+};
+
+// Builds the default arena for default parameters and extends it with
+// randomly placed boxes, balls and enemies for larger counts.
+SceneDescription generate_scene(const SceneParams& params);
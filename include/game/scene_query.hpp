@@ -0,0 +1,115 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+#include "object.hpp"
+#include "thread_pool.hpp"
+
+// Raycasts, sphere sweeps and overlap tests against the objects of a world,
+// for aiming, lines of sight and tools. The queries walk a tree over the
+// same AABBs the broadphase sorts, split by the surface area heuristic so
+// that the walls end up apart from the small bodies, and flattened like a
+// MeshBvh. Only the objects in leaves the query reaches test their actual
+// shape.
+//
+// build() takes the objects as they are, the tree is stale once they move
+// and the vector has to outlive it. Queries are const and may run on many
+// threads at once.
+class SceneQuery {
+public:
+    static constexpr uint32_t NONE = std::numeric_limits<uint32_t>::max();
+    static constexpr uint32_t ALL_KINDS = (1u << BodyStore::STATIC)
+        | (1u << BodyStore::BALL) | (1u << BodyStore::BOX)
+        | (1u << BodyStore::ENEMY);
+    static constexpr uint32_t MAX_LEAF = 4;
+
+    struct Filter {
+        // Bits 1 << BodyStore::Kind of the objects that can be hit
+        uint32_t kinds;
+        // Id of an object never hit, such as the one looking
+        uint32_t ignore;
+
+        Filter(const uint32_t kinds = ALL_KINDS, const uint32_t ignore = NONE)
+         : kinds(kinds), ignore(ignore)
+        { }
+    };
+
+    struct Hit {
+        // Of the object hit, NONE for a miss
+        uint32_t id = NONE;
+        float distance = std::numeric_limits<float>::infinity();
+        // On the surface of the object
+        glm::vec3 point;
+        // Of the surface, back towards the cast
+        glm::vec3 normal;
+    };
+
+private:
+    // Laid out like MeshBvh::Node, the offset is into m_order for a leaf
+    struct Node {
+        glm::vec3 min;
+        uint32_t offset;
+        glm::vec3 max;
+        uint32_t count;
+
+        bool is_leaf() const {
+            return count != 0;
+        }
+    };
+    // Deeper than any tree over the objects of a world gets
+    static constexpr uint32_t MAX_DEPTH = 64;
+    // Rays handed to a worker at a time by the batched queries
+    static constexpr size_t BATCH = 64;
+
+    const std::vector<std::shared_ptr<Object>>* m_objects = nullptr;
+    std::vector<Node> m_nodes;
+    // Indices into m_objects in the order of the leaves
+    std::vector<uint32_t> m_order;
+    std::vector<glm::vec3> m_min;
+    std::vector<glm::vec3> m_max;
+
+public:
+    void build(const std::vector<std::shared_ptr<Object>>& objects);
+
+    // Closest object along the ray from 'origin' in 'direction', which does
+    // not have to be a unit vector, up to 'max_distance'
+    bool raycast(const glm::vec3& origin, const glm::vec3& direction,
+        const float max_distance, Hit& out, const Filter& filter = Filter()) const;
+    // Appends every object along the ray, nearest first, and returns how many
+    size_t raycast_all(const glm::vec3& origin, const glm::vec3& direction,
+        const float max_distance, std::vector<Hit>& out,
+        const Filter& filter = Filter()) const;
+    // First object the sphere touches when moved along 'direction'. Boxes
+    // are taken as grown by the radius, see cast() in obb.hpp.
+    bool sweep(const glm::vec3& center, const float radius,
+        const glm::vec3& direction, const float max_distance, Hit& out,
+        const Filter& filter = Filter()) const;
+    // Appends the ids of the objects whose AABBs overlap the box between
+    // 'min' and 'max' and returns how many
+    size_t overlap(const glm::vec3& min, const glm::vec3& max,
+        std::vector<uint32_t>& out, const Filter& filter = Filter()) const;
+
+    // Answer 'count' rays or sweeps at once, given as x, y, z triples, on
+    // 'pool' when there is one
+    void raycast(const float* origins, const float* directions,
+        const size_t count, const float max_distance, Hit* out,
+        const Filter& filter = Filter(), ThreadPool* pool = nullptr) const;
+    void sweep(const float* centers, const float radius,
+        const float* directions, const size_t count, const float max_distance,
+        Hit* out, const Filter& filter = Filter(), ThreadPool* pool = nullptr) const;
+
+    size_t size() const {
+        return m_order.size();
+    }
+
+private:
+    uint32_t build(const uint32_t first, const uint32_t count, const uint32_t depth);
+    bool accepts(const Object& obj, const Filter& filter) const {
+        return (filter.kinds >> obj.get_kind() & 1) != 0 && obj.get_id() != filter.ignore;
+    }
+    // Closest hit when 'all' is null, every hit appended to it otherwise
+    bool cast(const glm::vec3& origin, const glm::vec3& direction,
+        const float radius, const float max_distance, Hit& out,
+        std::vector<Hit>* all, const Filter& filter) const;
+};
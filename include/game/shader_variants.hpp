@@ -0,0 +1,71 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <string>
+#include "libs.hpp"
+#include "light_clusters.hpp"
+#include "material_properties.hpp"
+#include "program_cache.hpp"
+
+// The lighting program specialized for the features of a material. Every
+// feature set is compiled from the same sources with #defines, so the bulbs
+// with no diffuse and specular color skip that math instead of multiplying
+// it by zero, and untextured objects skip the texture fetch.
+class ShaderVariants {
+public:
+    enum Feature : uint8_t {
+        TEXTURED = 1 << 0,
+        DIFFUSE = 1 << 1,
+        // Implies DIFFUSE, the highlight fades with the diffuse term
+        SPECULAR = 1 << 2,
+    };
+    static constexpr uint8_t COUNT = 8;
+
+    // Locations of the uniforms in a variant, -1 for those it does not use
+    struct Uniforms {
+        GLint model_matrix;
+        GLint PVM_matrix;
+        GLint normal_matrix;
+        GLint tex_scale;
+        GLint material_ambient_color;
+        GLint material_diffuse_color;
+        GLint material_specular_color;
+        GLint material_shininess;
+        GLint light_ambient_color;
+        GLint light_diffuse_color;
+        GLint light_specular_color;
+        GLint eye_position;
+        LightClusters::Uniforms clusters;
+    };
+
+    struct Variant {
+        GLuint program = 0;
+        Uniforms uniforms;
+    };
+
+private:
+    const LightClusters& m_clusters;
+    std::array<Variant, COUNT> m_variants;
+
+public:
+    // Builds every variant of the program through 'programs', reloads keep
+    // the variants up to date
+    ShaderVariants(ProgramCache& programs, const LightClusters& clusters,
+        const std::string& vertex, const std::string& fragment,
+        const ProgramCache::Attributes& attributes);
+    ShaderVariants(const ShaderVariants&) = delete;
+    ShaderVariants& operator=(const ShaderVariants&) = delete;
+
+    // Features a draw with the material and the texture needs
+    static uint8_t features_of(const MaterialProperties& material, const GLuint tex);
+    static std::string defines_of(const uint8_t features);
+
+    // False when some variant failed to build
+    bool is_valid() const;
+    const Variant& get(const uint8_t features) const {
+        return m_variants[features];
+    }
+
+private:
+    void resolve(const uint8_t features, const GLuint program);
+};
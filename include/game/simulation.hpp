@@ -0,0 +1,160 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "draw_item.hpp"
+#include "profiler.hpp"
+#include "world.hpp"
+
+// State of the world after one simulation tick, as far as drawing and the
+// overlay are concerned.
+struct Snapshot {
+    uint64_t tick = 0;
+    // Simulation clock of the tick in seconds
+    double time = 0;
+    // Sorted by id
+    std::vector<DrawItem> items;
+    std::vector<PointLight> lights;
+    // Sparks and debris, drawn as they are rather than interpolated
+    std::vector<ParticleVertex> particles;
+    ParticleSystem::Stats particle_stats;
+    Integrator::Stats integrator_stats;
+
+    float world_time = 0;
+    uint32_t alive_enemies = 0;
+    bool player_alive = true;
+    bool over = false;
+    std::vector<PhaseTiming> phases;
+};
+
+// Triple buffer of snapshots. The simulation fills the back slot and swaps
+// it with the middle one, the renderer swaps the middle one into the front
+// when it is newer. Both only hold the lock for the swap, neither side ever
+// waits for the other to finish its work.
+class SnapshotBuffer {
+private:
+    std::array<Snapshot, 3> m_slots;
+    uint32_t m_back = 0;
+    uint32_t m_middle = 1;
+    uint32_t m_front = 2;
+    bool m_fresh = false;
+    std::mutex m_mutex;
+public:
+    Snapshot& back() {
+        return m_slots[m_back];
+    }
+    void publish() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        std::swap(m_back, m_middle);
+        m_fresh = true;
+    }
+
+    // Swaps in the newest snapshot, if there is one. The replaced front is
+    // handed over in 'previous' and the old 'previous' goes back to the
+    // simulation to be overwritten.
+    bool acquire(Snapshot& previous) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_fresh) {
+            return false;
+        }
+        std::swap(previous, m_slots[m_front]);
+        std::swap(m_front, m_middle);
+        m_fresh = false;
+        return true;
+    }
+    const Snapshot& front() const {
+        return m_slots[m_front];
+    }
+};
+
+// Steps a World at a fixed tick rate, either on its own thread or from the
+// render loop, and publishes a Snapshot after every tick. The renderer draws
+// one tick in the past and interpolates positions between the two latest
+// snapshots, so the frame rate and the tick rate are independent and a slow
+// tick does not show up as a stutter.
+//
+// Once started, the world belongs to the simulation thread. The input is
+// handed over through set_input() and fire() and the tick callback runs on
+// the simulation thread too.
+class Simulation {
+public:
+    using Clock = std::chrono::steady_clock;
+    using TickCallback = std::function<void(float)>;
+private:
+    // Ticks dropped at once when the simulation falls behind the clock
+    static constexpr uint32_t MAX_CATCH_UP = 5;
+
+    World& m_world;
+    Profiler& m_profiler;
+    TickCallback m_on_tick;
+    const double m_tick_length;
+
+    // Ticks since the epoch of the clock. The simulation moves it when it
+    // drops ticks while the renderer reads it in interpolate().
+    std::atomic<Clock::rep> m_start;
+    uint64_t m_tick = 0;
+
+    std::mutex m_input_mutex;
+    World::Input m_input;
+
+    SnapshotBuffer m_snapshots;
+    // Renderer side, previous and newest snapshot
+    Snapshot m_previous;
+    // Renderer side, how far the render time is behind the newest snapshot
+    float m_render_lag = 0;
+
+    std::atomic<bool> m_stop;
+    std::thread m_thread;
+
+public:
+    Simulation(World& world, Profiler& profiler, const float tick_rate,
+        TickCallback on_tick);
+    ~Simulation();
+    Simulation(const Simulation&) = delete;
+    Simulation& operator=(const Simulation&) = delete;
+
+    // Runs the ticks on a thread of their own from now on
+    void start();
+    void stop();
+    // Runs the ticks that are due on the calling thread, for a simulation
+    // that was not started
+    void advance();
+
+    // Position, aim and machine gun trigger of the player, used by every
+    // tick until replaced
+    void set_input(const glm::vec3& position, const glm::vec3& aim,
+        const bool fire);
+    // Fires a single ball on the next tick
+    void fire();
+
+    // Renderer side: takes the newest snapshot and fills 'items' and
+    // 'lights' with the positions interpolated to the render time. Returns
+    // the newest snapshot.
+    const Snapshot& interpolate(std::vector<DrawItem>& items,
+        std::vector<PointLight>& lights);
+
+    double get_tick_length() const {
+        return m_tick_length;
+    }
+    // Seconds the last interpolate() drew behind the snapshot it returned,
+    // the particles move back along their velocities by it
+    float get_render_lag() const {
+        return m_render_lag;
+    }
+
+private:
+    void tick();
+    void run();
+    double now() const;
+    Clock::time_point get_start() const {
+        return Clock::time_point(Clock::duration(m_start.load()));
+    }
+    void set_start(const Clock::time_point start) {
+        m_start = start.time_since_epoch().count();
+    }
+};
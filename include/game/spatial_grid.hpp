@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Uniform grid over the XZ plane. Points are bucketed by a counting sort, so
+// after build() the points of every cell form one contiguous range of
+// get_order(). Callers can reorder their own SoA arrays by that permutation
+// and then walk the neighbouring cells as plain linear ranges.
+class SpatialGrid {
+private:
+    static constexpr uint32_t MAX_CELLS_PER_AXIS = 512;
+
+    float m_cell_size;
+    // Of the last build(), widened from m_cell_size for points spread far
+    float m_built_cell_size;
+    float m_min_x = 0, m_min_z = 0;
+    uint32_t m_dim_x = 0, m_dim_z = 0;
+
+    std::vector<uint32_t> m_cell_of;
+    std::vector<uint32_t> m_cell_start;
+    std::vector<uint32_t> m_order;
+public:
+    SpatialGrid(const float cell_size = 1.f)
+     : m_cell_size(cell_size), m_built_cell_size(cell_size)
+    {}
+
+    void set_cell_size(const float cell_size) {
+        m_cell_size = cell_size;
+    }
+    float get_cell_size() const {
+        return m_cell_size;
+    }
+    uint32_t get_dim_x() const {
+        return m_dim_x;
+    }
+    uint32_t get_dim_z() const {
+        return m_dim_z;
+    }
+    // Permutation of the input indices sorted by cell
+    const std::vector<uint32_t>& get_order() const {
+        return m_order;
+    }
+
+    void build(const float* xs, const float* zs, const size_t count) {
+        m_cell_of.resize(count);
+        m_order.resize(count);
+        if (count == 0) {
+            m_dim_x = m_dim_z = 0;
+            m_cell_start.assign(1, 0);
+            return;
+        }
+
+        float max_x = xs[0], max_z = zs[0];
+        m_min_x = xs[0];
+        m_min_z = zs[0];
+        for (size_t i = 1; i < count; ++i) {
+            m_min_x = std::min(m_min_x, xs[i]);
+            m_min_z = std::min(m_min_z, zs[i]);
+            max_x = std::max(max_x, xs[i]);
+            max_z = std::max(max_z, zs[i]);
+        }
+        // Enemies may be scattered over a huge area, keep the cell table bounded
+        float extent = std::max(max_x - m_min_x, max_z - m_min_z);
+        float cell = std::max(m_cell_size, extent / MAX_CELLS_PER_AXIS);
+        m_built_cell_size = cell;
+        m_dim_x = uint32_t((max_x - m_min_x) / cell) + 1;
+        m_dim_z = uint32_t((max_z - m_min_z) / cell) + 1;
+
+        m_cell_start.assign(m_dim_x * m_dim_z + 1, 0);
+        for (size_t i = 0; i < count; ++i) {
+            m_cell_of[i] = cell_index(cell_x(xs[i]), cell_z(zs[i]));
+            ++m_cell_start[m_cell_of[i] + 1];
+        }
+        for (size_t c = 1; c < m_cell_start.size(); ++c) {
+            m_cell_start[c] += m_cell_start[c - 1];
+        }
+        for (size_t i = 0; i < count; ++i) {
+            m_order[m_cell_start[m_cell_of[i]]++] = i;
+        }
+        // Shift the starts back, the loop above advanced each one to its end
+        for (size_t c = m_cell_start.size() - 1; c > 0; --c) {
+            m_cell_start[c] = m_cell_start[c - 1];
+        }
+        m_cell_start[0] = 0;
+    }
+
+    uint32_t cell_x(const float x) const {
+        return clamp_cell((x - m_min_x) / m_built_cell_size, m_dim_x);
+    }
+    uint32_t cell_z(const float z) const {
+        return clamp_cell((z - m_min_z) / m_built_cell_size, m_dim_z);
+    }
+    uint32_t cell_index(const uint32_t cx, const uint32_t cz) const {
+        return cz * m_dim_x + cx;
+    }
+    // Range [begin, end) of sorted positions that fall into cell (cx, cz)
+    uint32_t cell_begin(const uint32_t cx, const uint32_t cz) const {
+        return m_cell_start[cell_index(cx, cz)];
+    }
+    uint32_t cell_end(const uint32_t cx, const uint32_t cz) const {
+        return m_cell_start[cell_index(cx, cz) + 1];
+    }
+
+private:
+    static uint32_t clamp_cell(const float c, const uint32_t dim) {
+        if (c <= 0.f) {
+            return 0;
+        }
+        return std::min(uint32_t(c), dim - 1);
+    }
+};
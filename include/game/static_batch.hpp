@@ -0,0 +1,115 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <utility>
+#include <vector>
+#include "libs.hpp"
+#include "draw_item.hpp"
+#include "frame_arena.hpp"
+#include "gpu_resource.hpp"
+
+// The objects that never move (walls, the table, the bulbs), merged into one
+// vertex and index buffer and drawn with a glMultiDrawElementsIndirect per
+// texture and material instead of a draw call per object.
+//
+// The vertices are moved to the world space when the batch is built, so it
+// draws with the regular program and identity model and normal matrices. On
+// contexts without GL 4.3 or ARB_multi_draw_indirect the same commands go to
+// glMultiDrawElementsBaseVertex, which is core since GL 3.2.
+//
+// sort() orders the commands of every group and the groups themselves front
+// to back from the camera, by the distance to the bounding box of an object.
+// update() and sort() only touch the main memory and may run on any thread,
+// upload() then sends the changes to the indirect buffer on the GL thread.
+class StaticBatch {
+public:
+    // Layout of the GL DrawElementsIndirectCommand
+    struct DrawCommand {
+        GLuint count;
+        GLuint instance_count;
+        GLuint first_index;
+        GLint base_vertex;
+        GLuint base_instance;
+    };
+
+    // Objects sharing the texture and material, their commands are adjacent
+    struct Group {
+        GLuint tex;
+        MaterialProperties material;
+        // Range of the group in the sorted commands
+        size_t first_command;
+        size_t command_count;
+        // Commands that are not hidden
+        size_t visible;
+        // Where the group starts in the glMultiDrawElementsBaseVertex arguments
+        size_t first_visible;
+    };
+
+private:
+    GpuVertexArray m_vao;
+    GpuBuffer m_vertex_buffer;
+    GpuBuffer m_index_buffer;
+    GpuBuffer m_command_buffer;
+    bool m_indirect;
+
+    std::vector<DrawCommand> m_commands;
+    // Object id of every command, ascending within a group
+    std::vector<uint32_t> m_ids;
+    // World space bounding box of every command
+    std::vector<std::pair<glm::vec3, glm::vec3>> m_bounds;
+    std::vector<Group> m_groups;
+    // Indices to m_commands and m_groups in the drawing order
+    std::vector<uint32_t> m_order;
+    std::vector<uint32_t> m_group_order;
+    // The commands as they are drawn, the indirect buffer mirrors them
+    std::vector<DrawCommand> m_sorted;
+    // m_sorted changed since the last upload()
+    bool m_dirty = false;
+    glm::vec3 m_eye = glm::vec3(std::numeric_limits<float>::max());
+    size_t m_drawn = 0;
+    uint64_t m_triangles = 0;
+
+    // Arguments of glMultiDrawElementsBaseVertex, without the hidden commands
+    std::vector<GLsizei> m_counts;
+    std::vector<void*> m_offsets;
+    std::vector<GLint> m_base_vertices;
+
+public:
+    // Batches the items of 'items' accepts() takes, the attribute locations
+    // are the ones of the program the batch is drawn with
+    StaticBatch(const std::vector<DrawItem>& items, const GLint position_loc,
+        const GLint normal_loc, const GLint tex_coord_loc);
+    StaticBatch(const StaticBatch&) = delete;
+    StaticBatch& operator=(const StaticBatch&) = delete;
+
+    // Whether the item is drawn by a batch rather than on its own
+    static bool accepts(const DrawItem& item);
+
+    // Hides the objects that are no longer among 'items', e.g. after despawn.
+    // Cheap when nothing changed. The scratch lists go to 'arena'.
+    void update(const std::vector<DrawItem>& items, FrameArena& arena);
+    // Draws front to back from 'eye'. Cheap when the eye did not move.
+    void sort(const glm::vec3& eye, FrameArena& arena);
+    // Sends the commands to the indirect buffer if they changed
+    void upload();
+    // Expects the program in use with identity model and normal matrices and
+    // tex_scale 1. 'bind_group' sets the texture and material of a group.
+    void draw(const std::function<void(const Group&)>& bind_group) const;
+
+    bool is_indirect() const {
+        return m_indirect;
+    }
+    size_t get_command_count() const {
+        return m_drawn;
+    }
+    uint64_t get_triangles() const {
+        return m_triangles;
+    }
+    // Draw calls one draw() issues
+    size_t get_draw_calls() const;
+
+private:
+    // Lays out the visible commands in the drawing order
+    void rebuild();
+};
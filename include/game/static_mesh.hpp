@@ -0,0 +1,32 @@
+#pragma once
+#include <memory>
+#include "ball.hpp"
+#include "cuboid.hpp"
+#include "mesh_bvh.hpp"
+
+// Prop that never moves and that balls and scene queries collide with
+// triangle by triangle, so they pass through the gaps of its bounding box.
+// Boxes and enemies, the broadphase and the flow field still take it for its
+// AABB.
+class StaticMesh : public Cuboid {
+private:
+    std::shared_ptr<const MeshBvh> m_bvh;
+public:
+    StaticMesh(BodyStore& store, const PV112::PV112Geometry& geometry,
+        const GLuint tex, const glm::vec3& center, const glm::vec3& scale,
+        std::shared_ptr<const MeshBvh> bvh)
+     : Cuboid(store, geometry, tex, center, scale, Motion(false)),
+       m_bvh(std::move(bvh))
+    { }
+
+    virtual bool penetration_what(const Ball& ball, Penetration& out) const final override {
+        // The vertices of the mesh are scaled like the ones drawn
+        return m_bvh->collide(this->position(), m_scale, ball.get_center(),
+            ball.get_radius(), out);
+    }
+    virtual bool cast(const glm::vec3& origin, const glm::vec3& direction,
+            const float radius, float& distance, glm::vec3& normal) const final override {
+        return m_bvh->cast(this->position(), m_scale, origin, direction, radius,
+            distance, normal);
+    }
+};
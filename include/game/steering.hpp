@@ -0,0 +1,62 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "libs.hpp"
+#include "spatial_grid.hpp"
+#include "flow_field.hpp"
+
+class Object;
+class Enemy;
+
+struct SteeringParams {
+    float max_speed = 2.f;
+    float max_force = 6.f;
+    // Enemies closer than this push each other away
+    float neighbour_radius = 1.2f;
+    float separation_weight = 3.f;
+};
+
+// Batched enemy steering: seek towards the player plus separation from the
+// neighbours found through a SpatialGrid. Enemy state is gathered into SoA
+// arrays sorted by grid cell, so both passes run over contiguous memory.
+// When a FlowField is given, enemies seek along it instead of a straight line.
+class SteeringSystem {
+private:
+    SteeringParams m_params;
+    SpatialGrid m_grid;
+
+    std::vector<Enemy*> m_raw_enemies;
+    std::vector<float> m_raw_x, m_raw_z;
+
+    // Alive enemies in cell order
+    std::vector<Enemy*> m_enemies;
+    std::vector<float> m_px, m_pz;
+    // Heading to seek along, not normalized
+    std::vector<float> m_hx, m_hz;
+    std::vector<float> m_vx, m_vz;
+    std::vector<float> m_fx, m_fz;
+public:
+    SteeringSystem() = default;
+    SteeringSystem(const SteeringParams& params)
+     : m_params(params)
+    {}
+
+    const SteeringParams& get_params() const {
+        return m_params;
+    }
+    void set_params(const SteeringParams& params) {
+        m_params = params;
+    }
+
+    void step(const std::vector<std::shared_ptr<Object>>& enemies,
+        const glm::vec3& target, const float time_delta,
+        const FlowField::Field* field = nullptr);
+
+private:
+    void gather(const std::vector<std::shared_ptr<Object>>& enemies,
+        const glm::vec3& target, const float time_delta,
+        const FlowField::Field* field);
+    void seek();
+    void separate();
+    void integrate(const float time_delta);
+};
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include "libs.hpp"
+#include "gpu_resource.hpp"
+
+// One buffer for the data that is written anew every frame, like the ImGui
+// vertices. It is split into FRAMES regions used in turns, each guarded by a
+// fence, so the CPU writes one region while the GPU still reads the others.
+//
+// With ARB_buffer_storage the buffer is mapped once for good and write() is
+// a memcpy. Without it, the whole buffer is orphaned with glBufferData every
+// frame and written with glBufferSubData.
+class StreamBuffer {
+public:
+    static constexpr uint32_t FRAMES = 3;
+
+private:
+    GpuBuffer m_buffer;
+    GLsizeiptr m_frame_size;
+    bool m_persistent;
+    char* m_mapped = nullptr;
+
+    uint32_t m_frame = 0;
+    GLsizeiptr m_used = 0;
+    GLsync m_fences[FRAMES] = {};
+    // A write did not fit, the buffer grows at the next frame
+    bool m_overflow = false;
+    uint64_t m_stalls = 0;
+
+public:
+    explicit StreamBuffer(const GLsizeiptr frame_size);
+    ~StreamBuffer();
+    StreamBuffer(const StreamBuffer&) = delete;
+    StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+    // Waits until the GPU is done with the region of this frame
+    void begin_frame();
+    // Fences the region after the last draw reading it
+    void end_frame();
+
+    // Copies 'size' bytes into the region of this frame, aligned to
+    // 'alignment' bytes. Returns their offset in the buffer, or -1 when the
+    // region is full.
+    GLintptr write(const void* data, const GLsizeiptr size,
+        const GLsizeiptr alignment = 4);
+
+    // Changes when the buffer grows, bind it again every frame
+    GLuint get_buffer() const {
+        return m_buffer.get();
+    }
+    bool is_persistent() const {
+        return m_persistent;
+    }
+    // Frames that had to wait for the GPU
+    uint64_t get_stalls() const {
+        return m_stalls;
+    }
+
+private:
+    void create();
+    void destroy();
+};
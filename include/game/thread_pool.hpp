@@ -0,0 +1,51 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads that live as long as the pool and run one parallel_for at a time.
+// The calling thread works as one of them, so a pool of one thread runs the
+// tasks in place.
+class ThreadPool {
+private:
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_start_cv;
+    std::condition_variable m_done_cv;
+    std::function<void(size_t)> m_task;
+    size_t m_count = 0;
+    std::atomic<size_t> m_next;
+    uint64_t m_generation = 0;
+    uint32_t m_busy_workers = 0;
+    bool m_stop = false;
+
+public:
+    // 'threads' == 0 uses all cores
+    explicit ThreadPool(const uint32_t threads = 0);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Runs 'task' for every index below 'count' and waits for all of them.
+    // Indices are claimed one by one, so tasks of different length balance
+    // out.
+    void parallel_for(const size_t count, std::function<void(size_t)> task);
+
+    // Threads working on a parallel_for, the calling one included
+    uint32_t size() const {
+        return m_workers.size() + 1;
+    }
+
+    static uint32_t cores() {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+private:
+    void work();
+    void run();
+};
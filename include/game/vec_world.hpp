@@ -0,0 +1,77 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "game.hpp"
+#include "profiler.hpp"
+#include "thread_pool.hpp"
+#include "world.hpp"
+
+// Batch of independent headless worlds stepped together, for balance testing
+// and bot training. Every step advances all worlds by the same time delta,
+// the worlds are spread over a pool of threads that lives as long as the
+// batch. A world that is over is rebuilt with its next seed within the same
+// step, so the observation returned for it is the first one of a new match.
+//
+// Actions are ACTION_SIZE floats per world: move x, move z (XZ direction,
+// clamped to unit length), fire (> 0.5 fires with the machine gun cadence)
+// and aim x, y, z.
+//
+// Observations are OBSERVATION_SIZE floats per world: player x, y, z, time
+// left, player alive, alive enemies, then position relative to the player
+// and hit count of the OBSERVED_ENEMIES nearest alive enemies, zero padded.
+//
+// Reward is KILL_REWARD per enemy killed in the step plus DEATH_REWARD when
+// the player dies.
+class VecWorld {
+public:
+    static constexpr uint32_t ACTION_SIZE = 6;
+    static constexpr uint32_t OBSERVED_ENEMIES = 8;
+    static constexpr uint32_t OBSERVATION_SIZE = 6 + 4 * OBSERVED_ENEMIES;
+    static constexpr float KILL_REWARD = 1.f;
+    static constexpr float DEATH_REWARD = -10.f;
+
+private:
+    GameOptions m_opts;
+    WorldResources m_res;
+    uint32_t m_base_seed;
+    // One per world, they outlive the worlds rebuilt on reset
+    std::vector<Profiler> m_profilers;
+    // Shared with Python, which may hold a world past its rebuild
+    std::vector<std::shared_ptr<World>> m_worlds;
+    std::vector<uint32_t> m_episodes;
+    ThreadPool m_pool;
+
+public:
+    // 'threads' == 0 uses all cores, the calling thread works as one of them.
+    // GameOptions::on_frame is not called by batched worlds.
+    VecWorld(const GameOptions& opts, const uint32_t count,
+        const uint32_t threads = 0);
+    VecWorld(const VecWorld&) = delete;
+    VecWorld& operator=(const VecWorld&) = delete;
+
+    // Rebuilds all worlds from their first seed
+    void reset(float* observations);
+    void step(const float time_delta, const float* actions,
+        float* observations, float* rewards, uint8_t* dones);
+
+    size_t size() const {
+        return m_worlds.size();
+    }
+    World& get(const size_t index) {
+        return *m_worlds.at(index);
+    }
+    std::shared_ptr<World> share(const size_t index) {
+        return m_worlds.at(index);
+    }
+    const Profiler& get_profiler(const size_t index) const {
+        return m_profilers.at(index);
+    }
+
+private:
+    void build(const size_t index);
+    void observe(const size_t index, float* observation) const;
+    // Runs 'task' for every world index on the pool and waits for it
+    void parallel_for(std::function<void(size_t)> task);
+};
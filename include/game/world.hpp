@@ -0,0 +1,177 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+#include "libs.hpp"
+#include "PV112.h"
+#include "body_store.hpp"
+#include "broadphase.hpp"
+#include "contact_solver.hpp"
+#include "flow_field.hpp"
+#include "game.hpp"
+#include "integrator.hpp"
+#include "mesh_bvh.hpp"
+#include "particle_system.hpp"
+#include "profiler.hpp"
+#include "scene_generator.hpp"
+#include "scene_query.hpp"
+#include "steering.hpp"
+
+// OpenGL objects and sound the objects of a world are created with. The
+// headless set has no OpenGL objects at all, only the mesh bounds and BVHs,
+// which is all a world needs when it is simulated without a window.
+struct WorldResources {
+    PV112::PV112Geometry cube, sphere, table, box, bulb;
+    GLuint ball_tex = 0;
+    GLuint stone_tex = 0;
+    GLuint metal_tex = 0;
+    GLuint spike_tex = 0;
+    GLuint glass_tex = 0;
+    // One texture per hit an enemy can take, the last one is its death
+    std::vector<GLuint> enemy_textures;
+    irrklang::ISoundEngine *sound = nullptr;
+    // Triangles of the props balls collide with, without them the props are
+    // their AABBs
+    std::shared_ptr<const MeshBvh> table_bvh;
+    std::shared_ptr<const MeshBvh> bulb_bvh;
+
+    // The BVHs are built on 'pool' when there is one
+    static WorldResources headless(ThreadPool* pool = nullptr);
+};
+
+// One match: the arena, its objects, the enemies chasing the player and the
+// rules deciding who wins. It knows nothing about windows or input, the game
+// feeds it the player state every tick and draws what describe() captures.
+class World {
+public:
+    struct Input {
+        glm::vec3 position;
+        // Direction balls are fired in
+        glm::vec3 aim;
+        // Keep firing with the machine gun cadence
+        bool fire = false;
+        // Single shots fired since the last step
+        uint32_t shots = 0;
+    };
+
+private:
+    static constexpr float FIRE_INTERVAL = 0.1f;
+    // How long a muzzle flash lights the scene
+    static constexpr float FLASH_TIME = 0.08f;
+
+    GameOptions m_opts;
+    WorldResources m_res;
+    Profiler& m_profiler;
+    SceneDescription m_scene;
+    std::mt19937 m_rng;
+
+    // Declared before the objects, they unregister from it when destroyed
+    BodyStore m_bodies;
+    // Sorted by id, new objects are only ever appended
+    std::vector<std::shared_ptr<Object>> m_objects;
+    std::vector<std::shared_ptr<Object>> m_enemies;
+    // Static props the enemies have to walk around
+    std::vector<std::shared_ptr<Object>> m_obstacles;
+    SteeringSystem m_steering;
+    std::unique_ptr<FlowField> m_flow_field;
+    Broadphase m_broadphase;
+    ContactSolver m_solver;
+    Integrator m_integrator;
+    SceneQuery m_queries;
+    // Objects moved or changed since m_queries was built
+    bool m_queries_stale = true;
+    ParticleSystem m_particles;
+
+    float m_time = 0;
+    float m_last_fired = -1;
+    // Muzzle flashes, position and the time they were fired
+    std::vector<std::pair<glm::vec3, float>> m_flashes;
+    glm::vec3 m_player;
+    bool m_player_alive = true;
+
+public:
+    // A threaded flow field keeps the frame rate smooth, a world stepped in
+    // a batch rather builds it in place and stays deterministic.
+    World(const GameOptions& opts, const WorldResources& resources,
+        Profiler& profiler, const bool threaded_flow_field = true);
+    World(const World&) = delete;
+    World& operator=(const World&) = delete;
+
+    // Steps longer than IntegratorParams::max_time_delta are cut to it
+    void step(const float time_delta, const Input& input);
+    void fire_ball(const glm::vec3& position, const glm::vec3& direction);
+    // Moves the player along XZ with the camera speed, kept inside the arena
+    glm::vec3 move_player(const glm::vec3& position, const glm::vec3& direction,
+        const float time_delta) const;
+
+    std::vector<uint32_t> spawn_balls(const float* positions,
+        const float* velocities, const float* radii, const size_t count);
+    std::vector<uint32_t> spawn_boxes(const float* positions,
+        const float* velocities, const size_t count);
+    std::vector<uint32_t> spawn_enemies(const float* positions,
+        const float* scales, const size_t count);
+    size_t despawn(const uint32_t* ids, const size_t count);
+
+    uint32_t alive_enemies() const;
+    // Appends a DrawItem for every object, in the order of their ids
+    void describe(std::vector<DrawItem>& items) const;
+    // Appends the lamps, muzzle flashes and the glow of alive enemies
+    void describe_lights(std::vector<PointLight>& lights) const;
+    void describe_particles(std::vector<ParticleVertex>& particles) const {
+        m_particles.describe(particles);
+    }
+    bool is_over() const {
+        return !m_player_alive || m_time > m_opts.game_time
+            || this->alive_enemies() == 0;
+    }
+
+    float get_time() const {
+        return m_time;
+    }
+    bool is_player_alive() const {
+        return m_player_alive;
+    }
+    const glm::vec3& get_player() const {
+        return m_player;
+    }
+    const GameOptions& get_options() const {
+        return m_opts;
+    }
+    const SceneDescription& get_scene() const {
+        return m_scene;
+    }
+    BodyStore& get_bodies() {
+        return m_bodies;
+    }
+    const std::vector<std::shared_ptr<Object>>& get_objects() const {
+        return m_objects;
+    }
+    const std::vector<std::shared_ptr<Object>>& get_enemies() const {
+        return m_enemies;
+    }
+    const ContactSolver& get_solver() const {
+        return m_solver;
+    }
+    const Integrator& get_integrator() const {
+        return m_integrator;
+    }
+    const ParticleSystem& get_particles() const {
+        return m_particles;
+    }
+    // Over the objects as they are now, the tree is built again on the first
+    // call after they moved
+    const SceneQuery& queries();
+
+private:
+    void build_scene();
+    void clear_expired();
+    // Forces, contacts and motion of one substep of a step
+    void substep(const float time_delta);
+    void resolve_collisions(const float time_delta);
+    // Lets 'target' know that 'other' hit it at 'point', and sprays the
+    // sparks and debris when it is an enemy. 'away' points off the target.
+    void hit(Object& target, const Object& other, const glm::vec3& point,
+        const glm::vec3& away);
+    void play(const char* sound);
+};
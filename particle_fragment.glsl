@@ -0,0 +1,14 @@
+#version 330
+
+in vec4 VS_color;
+
+out vec4 final_color;
+
+// Round sprites, unlit
+void main()
+{
+    vec2 offset = 2.0 * gl_PointCoord - 1.0;
+    if (dot(offset, offset) > 1.0)
+        discard;
+    final_color = VS_color;
+}
@@ -0,0 +1,21 @@
+#version 330
+
+// The diameter is in w
+in vec4 position;
+in vec3 velocity;
+in vec4 color;
+
+uniform mat4 PV_matrix;
+// Seconds the frame is drawn behind the simulation
+uniform float lag;
+// Pixels per unit of size at the distance of 1
+uniform float pixel_scale;
+
+out vec4 VS_color;
+
+void main()
+{
+    gl_Position = PV_matrix * vec4(position.xyz - lag * velocity, 1.0);
+    gl_PointSize = max(1.0, position.w * pixel_scale / gl_Position.w);
+    VS_color = color;
+}
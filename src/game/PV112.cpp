@@ -13,10 +13,11 @@
 
 
 #include <memory>
-#include <sstream>
 #include <fstream>
 #include <iostream>
 
+#include <glm/gtc/constants.hpp>
+
 #include "game/cube.inl"
 #include "game/sphere.inl"
 #include "game/teapot.inl"
@@ -72,10 +73,16 @@ void SetDebugCallback(GLDEBUGPROCARB callback)
 
 string LoadFileToString(const char *file_name)
 {
-    ifstream file(file_name);
-    stringstream ss;
-    ss << file.rdbuf();
-    return ss.str();
+    // Straight into the string, without a copy through a stream buffer
+    ifstream file(file_name, ios::binary | ios::ate);
+    if (!file)
+    {
+        return string();
+    }
+    string content(size_t(file.tellg()), '\0');
+    file.seekg(0);
+    file.read(&content[0], content.size());
+    return content;
 }
 
 void WaitForEnterAndExit()
@@ -94,7 +101,11 @@ GLuint LoadAndCompileShader(GLenum shader_type, const char *file_name)
         cout << "File " << file_name << " is empty or failed to load" << endl;
         return 0;
     }
+    return CompileShader(shader_type, s_source, file_name);
+}
 
+GLuint CompileShader(GLenum shader_type, const std::string &s_source, const char *file_name)
+{
     // Create shader object and set the source
     GLuint shader = glCreateShader(shader_type);
     const char *source = s_source.c_str();
@@ -222,20 +233,15 @@ PV112Geometry &PV112Geometry::operator =(const PV112Geometry &rhs)
     Mode = rhs.Mode;
     DrawArraysCount = rhs.DrawArraysCount;
     DrawElementsCount = rhs.DrawElementsCount;
+    aabb = rhs.aabb;
+    Data = rhs.Data;
+    Objects = rhs.Objects;
     return *this;
 }
 
 void DeleteGeometry(PV112Geometry &geom)
 {
-    // This is mostly an example of what should be destroyed and how. We won't be using it anywhere.
-    //
-    // When using it, make sure the OpenGL context still exists (i.e. the main window still exists).
-
-    // OpenGL silently ignores deleting objects that are 0, so this is safe even if the buffers were not created.
-    glDeleteBuffers(3, geom.VertexBuffers);
-    glDeleteBuffers(1, &geom.IndexBuffer);
-    glDeleteVertexArrays(1, &geom.VAO);
-
+    // The objects stay alive while other copies of the geometry hold them
     geom = PV112Geometry();        // Reset the state to 'no geometry'
 }
 
@@ -263,11 +269,54 @@ get_raw_vert_from_inl(const float (&vertices)[Count])
     return raw_vertices;
 }
 
+// Copies interleaved position, normal and texture coordinates of an .inl geometry
+static std::shared_ptr<const MeshData> MeshDataFromInl(const float *vertices, int vertices_count,
+        const unsigned int *indices, int indices_count)
+{
+    auto data = std::make_shared<MeshData>();
+    for (int i = 0; i < vertices_count; i++)
+    {
+        const float *v = vertices + 8 * i;
+        data->Positions.push_back(glm::vec3(v[0], v[1], v[2]));
+        data->Normals.push_back(glm::vec3(v[3], v[4], v[5]));
+        data->TexCoords.push_back(glm::vec2(v[6], v[7]));
+    }
+    data->Indices.assign(indices, indices + indices_count);
+    return data;
+}
+
+// Size of the storage of a buffer, 0 for no buffer
+static size_t BufferSize(GLuint buffer)
+{
+    if (buffer == 0)
+        return 0;
+    GLint size = 0;
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    glGetBufferParameteriv(GL_ARRAY_BUFFER, GL_BUFFER_SIZE, &size);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return size;
+}
+
+// Hands the objects of a freshly created geometry over to its owner
+static void AdoptObjects(PV112Geometry &geometry)
+{
+    auto objects = std::make_shared<GeometryObjects>();
+    for (int i = 0; i < 3; ++i)
+    {
+        const GLuint buffer = geometry.VertexBuffers[i];
+        objects->VertexBuffers[i] = GpuBuffer(buffer, BufferSize(buffer));
+    }
+    objects->IndexBuffer = GpuBuffer(geometry.IndexBuffer, BufferSize(geometry.IndexBuffer));
+    objects->VAO = GpuVertexArray(geometry.VAO);
+    geometry.Objects = objects;
+}
+
 PV112Geometry CreateCube(GLint position_location, GLint normal_location, GLint tex_coord_location)
 {
     PV112Geometry geometry;
 
     geometry.aabb = AABB(get_raw_vert_from_inl(cube_vertices));
+    geometry.Data = MeshDataFromInl(cube_vertices, cube_vertices_count, cube_indices, cube_indices_count);
 
     // Create a single buffer for vertex data
     glGenBuffers(1, &geometry.VertexBuffers[0]);
@@ -315,6 +364,7 @@ PV112Geometry CreateCube(GLint position_location, GLint normal_location, GLint t
     geometry.DrawArraysCount = 0;
     geometry.DrawElementsCount = cube_indices_count;
 
+    AdoptObjects(geometry);
     return geometry;
 }
 
@@ -367,7 +417,9 @@ PV112Geometry CreateSphere(GLint position_location, GLint normal_location, GLint
     geometry.Mode = GL_TRIANGLE_STRIP;
     geometry.DrawArraysCount = 0;
     geometry.DrawElementsCount = sphere_indices_count;
+    geometry.Data = MeshDataFromInl(sphere_vertices, sphere_vertices_count, sphere_indices, sphere_indices_count);
 
+    AdoptObjects(geometry);
     return geometry;
 }
 
@@ -420,7 +472,108 @@ PV112Geometry CreateTeapot(GLint position_location, GLint normal_location, GLint
     geometry.Mode = GL_TRIANGLE_STRIP;
     geometry.DrawArraysCount = 0;
     geometry.DrawElementsCount = teapot_indices_count;
+    geometry.Data = MeshDataFromInl(teapot_vertices, teapot_vertices_count, teapot_indices, teapot_indices_count);
+
+    AdoptObjects(geometry);
+    return geometry;
+}
+
+PV112Geometry CreateUVSphere(int slices, int stacks, GLint position_location, GLint normal_location,
+        GLint tex_coord_location)
+{
+    auto data = std::make_shared<MeshData>();
+    const float pi = glm::pi<float>();
+
+    // One row of vertices per parallel, the first and the last column meet at the seam
+    for (int i = 0; i <= stacks; i++)
+    {
+        const float v = float(i) / stacks;
+        const float phi = v * pi;
+        for (int j = 0; j <= slices; j++)
+        {
+            const float u = float(j) / slices;
+            const float theta = u * 2 * pi;
+            const glm::vec3 n(sin(phi) * cos(theta), cos(phi), sin(phi) * sin(theta));
+            data->Positions.push_back(n);
+            data->Normals.push_back(n);
+            data->TexCoords.push_back(glm::vec2(u, v));
+        }
+    }
+    // Counter-clockwise from the outside, the triangles touching the poles are skipped
+    for (int i = 0; i < stacks; i++)
+    {
+        for (int j = 0; j < slices; j++)
+        {
+            const unsigned int a = i * (slices + 1) + j;
+            const unsigned int b = a + slices + 1;
+            if (i != 0)
+                data->Indices.insert(data->Indices.end(), {a, a + 1, b});
+            if (i != stacks - 1)
+                data->Indices.insert(data->Indices.end(), {a + 1, b + 1, b});
+        }
+    }
+
+    std::vector<float> vertices;
+    vertices.reserve(data->Positions.size() * 8);
+    for (size_t i = 0; i < data->Positions.size(); i++)
+    {
+        const auto &p = data->Positions[i];
+        const auto &n = data->Normals[i];
+        const auto &t = data->TexCoords[i];
+        vertices.insert(vertices.end(), {p.x, p.y, p.z, n.x, n.y, n.z, t.x, t.y});
+    }
+
+    PV112Geometry geometry;
+    geometry.aabb = AABB(glm::vec3(0), glm::vec3(1));
+
+    // Create a single buffer for vertex data
+    glGenBuffers(1, &geometry.VertexBuffers[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, geometry.VertexBuffers[0]);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    geometry.VertexBuffers[1] = 0;
+    geometry.VertexBuffers[2] = 0;
+
+    // Create a buffer for indices
+    glGenBuffers(1, &geometry.IndexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry.IndexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, data->Indices.size() * sizeof(unsigned int), data->Indices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    // Create a vertex array object for the geometry
+    glGenVertexArrays(1, &geometry.VAO);
 
+    // Set the parameters of the geometry
+    glBindVertexArray(geometry.VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, geometry.VertexBuffers[0]);
+    if (position_location >= 0)
+    {
+        glEnableVertexAttribArray(position_location);
+        glVertexAttribPointer(position_location, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 8, 0);
+    }
+    if (normal_location >= 0)
+    {
+        glEnableVertexAttribArray(normal_location);
+        glVertexAttribPointer(normal_location, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 8, (const void *)(sizeof(float) * 3));
+    }
+    if (tex_coord_location >= 0)
+    {
+        glEnableVertexAttribArray(tex_coord_location);
+        glVertexAttribPointer(tex_coord_location, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 8, (const void *)(sizeof(float) * 6));
+    }
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry.IndexBuffer);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    geometry.Mode = GL_TRIANGLES;
+    geometry.DrawArraysCount = 0;
+    geometry.DrawElementsCount = data->Indices.size();
+    geometry.Data = data;
+
+    AdoptObjects(geometry);
     return geometry;
 }
 
@@ -581,33 +734,66 @@ bool ParseOBJFile(const char *file_name, std::vector<glm::vec3> &out_vertices, s
     return true;
 }
 
-PV112Geometry LoadOBJ(const char *file_name, GLint position_location, GLint normal_location, GLint tex_coord_location)
+// Moves the vertices to fit into a unit box centered at the origin and returns their bounds
+static AABB NormalizeVertices(std::vector<glm::vec3> &vertices)
 {
-    PV112Geometry geometry;
+    AABB aabb(vertices);
+    auto widths = aabb.get_halfwidths();
+
+    auto shift = -aabb.get_center();
+    float scale = std::max(std::max(2*widths[0], 2*widths[1]), 2*widths[2]);
 
+    for (auto& vertex: vertices) {
+        vertex += shift;
+        vertex /= scale;
+    }
+    widths /= scale;
+    return AABB({0, 0, 0}, widths);
+}
+
+AABB LoadOBJBounds(const char *file_name)
+{
     std::vector<glm::vec3> vertices;
     std::vector<glm::vec3> normals;
     std::vector<glm::vec2> tex_coords;
     if (!ParseOBJFile(file_name, vertices, normals, tex_coords))
     {
-        return geometry;        // Return empty geometry, the error message was already printed
+        return AABB(glm::vec3(0), glm::vec3(0));
     }
+    return NormalizeVertices(vertices);
+}
 
-    { // Normalize object
-        AABB aabb(vertices);
-        auto widths = aabb.get_halfwidths();
+std::shared_ptr<MeshData> ReadOBJ(const char *file_name, AABB &out_aabb)
+{
+    auto data = std::make_shared<MeshData>();
+    if (!ParseOBJFile(file_name, data->Positions, data->Normals, data->TexCoords))
+    {
+        return nullptr;         // The error message was already printed
+    }
+    out_aabb = NormalizeVertices(data->Positions);
+    return data;
+}
 
-        auto shift = -aabb.get_center();
-        float scale = std::max(std::max(2*widths[0], 2*widths[1]), 2*widths[2]);
+PV112Geometry LoadOBJ(const char *file_name, GLint position_location, GLint normal_location, GLint tex_coord_location)
+{
+    AABB aabb(glm::vec3(0), glm::vec3(0));
+    auto data = ReadOBJ(file_name, aabb);
+    return CreateOBJGeometry(std::move(data), aabb, position_location, normal_location, tex_coord_location);
+}
 
-        for (auto& vertex: vertices) {
-            vertex += shift;
-            vertex /= scale;
-         }
-        widths /= scale;
-        geometry.aabb = AABB({0, 0, 0}, widths);
+PV112Geometry CreateOBJGeometry(std::shared_ptr<MeshData> data, const AABB &aabb, GLint position_location, GLint normal_location, GLint tex_coord_location)
+{
+    PV112Geometry geometry;
+    if (!data)
+    {
+        return geometry;        // Return empty geometry
     }
 
+    geometry.aabb = aabb;
+    const auto &vertices = data->Positions;
+    const auto &normals = data->Normals;
+    const auto &tex_coords = data->TexCoords;
+
 
     // Create buffers for vertex data
     glGenBuffers(3, geometry.VertexBuffers);
@@ -652,7 +838,9 @@ PV112Geometry LoadOBJ(const char *file_name, GLint position_location, GLint norm
     geometry.Mode = GL_TRIANGLES;
     geometry.DrawArraysCount = vertices.size();
     geometry.DrawElementsCount = 0;
+    geometry.Data = std::move(data);
 
+    AdoptObjects(geometry);
     return geometry;
 }
 
@@ -676,6 +864,13 @@ PV112Camera::PV112Camera(const std::array<std::array<float, 2>, 3>& bounds)
     arrows_pressed.fill(false);
 }
 
+void PV112Camera::set_bounds(const std::array<std::array<float, 2>, 3>& new_bounds)
+{
+    bounds = new_bounds;
+    this->clamp_position();
+    this->update_attributes();
+}
+
 void PV112Camera::OnMouseButtonChanged(int button, int state, int x, int y)
 {
     // // Left mouse button affects the angles
@@ -742,6 +937,15 @@ void PV112Camera::ProcessArrowKeys(std::array<bool, 4> keys, float time_delta) {
     }
 }
 
+void PV112Camera::SetView(const glm::vec3 &position, float horizontal, float vertical)
+{
+    attr.position = position;
+    horizontal_angle = horizontal;
+    vertical_angle = vertical;
+    this->clamp_position();
+    this->update_attributes();
+}
+
 void PV112Camera::clamp_position() {
     const float eps = 0.4;
     for (unsigned i = 0; i < 3; ++i) {
@@ -0,0 +1,77 @@
+#include <cstdlib>
+#include <new>
+#include "game/allocation_probe.hpp"
+
+namespace {
+
+thread_local uint64_t t_allocations = 0;
+
+void*
+allocate(const std::size_t size) {
+    ++t_allocations;
+    // malloc(0) may return null, operator new must not
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+} // namespace
+
+uint64_t
+AllocationProbe::count() {
+    return t_allocations;
+}
+
+void*
+operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void*
+operator new[](std::size_t size) {
+    return allocate(size);
+}
+
+void*
+operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    ++t_allocations;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void*
+operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    ++t_allocations;
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void
+operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void
+operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void
+operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void
+operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void
+operator delete(void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
+
+void
+operator delete[](void* p, const std::nothrow_t&) noexcept {
+    std::free(p);
+}
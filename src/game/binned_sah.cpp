@@ -0,0 +1,48 @@
+#include "game/binned_sah.hpp"
+
+constexpr uint32_t BinnedSah::BINS;
+
+BinnedSah::BinnedSah(const glm::vec3& low, const glm::vec3& high)
+ : m_low(low)
+{
+    for (uint32_t axis = 0; axis < 3; ++axis) {
+        m_scale[axis] = high[axis] > low[axis] ? BINS / (high[axis] - low[axis]) : 0;
+    }
+}
+
+void
+BinnedSah::begin(const uint32_t axis) {
+    m_axis = axis;
+    m_bins.fill(Bin());
+}
+
+void
+BinnedSah::sweep() {
+    // Areas and counts left of every boundary, then sweeping from the right
+    std::array<float, BINS> left_area;
+    std::array<uint32_t, BINS> left_count;
+    Bin left;
+    for (uint32_t b = 0; b + 1 < BINS; ++b) {
+        left.min = glm::min(left.min, m_bins[b].min);
+        left.max = glm::max(left.max, m_bins[b].max);
+        left.count += m_bins[b].count;
+        left_area[b] = area(left.min, left.max);
+        left_count[b] = left.count;
+    }
+    Bin right;
+    for (uint32_t b = BINS - 1; b > 0; --b) {
+        right.min = glm::min(right.min, m_bins[b].min);
+        right.max = glm::max(right.max, m_bins[b].max);
+        right.count += m_bins[b].count;
+        if (left_count[b - 1] == 0 || right.count == 0) {
+            continue;
+        }
+        const float cost = left_area[b - 1] * left_count[b - 1]
+            + area(right.min, right.max) * right.count;
+        if (cost < m_best.cost) {
+            m_best.cost = cost;
+            m_best.axis = m_axis;
+            m_best.bin = b;
+        }
+    }
+}
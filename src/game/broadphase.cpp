@@ -0,0 +1,56 @@
+#include <algorithm>
+#include "game/broadphase.hpp"
+
+const std::vector<Broadphase::Pair>&
+Broadphase::find_pairs(const std::vector<std::shared_ptr<Object>>& objects) {
+    m_pairs.clear();
+    if (objects.size() < 2) {
+        return m_pairs;
+    }
+
+    // Sweep along the axis where the objects are spread the most
+    glm::vec3 sum(0), sum_sq(0);
+    for (const auto& obj : objects) {
+        const auto c = obj->get_aabb().get_center();
+        sum += c;
+        sum_sq += c * c;
+    }
+    const float n = objects.size();
+    const glm::vec3 variance = sum_sq / n - (sum / n) * (sum / n);
+    uint32_t axis = 0;
+    if (variance[1] > variance[axis]) {
+        axis = 1;
+    }
+    if (variance[2] > variance[axis]) {
+        axis = 2;
+    }
+
+    m_intervals.resize(objects.size());
+    for (uint32_t i = 0; i < objects.size(); ++i) {
+        const auto& aabb = objects[i]->get_aabb();
+        const float c = aabb.get_center()[axis];
+        const float hw = aabb.get_halfwidths()[axis];
+        m_intervals[i] = {c - hw, c + hw, i};
+    }
+    std::sort(m_intervals.begin(), m_intervals.end(),
+        [](const Interval& a, const Interval& b) {
+            return a.min < b.min;
+        });
+
+    for (size_t i = 0; i < m_intervals.size(); ++i) {
+        const auto& a = m_intervals[i];
+        const auto& obj_A = *objects[a.index];
+        for (size_t j = i + 1; j < m_intervals.size() && m_intervals[j].min <= a.max; ++j) {
+            const auto& b = m_intervals[j];
+            const auto& obj_B = *objects[b.index];
+            if (!obj_A.is_active() && !obj_B.is_active()) {
+                continue;
+            }
+            if (obj_A.get_aabb().check_collision(obj_B.get_aabb())) {
+                m_pairs.push_back({std::min(a.index, b.index), std::max(a.index, b.index)});
+            }
+        }
+    }
+    std::sort(m_pairs.begin(), m_pairs.end());
+    return m_pairs;
+}
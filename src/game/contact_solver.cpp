@@ -0,0 +1,233 @@
+#include <algorithm>
+#include <cmath>
+#include "game/contact_solver.hpp"
+
+namespace {
+
+// A point of the last step farther than this does not warm start a new one
+constexpr float MATCH_DISTANCE = 0.1f;
+
+bool
+by_key(const ContactSolver::Contact& a, const ContactSolver::Contact& b) {
+    return a.key < b.key;
+}
+
+// Of the point of 'b' relative to the point of 'a'
+glm::vec3
+relative_velocity(const std::vector<glm::vec3>& v, const std::vector<glm::vec3>& w,
+        const ContactSolver::Contact& c) {
+    return v[c.b] + glm::cross(w[c.b], c.rb) - v[c.a] - glm::cross(w[c.a], c.ra);
+}
+
+void
+apply(std::vector<glm::vec3>& v, std::vector<glm::vec3>& w,
+        const ContactSolver::Contact& c, const glm::vec3& impulse) {
+    v[c.a] -= c.inv_mass_a * impulse;
+    w[c.a] -= c.inv_inertia_a * glm::cross(c.ra, impulse);
+    v[c.b] += c.inv_mass_b * impulse;
+    w[c.b] += c.inv_inertia_b * glm::cross(c.rb, impulse);
+}
+
+// Of the two bodies pushed at the contact point along 'direction'
+float
+effective_mass(const ContactSolver::Contact& c, const glm::vec3& direction) {
+    const glm::vec3 ta = glm::cross(c.ra, direction);
+    const glm::vec3 tb = glm::cross(c.rb, direction);
+    const float inverse = c.inv_mass_a + c.inv_mass_b
+        + glm::dot(ta, c.inv_inertia_a * ta) + glm::dot(tb, c.inv_inertia_b * tb);
+    return inverse > 0 ? 1 / inverse : 0;
+}
+
+// Two directions orthogonal to the unit 'normal' and to each other
+void
+tangents(const glm::vec3& normal, glm::vec3* out) {
+    out[0] = glm::normalize(std::abs(normal.x) > 0.57735f ?
+        glm::vec3(normal.y, -normal.x, 0) : glm::vec3(0, normal.z, -normal.y));
+    out[1] = glm::cross(normal, out[0]);
+}
+
+}
+
+ContactSolver::ContactSolver(const SolverParams& params)
+ : m_params(params)
+{ }
+
+void
+ContactSolver::collide(const std::vector<std::shared_ptr<Object>>& objects,
+        const std::vector<Broadphase::Pair>& pairs) {
+    std::swap(m_contacts, m_previous);
+    m_contacts.clear();
+    m_began.clear();
+    for (const auto& pair : pairs) {
+        const Object* obj_A = objects[pair.first].get();
+        const Object* obj_B = objects[pair.second].get();
+        if (obj_A->get_id() > obj_B->get_id()) {
+            std::swap(obj_A, obj_B);
+        }
+        Penetration penetration;
+        if (!obj_A->penetration(*obj_B, penetration)) {
+            continue;
+        }
+        Contact c;
+        c.key = uint64_t(obj_A->get_id()) << 32 | obj_B->get_id();
+        c.a = obj_A->get_row();
+        c.b = obj_B->get_row();
+        c.normal = penetration.normal;
+        tangents(c.normal, c.tangents);
+        c.inv_mass_a = obj_A->inverse_mass();
+        c.inv_mass_b = obj_B->inverse_mass();
+        c.inv_inertia_a = m_params.rotation ? obj_A->inverse_inertia() : glm::mat3(0.f);
+        c.inv_inertia_b = m_params.rotation ? obj_B->inverse_inertia() : glm::mat3(0.f);
+        c.restitution = m_params.restitution
+            * std::max(obj_A->get_bounciness(), obj_B->get_bounciness());
+        c.target = 0;
+        c.normal_impulse = 0;
+        c.friction_impulse[0] = c.friction_impulse[1] = 0;
+        c.split_impulse = 0;
+        for (uint32_t i = 0; i < penetration.count; ++i) {
+            c.point = penetration.points[i];
+            c.ra = c.point - obj_A->position();
+            c.rb = c.point - obj_B->position();
+            c.depth = penetration.depths[i];
+            c.normal_mass = effective_mass(c, c.normal);
+            c.tangent_mass[0] = effective_mass(c, c.tangents[0]);
+            c.tangent_mass[1] = effective_mass(c, c.tangents[1]);
+            m_contacts.push_back(c);
+        }
+    }
+    // The points of a pair stay together, their order does not matter
+    std::sort(m_contacts.begin(), m_contacts.end(), by_key);
+
+    // Both lists are sorted, one merge-like pass matches the pairs
+    auto previous = m_previous.begin();
+    for (uint32_t i = 0; i < m_contacts.size(); ++i) {
+        auto& c = m_contacts[i];
+        previous = std::lower_bound(previous, m_previous.end(), c, by_key);
+        if (previous == m_previous.end() || previous->key != c.key) {
+            if (i == 0 || m_contacts[i - 1].key != c.key) {
+                m_began.push_back(i);
+            }
+            continue;
+        }
+        if (!m_params.warm_start) {
+            continue;
+        }
+        // From the nearest point the pair had
+        const Contact* nearest = nullptr;
+        float nearest_distance = MATCH_DISTANCE * MATCH_DISTANCE;
+        for (auto p = previous; p != m_previous.end() && p->key == c.key; ++p) {
+            const glm::vec3 d = p->point - c.point;
+            if (glm::dot(d, d) < nearest_distance) {
+                nearest = &*p;
+                nearest_distance = glm::dot(d, d);
+            }
+        }
+        if (nearest != nullptr) {
+            c.normal_impulse = nearest->normal_impulse;
+            // The normal turns a little between steps, keep what is tangent
+            const glm::vec3 f = nearest->friction_impulse[0] * nearest->tangents[0]
+                + nearest->friction_impulse[1] * nearest->tangents[1];
+            c.friction_impulse[0] = glm::dot(f, c.tangents[0]);
+            c.friction_impulse[1] = glm::dot(f, c.tangents[1]);
+        }
+    }
+}
+
+void
+ContactSolver::solve(BodyStore& bodies, const float time_delta) {
+    for (auto& c : m_contacts) {
+        // Only a fast approach bounces, a resting contact is solved to zero
+        const float vn = glm::dot(relative_velocity(bodies.velocity,
+            bodies.angular_velocity, c), c.normal);
+        c.target = vn < -m_params.restitution_threshold ? -c.restitution * vn : 0.f;
+    }
+    this->warm_start(bodies);
+    this->solve_velocities(bodies);
+    this->solve_positions(bodies, time_delta);
+}
+
+void
+ContactSolver::warm_start(BodyStore& bodies) {
+    for (const auto& c : m_contacts) {
+        apply(bodies.velocity, bodies.angular_velocity, c,
+            c.normal_impulse * c.normal + c.friction_impulse[0] * c.tangents[0]
+            + c.friction_impulse[1] * c.tangents[1]);
+    }
+}
+
+void
+ContactSolver::solve_velocities(BodyStore& bodies) {
+    auto& v = bodies.velocity;
+    auto& w = bodies.angular_velocity;
+    for (uint32_t iteration = 0; iteration < m_params.velocity_iterations; ++iteration) {
+        for (auto& c : m_contacts) {
+            if (c.normal_mass == 0) {
+                continue;
+            }
+            // The accumulated impulse never pulls the bodies together
+            const float vn = glm::dot(relative_velocity(v, w, c), c.normal);
+            const float normal_impulse = std::max(
+                c.normal_impulse - (vn - c.target) * c.normal_mass, 0.f);
+            apply(v, w, c, (normal_impulse - c.normal_impulse) * c.normal);
+            c.normal_impulse = normal_impulse;
+
+            // Friction stops the sliding, up to the cone of the normal impulse
+            const glm::vec3 dv = relative_velocity(v, w, c);
+            float friction[2];
+            for (uint32_t k = 0; k < 2; ++k) {
+                friction[k] = c.friction_impulse[k]
+                    - glm::dot(dv, c.tangents[k]) * c.tangent_mass[k];
+            }
+            const float limit = m_params.friction * c.normal_impulse;
+            const float length = std::sqrt(friction[0] * friction[0]
+                + friction[1] * friction[1]);
+            if (length > limit) {
+                friction[0] *= limit / length;
+                friction[1] *= limit / length;
+            }
+            apply(v, w, c, (friction[0] - c.friction_impulse[0]) * c.tangents[0]
+                + (friction[1] - c.friction_impulse[1]) * c.tangents[1]);
+            c.friction_impulse[0] = friction[0];
+            c.friction_impulse[1] = friction[1];
+        }
+    }
+}
+
+void
+ContactSolver::solve_positions(BodyStore& bodies, const float time_delta) {
+    if (m_params.position_iterations == 0 || time_delta <= 0) {
+        return;
+    }
+    // Zero but for the rows of the contacts, which are reset after use
+    if (m_push.size() < bodies.size()) {
+        m_push.resize(bodies.size(), glm::vec3(0));
+        m_twist.resize(bodies.size(), glm::vec3(0));
+    }
+    const float rate = m_params.baumgarte / time_delta;
+    for (uint32_t iteration = 0; iteration < m_params.position_iterations; ++iteration) {
+        for (auto& c : m_contacts) {
+            if (c.normal_mass == 0) {
+                continue;
+            }
+            const float bias = rate * std::max(c.depth - m_params.slop, 0.f);
+            const float vn = glm::dot(relative_velocity(m_push, m_twist, c), c.normal);
+            const float split_impulse = std::max(
+                c.split_impulse + (bias - vn) * c.normal_mass, 0.f);
+            apply(m_push, m_twist, c, (split_impulse - c.split_impulse) * c.normal);
+            c.split_impulse = split_impulse;
+        }
+    }
+    // A body in several contacts is moved once
+    auto move = [&](const uint32_t row) {
+        bodies.position[row] += time_delta * m_push[row];
+        if (m_twist[row] != glm::vec3(0)) {
+            bodies.orientation[row] = turned(bodies.orientation[row], m_twist[row],
+                time_delta);
+        }
+        m_push[row] = m_twist[row] = glm::vec3(0);
+    };
+    for (const auto& c : m_contacts) {
+        move(c.a);
+        move(c.b);
+    }
+}
@@ -1,26 +1,21 @@
 #include <cassert>
 #include "game/cuboid.hpp"
 #include "game/ball.hpp"
-#include "game/linalg.hpp"
 
 
-Cuboid::Cuboid(const GLuint program, const PV112::PV112Geometry& geometry,
+Cuboid::Cuboid(BodyStore& store, const PV112::PV112Geometry& geometry,
         const GLuint tex, const glm::vec3& center, const glm::vec3& scale)
- : Object(init_aabb(geometry.aabb, center, scale)),
-   m_program(program), m_geometry(geometry), m_tex(tex), m_center(center),
-   m_scale(scale), m_halfw(init_aabb(geometry.aabb, center, scale).get_halfwidths())
-{
-    this->init();
-}
+ : Cuboid(store, geometry, tex, center, scale, Motion(glm::vec3(1), 0))
+{ }
 
-Cuboid::Cuboid(const GLuint program, const PV112::PV112Geometry& geometry,
+Cuboid::Cuboid(BodyStore& store, const PV112::PV112Geometry& geometry,
         const GLuint tex, const glm::vec3& center, const glm::vec3& scale,
         const Motion& motion)
- : Object(init_aabb(geometry.aabb, center, scale), motion),
-   m_program(program), m_geometry(geometry), m_tex(tex), m_center(center),
-   m_scale(scale), m_halfw(init_aabb(geometry.aabb, center, scale).get_halfwidths())
+ : Object(store, init_aabb(geometry.aabb, center, scale), motion),
+   m_tex(tex), m_geometry(geometry), m_scale(scale),
+   m_halfw(init_aabb(geometry.aabb, center, scale).get_halfwidths())
 {
-    this->init();
+    m_store.kind[m_body] = m_motion.active ? BodyStore::BOX : BodyStore::STATIC;
 }
 
 AABB
@@ -32,36 +27,25 @@ Cuboid::init_aabb(AABB aabb, const glm::vec3& center, const glm::vec3& scale)
 }
 
 void
-Cuboid::init() {
-    this->bind_cube_texture();
-}
-
-void
-Cuboid::bind_cube_texture() {
-    m_tex_loc = glGetUniformLocation(m_program, "my_tex");
-}
-
-glm::mat4
-Cuboid::update_geometry(const float time_delta) {
+Cuboid::integrate(const float time_delta, const glm::vec3& velocity) {
     if (m_motion.active) {
-        m_motion.account_gravity(time_delta);
-        m_center = m_center + time_delta * m_motion.v;
-        m_aabb.set_center(m_center);
+        this->position() += time_delta * velocity;
+        this->integrate_rotation(time_delta);
+        // Also after the split impulses turned the box
+        this->fit_bounds();
     }
-
-    auto model_matrix = glm::translate(glm::mat4(1.f), m_center);
-    model_matrix = glm::scale(model_matrix, m_scale);
-    return model_matrix;
 }
 
 void
-Cuboid::render(const float time) {
-    glBindVertexArray(m_geometry.VAO);
+Cuboid::fit_bounds() {
+    m_store.halfwidth[m_body] = this->get_obb().fitted_halfwidths();
+}
 
-    glUniform1i(m_tex_loc, 0); // Choose proper texture unit
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_tex);
-    DrawGeometry(m_geometry);
+void
+Cuboid::describe_mesh(DrawItem& item) const {
+    PV112::SetDrawGeometry(item, m_geometry);
+    item.scale = m_scale;
+    item.tex = m_tex;
 }
 
 float
@@ -69,73 +53,48 @@ Cuboid::mass() const {
     return 8 * m_halfw.x * m_halfw.y * m_halfw.z;
 }
 
+glm::vec3
+Cuboid::inertia() const {
+    const glm::vec3 h2 = m_halfw * m_halfw;
+    return this->mass() / 3.f * glm::vec3(h2.y + h2.z, h2.x + h2.z, h2.x + h2.y);
+}
+
 bool
 Cuboid::check_collision(const Object& other) const {
     return other.check_collision_what(*this);
 }
 bool
 Cuboid::check_collision_what(const Ball& ball) const {
-    auto up = m_center + m_halfw;
-    auto low = m_center - m_halfw;
-    glm::vec3 clamp(0);
-    clamp.x = std::max(low.x, std::min(ball.get_center().x, up.x));
-    clamp.y = std::max(low.y, std::min(ball.get_center().y, up.y));
-    clamp.z = std::max(low.z, std::min(ball.get_center().z, up.z));
-
-    // this is the same as isPointInsideSphere
-    float dst = glm::length(clamp - ball.get_center());
-
-    // return m_aabb.check_collision(ball.get_aabb());
-    return dst < ball.get_radius();
+    Penetration penetration;
+    return this->penetration_what(ball, penetration);
 }
 bool
 Cuboid::check_collision_what(const Cuboid& other) const {
-    return m_aabb.check_collision(other.get_aabb());
+    Penetration penetration;
+    return this->penetration_what(other, penetration);
 }
 
-glm::vec3
-Cuboid::bounce_normal(const Object& other) const {
-    return -other.bounce_normal_what(*this);
-}
-glm::vec3
-Cuboid::bounce_normal_what(const Ball& ball) const {
-    std::vector<glm::vec3> normals = {
-        {1, 0, 0}, {-1, 0, 0},
-        {0, 1, 0}, {0, -1, 0},
-        {0, 0, 1}, {0, 0, -1}
-    };
-    auto ball_c = ball.get_center();
-    float best_dst = std::numeric_limits<float>::max();
-    glm::vec3 best_n(0);
-
-    for (const auto& n : normals) {
-        auto p = plane_line_inter(n, m_center + n * m_halfw, m_center, ball_c);
-        float dst = glm::length(m_center - p);
-        // std::cout << "dst: "<< dst <<" normal: " << n.x << " " << n.y << " " << n.z << std::endl<< std::endl;
-        if (glm::dot(m_center - p, ball_c - p) < 0 && dst < best_dst) {
-            best_dst = dst;
-            best_n = n;
-        }
+bool
+Cuboid::penetration(const Object& other, Penetration& out) const {
+    if (!other.penetration_what(*this, out)) {
+        return false;
     }
-    // std::cout << "Normal: " << best_n.x << " " << best_n.y << " " << best_n.z << std::endl<< std::endl;
-    return best_n;
+    out.normal = -out.normal;
+    return true;
 }
-glm::vec3
-Cuboid::bounce_normal_what(const Cuboid& other) const {
-    float best_dst = std::numeric_limits<float>::max();
-    glm::vec3 best_n(0);
-    for (const auto sign : {1, -1}) {
-        for (uint32_t i = 0; i < 3; ++i) {
-            float a1 = m_center[i] + sign * m_halfw[i];
-            float a2 = other.m_center[i] - sign * other.m_halfw[i];
-            if (std::abs(a1 - a2) < best_dst) {
-                best_dst = std::abs(a1 - a2);
-                glm::vec3 n(0);
-                n[i] = sign;
-                best_n = n;
-            }
-        }
+bool
+Cuboid::penetration_what(const Ball& ball, Penetration& out) const {
+    return collide(this->get_obb(), ball.get_center(), ball.get_radius(), out);
+}
+bool
+Cuboid::penetration_what(const Cuboid& other, Penetration& out) const {
+    if (this->is_aligned() && other.is_aligned()) {
+        return collide_aligned(this->get_obb(), other.get_obb(), out);
     }
-    // std::cout << "Normal: " << best_n.x << " " << best_n.y << " " << best_n.z << std::endl;
-    return best_n;
+    return collide(this->get_obb(), other.get_obb(), out);
+}
+bool
+Cuboid::cast(const glm::vec3& origin, const glm::vec3& direction,
+        const float radius, float& distance, glm::vec3& normal) const {
+    return ::cast(this->get_obb(), origin, direction, radius, distance, normal);
 }
@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include "game/flow_field.hpp"
+
+namespace {
+
+struct Neighbour {
+    int dx, dz;
+    float cost;
+};
+const std::array<Neighbour, 8> NEIGHBOURS = {{
+    {1, 0, 1.f}, {-1, 0, 1.f}, {0, 1, 1.f}, {0, -1, 1.f},
+    {1, 1, float(M_SQRT2)}, {1, -1, float(M_SQRT2)},
+    {-1, 1, float(M_SQRT2)}, {-1, -1, float(M_SQRT2)}
+}};
+
+}
+
+FlowField::FlowField(const Bounds& bounds, const float cell_size,
+        const float margin, const bool threaded)
+ : m_bounds(bounds), m_cell_size(cell_size), m_margin(margin),
+   m_dim_x(std::ceil((bounds[0][1] - bounds[0][0]) / cell_size)),
+   m_dim_z(std::ceil((bounds[2][1] - bounds[2][0]) / cell_size)),
+   m_threaded(threaded)
+{
+    if (m_threaded) {
+        m_worker = std::thread(&FlowField::run, this);
+    }
+}
+
+FlowField::~FlowField() {
+    if (!m_threaded) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    m_worker.join();
+}
+
+void
+FlowField::update(const glm::vec3& target,
+        const std::vector<std::shared_ptr<Object>>& obstacles) {
+    const int32_t cell = this->target_cell(target);
+    m_footprints.clear();
+    for (const auto& obstacle : obstacles) {
+        m_footprints.push_back(this->footprint(obstacle->get_aabb()));
+    }
+    if (cell == m_requested_cell && m_footprints == m_requested_footprints) {
+        return;
+    }
+    m_requested_cell = cell;
+    m_requested_footprints.swap(m_footprints);
+
+    std::unique_ptr<Job> job;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        job = std::move(m_spare);
+    }
+    if (!job) {
+        job.reset(new Job());
+    }
+    job->target = target;
+    job->footprints.assign(m_requested_footprints.begin(),
+        m_requested_footprints.end());
+    if (!m_threaded) {
+        if (!m_back) {
+            m_back = std::make_shared<Field>();
+        }
+        this->build(*job, *m_back);
+        this->publish();
+        m_spare = std::move(job);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        // An older job that has not started yet is simply superseded
+        if (m_pending) {
+            m_spare = std::move(m_pending);
+        }
+        m_pending = std::move(job);
+    }
+    m_cv.notify_one();
+}
+
+int32_t
+FlowField::target_cell(const glm::vec3& target) const {
+    const int dim_x = m_dim_x, dim_z = m_dim_z;
+    const int x = std::min(std::max(int((target.x - m_bounds[0][0]) / m_cell_size), 0), dim_x - 1);
+    const int z = std::min(std::max(int((target.z - m_bounds[2][0]) / m_cell_size), 0), dim_z - 1);
+    return z * dim_x + x;
+}
+
+FlowField::Footprint
+FlowField::footprint(const AABB& aabb) const {
+    const auto c = aabb.get_center();
+    const auto hw = aabb.get_halfwidths() + glm::vec3(m_margin);
+    auto to_cell = [&](const float v, const float lo, const int dim) {
+        return std::min(std::max(int(std::floor((v - lo) / m_cell_size)), 0), dim - 1);
+    };
+    return {{to_cell(c.x - hw.x, m_bounds[0][0], m_dim_x),
+        to_cell(c.x + hw.x, m_bounds[0][0], m_dim_x),
+        to_cell(c.z - hw.z, m_bounds[2][0], m_dim_z),
+        to_cell(c.z + hw.z, m_bounds[2][0], m_dim_z)}};
+}
+
+void
+FlowField::run() {
+    while (true) {
+        std::unique_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stop || m_pending; });
+            if (m_stop) {
+                return;
+            }
+            job = std::move(m_pending);
+        }
+
+        if (!m_back) {
+            m_back = std::make_shared<Field>();
+        }
+        this->build(*job, *m_back);
+        this->publish();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_spare = std::move(job);
+    }
+}
+
+void
+FlowField::publish() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto previous = std::const_pointer_cast<Field>(m_front);
+    m_front = std::move(m_back);
+    // Reuse the old front buffer only if no frame is still reading it
+    if (previous && previous.use_count() == 1) {
+        m_back = std::move(previous);
+    }
+}
+
+void
+FlowField::build(Job& job, Field& field) const {
+    field.min_x = m_bounds[0][0];
+    field.min_z = m_bounds[2][0];
+    field.cell_size = m_cell_size;
+    field.dim_x = m_dim_x;
+    field.dim_z = m_dim_z;
+    const int dim_x = field.dim_x;
+    const int dim_z = field.dim_z;
+    const size_t cells = size_t(dim_x) * dim_z;
+
+    field.blocked.assign(cells, 0);
+    field.cost.assign(cells, std::numeric_limits<float>::max());
+    field.dir_x.assign(cells, 0.f);
+    field.dir_z.assign(cells, 0.f);
+
+    // Rasterize the inflated obstacle footprints
+    for (const auto& f : job.footprints) {
+        for (int z = f[2]; z <= f[3]; ++z) {
+            for (int x = f[0]; x <= f[1]; ++x) {
+                field.blocked[z * dim_x + x] = 1;
+            }
+        }
+    }
+
+    field.target_cell = this->target_cell(job.target);
+
+    // Diagonal moves must not cut the corner of a blocked cell
+    auto can_move = [&](const int x, const int z, const Neighbour& n) {
+        const int nx = x + n.dx, nz = z + n.dz;
+        if (nx < 0 || nz < 0 || nx >= dim_x || nz >= dim_z) {
+            return false;
+        }
+        if (field.blocked[nz * dim_x + nx]) {
+            return false;
+        }
+        return n.dx == 0 || n.dz == 0 ||
+            (!field.blocked[z * dim_x + nx] && !field.blocked[nz * dim_x + x]);
+    };
+
+    // Dijkstra from the target over the free cells
+    using Entry = std::pair<float, int32_t>;
+    auto& open = job.open;
+    const auto later = std::greater<Entry>();
+    open.clear();
+    field.cost[field.target_cell] = 0.f;
+    open.push_back({0.f, field.target_cell});
+    while (!open.empty()) {
+        std::pop_heap(open.begin(), open.end(), later);
+        const auto top = open.back();
+        open.pop_back();
+        const int32_t cell = top.second;
+        if (top.first > field.cost[cell]) {
+            continue;
+        }
+        const int x = cell % dim_x, z = cell / dim_x;
+        for (const auto& n : NEIGHBOURS) {
+            if (!can_move(x, z, n)) {
+                continue;
+            }
+            const int32_t next = (z + n.dz) * dim_x + x + n.dx;
+            const float cost = top.first + n.cost;
+            if (cost < field.cost[next]) {
+                field.cost[next] = cost;
+                open.push_back({cost, next});
+                std::push_heap(open.begin(), open.end(), later);
+            }
+        }
+    }
+
+    // Point every cell to its cheapest neighbour. Blocked cells get a
+    // direction too, so an enemy pushed into the margin walks back out.
+    for (int z = 0; z < dim_z; ++z) {
+        for (int x = 0; x < dim_x; ++x) {
+            const int32_t cell = z * dim_x + x;
+            if (cell == field.target_cell) {
+                continue;
+            }
+            float best = field.blocked[cell] ?
+                std::numeric_limits<float>::max() : field.cost[cell];
+            const Neighbour* best_n = nullptr;
+            for (const auto& n : NEIGHBOURS) {
+                if (!can_move(x, z, n)) {
+                    continue;
+                }
+                const float cost = field.cost[(z + n.dz) * dim_x + x + n.dx];
+                if (cost < best) {
+                    best = cost;
+                    best_n = &n;
+                }
+            }
+            if (best_n) {
+                const float len = std::sqrt(float(best_n->dx * best_n->dx + best_n->dz * best_n->dz));
+                field.dir_x[cell] = best_n->dx / len;
+                field.dir_z[cell] = best_n->dz / len;
+            }
+        }
+    }
+}
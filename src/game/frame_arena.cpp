@@ -0,0 +1,50 @@
+#include <algorithm>
+#include "game/frame_arena.hpp"
+
+FrameArena::FrameArena(const size_t capacity) {
+    this->add_block(capacity);
+}
+
+void
+FrameArena::add_block(const size_t size) {
+    m_blocks.push_back({std::unique_ptr<char[]>(new char[size]), size});
+    ++m_block_allocations;
+}
+
+void*
+FrameArena::allocate(const size_t size, const size_t alignment) {
+    const size_t block_size = m_blocks.back().size;
+    const auto base = reinterpret_cast<uintptr_t>(m_blocks.back().data.get());
+    size_t start = (base + m_offset + alignment - 1) / alignment * alignment - base;
+    if (start + size > block_size) {
+        // The rest of the block is wasted until the next reset
+        m_used_before += m_offset;
+        this->add_block(std::max(2 * block_size, size + alignment));
+        m_offset = 0;
+        return this->allocate(size, alignment);
+    }
+    m_offset = start + size;
+    return m_blocks.back().data.get() + start;
+}
+
+void
+FrameArena::reset() {
+    m_high_water = std::max(m_high_water, this->get_used());
+    if (m_blocks.size() > 1) {
+        // One block for what the frame needed, the next one fits in it
+        const size_t capacity = this->get_capacity();
+        m_blocks.clear();
+        this->add_block(capacity);
+    }
+    m_offset = 0;
+    m_used_before = 0;
+}
+
+size_t
+FrameArena::get_capacity() const {
+    size_t capacity = 0;
+    for (const auto& block : m_blocks) {
+        capacity += block.size;
+    }
+    return capacity;
+}
@@ -3,18 +3,36 @@
 #include <memory>
 #include <time.h>
 #include <random>
+#include <stdexcept>
+#include <thread>
 
 #include "game/libs.hpp"
 #include "game/game.hpp"
 
+#include <glm/gtc/constants.hpp>
 #include <imgui/imgui.h>
 #include "game/imgui_impl_glfw_gl3.h"
 
 #include "game/PV112.h"
 #include "game/helpers.hpp"
+#include "game/job_system.hpp"
+#include "game/light_clusters.hpp"
+#include "game/mesh_bvh.hpp"
+#include "game/mesh_lod.hpp"
+#include "game/occlusion_culler.hpp"
 #include "game/cuboid.hpp"
 #include "game/ball.hpp"
 #include "game/enemy.hpp"
+#include "game/frame_arena.hpp"
+#include "game/profiler.hpp"
+#include "game/program_cache.hpp"
+#include "game/render_queue.hpp"
+#include "game/query_counter.hpp"
+#include "game/shader_variants.hpp"
+#include "game/simulation.hpp"
+#include "game/static_batch.hpp"
+#include "game/stream_buffer.hpp"
+#include "game/world.hpp"
 
 using namespace std;
 using namespace PV112;
@@ -26,36 +44,28 @@ int win_height = 1000;
 
 bool exit_game = false;
 bool fire = false;
-bool player_alive = true;
 
 using namespace irrklang;
 ISoundEngine *SoundEngine;
 
-// Shader program and its uniforms
-GLuint program;
-
-GLint model_matrix_loc;
-GLint PVM_matrix_loc;
-GLint normal_matrix_loc;
-GLint tex_scale_loc;
-
-GLint material_ambient_color_loc;
-GLint material_diffuse_color_loc;
-GLint material_specular_color_loc;
-GLint material_shininess_loc;
-
-GLint light1_position_loc;
-GLint light2_position_loc;
-GLint light_diffuse_color_loc;
-GLint light_ambient_color_loc;
-GLint light_specular_color_loc;
-
-GLint eye_position_loc;
+// Builds the shader programs and reloads them when their files change
+std::unique_ptr<ProgramCache> g_programs;
+// Lighting programs, one per material feature set
+std::unique_ptr<ShaderVariants> g_variants;
+// Depth-only program of the prepass
+GLuint depth_program;
+GLint depth_PVM_matrix_loc;
+// Point sprites of the particles, their vertices come from the stream buffer
+GLuint particle_program;
+GLint particle_PV_matrix_loc;
+GLint particle_lag_loc;
+GLint particle_pixel_scale_loc;
+GpuVertexArray g_particle_vao;
 
 // Simple geometries that we will use in this lecture
 PV112Geometry my_cube;
 
-//Space boundaries
+//Space boundaries, replaced by the generated scene in init()
 using Bound = std::array<float, 2>;
 std::array<Bound, 3> bounds = {
     Bound({-15, 15}), Bound({0, 7}), Bound({-15, 15})
@@ -64,9 +74,6 @@ std::array<bool, 4> arrows_pressed = {false, false, false, false};
 // Simple camera that allows us to look at the object from different views
 PV112Camera my_camera(bounds);
 
-auto light1_pos = glm::vec4(-5.5, 6.6, -11, 1.);
-auto light2_pos = glm::vec4(5.5, 6.6, 11, 1.);
-
 // OpenGL texture objects
 GLuint rocks_tex;
 GLuint metal_tex;
@@ -74,14 +81,68 @@ GLuint spike_tex;
 GLuint glass_tex;
 GLuint dice_tex[6];
 
-std::vector<std::shared_ptr<Object>> g_objects;
-std::vector<std::shared_ptr<Object>> g_enemies;
+// The world is stepped by the simulation, on its thread when it is threaded.
+// The rest of this file only ever looks at the snapshots it publishes.
+std::shared_ptr<World> g_world;
+std::unique_ptr<Simulation> g_simulation;
+Profiler g_profiler;
+Profiler g_sim_profiler;
+// Positions of the objects at the render time, refilled every frame
+std::vector<DrawItem> g_draw_items;
+// Objects that never move, drawn with a few calls
+std::unique_ptr<StaticBatch> g_static_batch;
+// Levels of detail of the balls
+std::unique_ptr<MeshLod> g_sphere_lod;
+// Dynamic objects in the drawing order
+RenderQueue g_render_queue;
+// Scratch memory of the renderer, rewound at the start of every frame
+FrameArena g_frame_arena;
+// Fragments that pass the depth test in the prepass and the lighting pass
+std::unique_ptr<QueryCounter> g_prepass_samples;
+std::unique_ptr<QueryCounter> g_shaded_samples;
+RenderStats g_render_stats;
+// GPU time of drawing a frame
+std::unique_ptr<QueryCounter> g_gpu_time;
+// Frames of a run with a frame limit
+std::vector<FrameRecord> g_frames;
+// Target of the offscreen rendering
+GLuint g_offscreen_fbo = 0;
+GpuRenderbuffer g_offscreen_color;
+GpuRenderbuffer g_offscreen_depth;
+// Textures of the world resources
+std::vector<GpuTexture> g_textures;
+// Hides the dynamic objects behind the static scene
+std::unique_ptr<OcclusionCuller> g_occlusion;
+// Data written anew every frame, the particles and the ImGui draw lists
+std::unique_ptr<StreamBuffer> g_stream;
+constexpr GLsizeiptr STREAM_FRAME_SIZE = 1 << 20;
+// Runs the tasks of a frame, the GL ones on this thread
+std::unique_ptr<JobSystem> g_jobs;
+std::unique_ptr<TaskGraph> g_frame_graph;
+// Snapshot the frame draws, set by the interpolate task
+const Snapshot* g_latest = nullptr;
+// Camera of the frame, set once the simulation moved it
+struct FrameView {
+    glm::mat4 projection;
+    glm::mat4 view;
+    // Both passes multiply by the same matrix so their depths match exactly
+    glm::mat4 projection_view;
+    glm::vec3 eye;
+    float fov;
+    float aspect;
+    // Pixels per unit of size at the distance of 1
+    float pixel_scale;
+};
+FrameView g_view;
+// Lights at the render time and the clusters they are binned into
+std::vector<PointLight> g_lights;
+std::unique_ptr<LightClusters> g_light_clusters;
+bool game_over = false;
 
 // Current time of the application in seconds, for animations
 float app_time_s = 0.0f;
 float prev_time_s = 0.0f;
 float close_time_s = std::numeric_limits<float>::max();
-float last_fired = 0.f;
 
 GameOptions game_opts;
 
@@ -140,33 +201,19 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     } else if (action == GLFW_RELEASE) {
         CheckArrowReleased(key);
     }
-    if (app_time_s > game_opts.game_time || !player_alive) {
+    if (game_over) {
         arrows_pressed.fill(false);
     }
 }
 
-auto random_range = [](float LO, float HI) {
-    return LO + (HI-LO) * ((rand() % 100) / 100.f);
-};
-
 void fire_ball() {
-    const auto position = my_camera.get_position();
-    const float radius = random_range(0.1, 0.3);
-    const float speed = random_range(5., 17.);
-    auto dir = glm::normalize(my_camera.get_direction());
-    dir *= (radius + 0.6);
-
-    g_objects.push_back(std::move(std::make_shared<Ball>(program,
-        position + dir, radius, Motion(dir, speed)
-    )));
-    g_objects.back()->set_expiration_time(app_time_s + game_opts.ball_time);
-    SoundEngine->play2D("audio/fire.mp3", GL_FALSE);
+    g_simulation->fire();
 }
 
 // Called when the user presses a mouse button
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
-    if (app_time_s > game_opts.game_time || !player_alive)  {
+    if (game_over)  {
         return;
     }
 
@@ -189,15 +236,25 @@ void mouse_moved(GLFWwindow* window, double x, double y)
     my_camera.OnMouseMoved(x, y, app_time_s - prev_time_s);
 }
 
-void bind_tex(const GLuint tex)
+// Uploads a decoded texture with mipmaps and keeps it in g_textures
+GLuint create_tex(const PV112::ImageData& image)
 {
+    if (image.Pixels.empty()) {
+        return 0;
+    }
+    GLuint tex = 0;
+    glGenTextures(1, &tex);
     glBindTexture(GL_TEXTURE_2D, tex);
+    PV112::SetTextureImage(image, GL_TEXTURE_2D);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glGenerateMipmap(GL_TEXTURE_2D);
     glBindTexture(GL_TEXTURE_2D, 0);
+    // RGBA8, the mipmaps add a third
+    g_textures.emplace_back(tex, size_t(image.Width) * image.Height * 4 * 4 / 3);
+    return tex;
 }
 
 void init_imgui(GLFWwindow* window)
@@ -209,235 +266,496 @@ void init_imgui(GLFWwindow* window)
     ImGui_ImplGlfwGL3_Init(window, false);
 }
 
+// Again after every reload of the particle program
+void find_particle_uniforms()
+{
+    particle_PV_matrix_loc = glGetUniformLocation(particle_program, "PV_matrix");
+    particle_lag_loc = glGetUniformLocation(particle_program, "lag");
+    particle_pixel_scale_loc = glGetUniformLocation(particle_program, "pixel_scale");
+}
+
 // Initializes OpenGL stuff
 void init()
 {
+    auto init_scope = g_profiler.scope("init");
     timer();
 
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     glClearDepth(1.0);
     glEnable(GL_DEPTH_TEST);
 
-    // Create shader program
-    program = CreateAndLinkProgram("vertex.glsl", "fragment.glsl");
-    if (0 == program)
-        WaitForEnterAndExit();
-
-    // Get attribute and uniform locations
-    int position_loc = glGetAttribLocation(program, "position");
-    int normal_loc = glGetAttribLocation(program, "normal");
-    int tex_coord_loc = glGetAttribLocation(program, "tex_coord");
-
-    model_matrix_loc = glGetUniformLocation(program, "model_matrix");
-    PVM_matrix_loc = glGetUniformLocation(program, "PVM_matrix");
-    normal_matrix_loc = glGetUniformLocation(program, "normal_matrix");
-    tex_scale_loc = glGetUniformLocation(program, "tex_scale");
-
-    material_ambient_color_loc = glGetUniformLocation(program, "material_ambient_color");
-    material_diffuse_color_loc = glGetUniformLocation(program, "material_diffuse_color");
-    material_specular_color_loc = glGetUniformLocation(program, "material_specular_color");
-    material_shininess_loc = glGetUniformLocation(program, "material_shininess");
-
-    light1_position_loc = glGetUniformLocation(program, "light1_position");
-    light2_position_loc = glGetUniformLocation(program, "light2_position");
-    light_ambient_color_loc = glGetUniformLocation(program, "light_ambient_color");
-    light_diffuse_color_loc = glGetUniformLocation(program, "light_diffuse_color");
-    light_specular_color_loc = glGetUniformLocation(program, "light_specular_color");
-
-    eye_position_loc = glGetUniformLocation(program, "eye_position");
-
-    std::vector<GLuint> dooms;
-    for (uint32_t i = 0; i < 7; ++i) {
-        std::string path("img/doom" + std::to_string(i) + ".png");
-        auto tex = PV112::CreateAndLoadTexture(path.c_str());
-        dooms.push_back(tex);
-        bind_tex(tex);
-    }
-
-    auto metal_tex = PV112::CreateAndLoadTexture("img/table_metal.jpg");
-    auto spike_tex = PV112::CreateAndLoadTexture("img/spikes.jpg");
-    auto stone_tex = PV112::CreateAndLoadTexture("img/rocks.jpg");
-    auto glass_tex = PV112::CreateAndLoadTexture("img/glass.jpg");
-    bind_tex(metal_tex);
-    bind_tex(spike_tex);
-    bind_tex(stone_tex);
-    bind_tex(glass_tex);
-
-
-    auto bulb_obj = PV112::LoadOBJ("obj/bulb.obj", position_loc, normal_loc, tex_coord_loc);
-    auto table_obj = PV112::LoadOBJ("obj/table.obj", position_loc, normal_loc, tex_coord_loc);
-    auto box_obj = PV112::LoadOBJ("obj/box.obj", position_loc, normal_loc, tex_coord_loc);
-    auto cube_obj = PV112::CreateCube(position_loc, normal_loc, tex_coord_loc);
-
-
-    // Walls
-    for (const auto dir : {0, 1}) {
-        for (uint32_t i = 0; i < 3; ++i) {
-            glm::vec3 center(0);
-            glm::vec3 widths(20);
-            const float thickness = 0.4;
-
-            center[i] = bounds[i][dir] + thickness * (dir ? 1 : -1);
-            widths[i] = thickness;
-            g_objects.push_back(std::move(std::make_shared<Cuboid>(program, cube_obj,
-                stone_tex, center, widths, Motion(false)
-            )));
-        }
+    // Create shader programs, the attribute locations are fixed so that
+    // the vertex arrays outlive a reload
+    const ProgramCache::Attributes attributes = {
+        {0, "position"}, {1, "normal"}, {2, "tex_coord"}
+    };
+    const GLint position_loc = attributes[0].first;
+    const GLint normal_loc = attributes[1].first;
+    const GLint tex_coord_loc = attributes[2].first;
+
+    WorldResources res;
+    res.sound = SoundEngine;
+    res.enemy_textures.resize(7);
+    std::vector<std::pair<std::string, GLuint*>> textures = {
+        {"img/table_metal.jpg", &res.metal_tex},
+        {"img/spikes.jpg", &res.spike_tex},
+        {"img/rocks.jpg", &res.stone_tex},
+        {"img/glass.jpg", &res.glass_tex},
+        {"img/metal.jpg", &res.ball_tex}
+    };
+    for (uint32_t i = 0; i < res.enemy_textures.size(); ++i) {
+        textures.emplace_back("img/doom" + std::to_string(i) + ".png",
+            &res.enemy_textures[i]);
     }
-
-
-    // Table in the middle
-    g_objects.push_back(std::move(std::make_shared<Cuboid>(program, table_obj,
-        metal_tex, glm::vec3(0, 0, 0), glm::vec3(4.5, 4, 4.5), Motion(false)
-    )));
-    // Balls on the table
-    {
-        std::vector<std::array<int, 2>> p = {
-            {1, 1}, {-1, 1}, {1, -1}, {-1, -1}
-        };
-        for (unsigned i = 0; i < 4; ++i) {
-            g_objects.push_back(std::move(std::make_shared<Ball>(program,
-                glm::vec3(1*p[i][0], 2. + i, 1*p[i][1]), 0.25,
-                Motion({0, 1, 0}, 3.)
-            )));
+    struct Mesh {
+        const char* path;
+        PV112Geometry* geometry;
+        // Of the meshes balls collide with
+        std::shared_ptr<const MeshBvh>* bvh;
+        std::shared_ptr<MeshData> data;
+        AABB aabb;
+        std::unique_ptr<MeshBvh::Builder> builder;
+    };
+    std::vector<Mesh> meshes(3);
+    meshes[0].path = "obj/bulb.obj";
+    meshes[0].geometry = &res.bulb;
+    meshes[0].bvh = &res.bulb_bvh;
+    meshes[1].path = "obj/table.obj";
+    meshes[1].geometry = &res.table;
+    meshes[1].bvh = &res.table_bvh;
+    meshes[2].path = "obj/box.obj";
+    meshes[2].geometry = &res.box;
+    meshes[2].bvh = nullptr;
+
+    // The files are read, parsed and decoded on the workers while this
+    // thread builds the shaders, every upload runs once its asset is ready
+    using Affinity = TaskGraph::Affinity;
+    TaskGraph startup;
+    bool shaders_valid = false;
+    startup.add("shaders", [&attributes, &shaders_valid]() {
+        g_programs.reset(new ProgramCache("shader_cache"));
+        g_light_clusters.reset(new LightClusters());
+        g_variants.reset(new ShaderVariants(*g_programs, *g_light_clusters,
+            "vertex.glsl", "fragment.glsl", attributes));
+        if (!g_variants->is_valid())
+            return;
+        // Shares the vertex arrays, so the position goes to the same location
+        depth_program = g_programs->load("depth_vertex.glsl", "depth_fragment.glsl",
+            {attributes[0]}, "", [](const GLuint p) {
+                depth_program = p;
+                depth_PVM_matrix_loc = glGetUniformLocation(depth_program, "PVM_matrix");
+                g_occlusion->set_pvm_loc(depth_PVM_matrix_loc);
+            });
+        particle_program = g_programs->load("particle_vertex.glsl",
+            "particle_fragment.glsl", {{0, "position"}, {1, "velocity"}, {2, "color"}},
+            "", [](const GLuint p) {
+                particle_program = p;
+                find_particle_uniforms();
+            });
+        shaders_valid = 0 != depth_program && 0 != particle_program;
+    }, {}, Affinity::MAIN);
+    std::vector<PV112::ImageData> images(textures.size());
+    for (size_t i = 0; i < textures.size(); ++i) {
+        const auto& path = textures[i].first;
+        const auto read = startup.add(("read " + path).c_str(), [&textures, &images, i]() {
+            PV112::ReadImage(textures[i].first.c_str(), images[i]);
+        });
+        startup.add(("upload " + path).c_str(), [&textures, &images, i]() {
+            *textures[i].second = create_tex(images[i]);
+            images[i] = PV112::ImageData();
+        }, {read}, Affinity::MAIN);
+    }
+    for (auto& mesh : meshes) {
+        const auto read = startup.add((std::string("read ") + mesh.path).c_str(), [&mesh]() {
+            mesh.data = PV112::ReadOBJ(mesh.path, mesh.aabb);
+        });
+        std::vector<TaskGraph::TaskId> upload_after = {read};
+        if (mesh.bvh != nullptr) {
+            // Loaded from the cache next to the mesh, or built by subtrees
+            // on all the workers. The builder copies the positions, the
+            // upload may take the mesh data once it started.
+            const std::string path = mesh.path;
+            const auto start = startup.add(("bvh start " + path).c_str(), [&mesh]() {
+                const std::vector<glm::vec3> none;
+                mesh.builder.reset(new MeshBvh::Builder(
+                    mesh.data ? mesh.data->Positions : none,
+                    std::string(mesh.path) + ".bvh"));
+                mesh.builder->start();
+            }, {read});
+            const auto build = startup.add_parallel(("bvh build " + path).c_str(),
+                MeshBvh::Builder::SUBTREES, [&mesh](size_t subtree) {
+                    mesh.builder->build(subtree);
+                }, {start});
+            startup.add(("bvh finish " + path).c_str(), [&mesh]() {
+                *mesh.bvh = mesh.builder->finish();
+                mesh.builder.reset();
+            }, {build});
+            upload_after.push_back(start);
         }
+        startup.add((std::string("upload ") + mesh.path).c_str(),
+            [&mesh, position_loc, normal_loc, tex_coord_loc]() {
+                *mesh.geometry = PV112::CreateOBJGeometry(std::move(mesh.data),
+                    mesh.aabb, position_loc, normal_loc, tex_coord_loc);
+            },
+            upload_after, Affinity::MAIN);
     }
-    // Boxes
-    auto create_boxes = [&](const unsigned D) {
-        auto one = []() {
-            return rand() % 2 == 0 ? 1 : -1;
-        };
-        const int width = bounds[D][1] - bounds[D][0];
-        const float spread = 3.;
-        const int count = width / spread;
-
-        glm::vec3 dir(0, 1, 0);
-        for (unsigned i = 0; i < count; ++i) {
-            glm::vec3 position(0, i/2. + 2, 0);
-            position[D] = bounds[0][0] + i*spread;
-            dir[D] = one();
-
-            g_objects.push_back(std::move(std::make_shared<Cuboid>(program, box_obj,
-                spike_tex, position, glm::vec3(0.5, 0.75, 0.4), Motion(dir, 3.)
-            )));
+    startup.add("spheres", [&res, position_loc, normal_loc, tex_coord_loc]() {
+        res.cube = PV112::CreateCube(position_loc, normal_loc, tex_coord_loc);
+        // Slices, stacks and the projected radius in pixels each level starts at
+        std::vector<MeshLod::Level> sphere_levels;
+        for (const auto& level : {glm::vec3(24, 12, 40), glm::vec3(16, 8, 16),
+                glm::vec3(10, 6, 6), glm::vec3(6, 4, 0)}) {
+            sphere_levels.push_back({PV112::CreateUVSphere(level.x, level.y,
+                position_loc, normal_loc, tex_coord_loc), level.z});
         }
-    };
-    create_boxes(0);
-    create_boxes(2);
-    MaterialProperties props = {
-        .ambient_color = glm::vec3(0.315f),
-        .diffuse_color = glm::vec3(0.),
-        .specular_color = glm::vec3(0.),
-        .shininess = 0
-    };
-
-    // Make some light bulbs
-    g_objects.push_back(std::move(std::make_shared<Cuboid>(program, bulb_obj,
-        glass_tex, glm::vec3(light1_pos) + glm::vec3(0, 0.2, 0),
-        glm::vec3(0.5, 0.5, 0.5), Motion(false)
-    )));
-    g_objects.back()->set_material_properties(props);
+        g_sphere_lod.reset(new MeshLod(std::move(sphere_levels)));
+        res.sphere = g_sphere_lod->get_finest();
+    }, {}, Affinity::MAIN);
+    g_jobs->run(startup);
+    if (game_opts.verbose) {
+        std::cout << "Startup" << std::endl;
+        startup.dump_timeline(std::cout);
+    }
 
-    g_objects.push_back(std::move(std::make_shared<Cuboid>(program, bulb_obj,
-        glass_tex, glm::vec3(light2_pos) + glm::vec3(0, 0.2, 0),
-        glm::vec3(0.5, 0.5, 0.5), Motion(false)
-    )));
-    g_objects.back()->set_material_properties(props);
+    if (!shaders_valid)
+        WaitForEnterAndExit();
+    if (game_opts.verbose) {
+        std::cout << "Shader programs " << g_programs->get_hits() << " cached, "
+                  << g_programs->get_misses() << " compiled" << std::endl;
+    }
+    if (game_opts.hot_reload_shaders) {
+        g_programs->watch(".");
+    }
 
-    // Create enemies
+    depth_PVM_matrix_loc = glGetUniformLocation(depth_program, "PVM_matrix");
+    find_particle_uniforms();
+    // The attribute pointers are set per frame, the stream buffer moves
+    g_particle_vao = GpuVertexArray::create();
+    glBindVertexArray(g_particle_vao.get());
+    for (GLuint location = 0; location < 3; ++location) {
+        glEnableVertexAttribArray(location);
+    }
+    glBindVertexArray(0);
+    glEnable(GL_PROGRAM_POINT_SIZE);
+    g_prepass_samples.reset(new QueryCounter(GL_SAMPLES_PASSED));
+    g_shaded_samples.reset(new QueryCounter(GL_SAMPLES_PASSED));
+    g_occlusion.reset(new OcclusionCuller(position_loc, depth_PVM_matrix_loc));
+
+    g_world.reset(new World(game_opts, res, g_sim_profiler));
+    g_simulation.reset(new Simulation(*g_world, g_sim_profiler,
+        game_opts.tick_rate, game_opts.on_frame));
     {
-        std::vector<std::array<int, 2>> p = {
-            {1, 1}, {-1, 1}, {1, -1}, {-1, -1}
-        };
-        for (unsigned i = 0; i < 5; ++i) {
-            for (unsigned j = 0; j < 4; ++j) {
-                float s = 2.5 * (i + 1);
-                g_enemies.push_back(std::move(std::make_shared<Enemy>(dooms,
-                    SoundEngine, program, 0,
-                    glm::vec3(s*p[j][0], i + 2, s*p[j][1]), 1. / (i + 1),
-                    Motion(false)
-                )));
-            }
-        }
+        std::vector<DrawItem> items;
+        g_world->describe(items);
+        g_static_batch.reset(new StaticBatch(items, position_loc, normal_loc,
+            tex_coord_loc));
     }
-    g_objects.insert(g_objects.end(), g_enemies.begin(), g_enemies.end());
-
+    const auto& scene = g_world->get_scene();
+    bounds = scene.bounds;
+    my_camera.set_bounds(bounds);
 
     // Play some music please
-    SoundEngine->play2D("audio/kill_them_all.mp3", GL_TRUE);
+    if (SoundEngine) {
+        SoundEngine->play2D("audio/kill_them_all.mp3", GL_TRUE);
+    }
 }
 
-void clear_objects() {
-    auto clear = [](auto& objects) {
-        objects.erase(std::remove_if(objects.begin(), objects.end(),
-                [](const auto& obj) {
-                    return obj->is_expired(app_time_s);
-                }),
-            objects.end());
-    };
-    clear(g_objects);
-    clear(g_enemies);
+// The world only exists while the game is running. It belongs to the
+// simulation, so these are only safe to call from the on_frame callback.
+void require_running()
+{
+    if (!g_world) {
+        throw std::runtime_error("no game is running");
+    }
 }
 
-// Called when the window needs to be rendered
-void render()
+std::shared_ptr<World> game_world()
 {
-    my_camera.ProcessArrowKeys(arrows_pressed, app_time_s - prev_time_s);
+    require_running();
+    return g_world;
+}
 
-    clear_objects();
-    for (size_t i = 0; i < g_objects.size(); ++i) {
-        const auto& obj_A = g_objects.at(i);
-        for (size_t j = i + 1; j < g_objects.size(); ++j) {
-            const auto& obj_B = g_objects.at(j);
-            if (!obj_A->is_active() && !obj_B->is_active()) {
-                continue;
-            }
-            if (obj_A->check_collision(*obj_B)) {
-                obj_A->bounce(*obj_B, app_time_s);
-            }
-        }
-    }
+std::vector<uint32_t> spawn_balls(const float* positions,
+    const float* velocities, const float* radii, const size_t count)
+{
+    require_running();
+    return g_world->spawn_balls(positions, velocities, radii, count);
+}
 
+std::vector<uint32_t> spawn_boxes(const float* positions,
+    const float* velocities, const size_t count)
+{
+    require_running();
+    return g_world->spawn_boxes(positions, velocities, count);
+}
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+std::vector<uint32_t> spawn_enemies(const float* positions,
+    const float* scales, const size_t count)
+{
+    require_running();
+    return g_world->spawn_enemies(positions, scales, count);
+}
 
-    glm::mat4 projection_matrix, view_matrix, model_matrix, PVM_matrix;
-    glm::mat3 normal_matrix;
+size_t despawn(const uint32_t* ids, const size_t count)
+{
+    require_running();
+    return g_world->despawn(ids, count);
+}
 
-    projection_matrix = glm::perspective(glm::radians(45.0f),
-            float(win_width) / float(win_height), 0.1f, 100.0f);
-    view_matrix = my_camera.get_view_matrix();
+void set_material(const ShaderVariants::Uniforms& u, const MaterialProperties& p)
+{
+    glUniform3fv(u.material_ambient_color, 1, glm::value_ptr(p.ambient_color));
+    glUniform3fv(u.material_diffuse_color, 1, glm::value_ptr(p.diffuse_color));
+    glUniform3fv(u.material_specular_color, 1, glm::value_ptr(p.specular_color));
+    glUniform1f(u.material_shininess, p.shininess);
+}
 
+// Lighting program state of the frame being drawn
+struct LightingPass {
+    glm::mat4 view_matrix;
+    glm::vec3 eye;
+    // Variants that got the uniforms of this frame
+    std::array<bool, ShaderVariants::COUNT> prepared;
+    int current = -1;
+    uint32_t switches = 0;
+};
 
-    glUseProgram(program);
+// Switches to the variant for 'features' unless it is in use already, the
+// first use in a frame sets the uniforms common to all draws
+const ShaderVariants::Uniforms& use_variant(LightingPass& pass,
+    const uint8_t features)
+{
+    const auto& variant = g_variants->get(features);
+    if (pass.current == features) {
+        return variant.uniforms;
+    }
+    pass.current = features;
+    ++pass.switches;
+    glUseProgram(variant.program);
+    if (!pass.prepared[features]) {
+        pass.prepared[features] = true;
+        const auto& u = variant.uniforms;
+        glUniform3fv(u.eye_position, 1, glm::value_ptr(pass.eye));
+        g_light_clusters->set_uniforms(u.clusters, pass.view_matrix,
+            win_width, win_height);
+        glUniform3f(u.light_ambient_color, 1.0f, 1.0f, 1.0f);
+        glUniform3f(u.light_diffuse_color, 1.0f, 1.0f, 1.0f);
+        glUniform3f(u.light_specular_color, 1.0f, 1.0f, 1.0f);
+    }
+    return variant.uniforms;
+}
 
-    glUniform3fv(eye_position_loc, 1, glm::value_ptr(my_camera.get_position()));
+void draw_geometry(const DrawItem& item)
+{
+    ++g_render_stats.draw_calls;
+    glBindVertexArray(item.vao);
+    if (item.elements_count > 0) {
+        glDrawElements(item.mode, item.elements_count, GL_UNSIGNED_INT, nullptr);
+    } else {
+        glDrawArrays(item.mode, 0, item.arrays_count);
+    }
+}
 
-    glUniform4fv(light1_position_loc, 1, glm::value_ptr(light1_pos));
-    glUniform4fv(light2_position_loc, 1, glm::value_ptr(light2_pos));
-    glUniform3f(light_ambient_color_loc, 1.0f, 1.0f, 1.0f);
-    glUniform3f(light_diffuse_color_loc, 1.0f, 1.0f, 1.0f);
-    glUniform3f(light_specular_color_loc, 1.0f, 1.0f, 1.0f);
+// Takes the camera after the simulation task moved it
+void update_view()
+{
+    g_view.fov = glm::radians(45.0f);
+    g_view.aspect = float(win_width) / float(win_height);
+    g_view.projection = glm::perspective(g_view.fov, g_view.aspect, 0.1f, 100.0f);
+    g_view.view = my_camera.get_view_matrix();
+    g_view.projection_view = g_view.projection * g_view.view;
+    g_view.eye = my_camera.get_position();
+    g_view.pixel_scale = win_height / (2 * std::tan(g_view.fov / 2));
+}
 
-    for (const auto& obj : g_objects) {
-        const auto& p = obj->get_material_properties();
-        glUniform3fv(material_ambient_color_loc, 1, glm::value_ptr(p.ambient_color));
-        glUniform3fv(material_diffuse_color_loc, 1, glm::value_ptr(p.diffuse_color));
-        glUniform3fv(material_specular_color_loc, 1, glm::value_ptr(p.specular_color));
-        glUniform1f(material_shininess_loc, p.shininess);
+// Orders the batch and the dynamic objects and picks the levels of detail,
+// no GL calls so it can run on any thread
+void sort_items()
+{
+    const glm::vec3& eye = g_view.eye;
+    g_static_batch->update(g_draw_items, g_frame_arena);
+    g_static_batch->sort(eye, g_frame_arena);
+    g_sphere_lod->begin_frame();
+    g_render_queue.begin(0.1f, 100.0f);
+    for (uint32_t i = 0; i < g_draw_items.size(); ++i) {
+        auto& item = g_draw_items[i];
+        if (StaticBatch::accepts(item)) {
+            continue;
+        }
+        const float distance = std::max(0.1f, glm::length(item.position - eye));
+        if (g_sphere_lod->applies(item)) {
+            g_sphere_lod->select(item, item.scale.x * g_view.pixel_scale / distance);
+        }
+        g_render_queue.push(i, distance,
+            ShaderVariants::features_of(item.material, item.tex),
+            item.tex, item.vao);
+    }
+    g_sphere_lod->end_frame();
+    g_render_queue.sort();
+}
 
-        glUniform1f(tex_scale_loc, obj->get_max_scale());
-        model_matrix = obj->update_geometry(app_time_s - prev_time_s);
+// Sparks and debris, where the newest snapshot has them moved back along
+// their velocities to the render time. A hundred thousand of them are a
+// single draw of points straight from the stream buffer.
+void draw_particles()
+{
+    const auto& particles = g_latest->particles;
+    if (particles.empty()) {
+        return;
+    }
+    const GLintptr offset = g_stream->write(particles.data(),
+        particles.size() * sizeof(ParticleVertex), sizeof(float));
+    if (offset < 0) {
+        // The buffer grows to fit them from the next frame on
+        return;
+    }
+    glUseProgram(particle_program);
+    glUniformMatrix4fv(particle_PV_matrix_loc, 1, GL_FALSE,
+        glm::value_ptr(g_view.projection_view));
+    glUniform1f(particle_lag_loc, g_simulation->get_render_lag());
+    glUniform1f(particle_pixel_scale_loc, g_view.pixel_scale);
+
+    glBindVertexArray(g_particle_vao.get());
+    glBindBuffer(GL_ARRAY_BUFFER, g_stream->get_buffer());
+    const GLsizei stride = sizeof(ParticleVertex);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride, (const void *)offset);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride,
+        (const void *)(offset + sizeof(float) * 4));
+    glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, stride,
+        (const void *)(offset + sizeof(float) * 7));
+    glDrawArrays(GL_POINTS, 0, particles.size());
+    g_render_stats.draw_calls += 1;
+}
 
-        PVM_matrix = projection_matrix * view_matrix * model_matrix;
-        normal_matrix = glm::inverse(glm::transpose(glm::mat3(model_matrix)));
-        glUniformMatrix4fv(model_matrix_loc, 1, GL_FALSE, glm::value_ptr(model_matrix));
-        glUniformMatrix4fv(PVM_matrix_loc, 1, GL_FALSE, glm::value_ptr(PVM_matrix));
-        glUniformMatrix3fv(normal_matrix_loc, 1, GL_FALSE, glm::value_ptr(normal_matrix));
+// Called when the window needs to be rendered, once the lights are binned
+// and the objects sorted
+void render()
+{
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    g_render_stats.draw_calls = 0;
 
-        obj->render(app_time_s);
+    glm::mat4 model_matrix, PVM_matrix;
+    glm::mat3 normal_matrix;
+
+    const glm::mat4& view_matrix = g_view.view;
+    const glm::mat4& projection_view = g_view.projection_view;
+    const glm::vec3& eye = g_view.eye;
+    g_light_clusters->upload();
+    g_static_batch->upload();
+
+    // In the lighting pass the objects go before the batch, the walls in it
+    // hide the least
+    g_render_stats.prepass_samples = 0;
+    const bool culling = game_opts.depth_prepass && game_opts.occlusion_culling;
+    if (game_opts.depth_prepass) {
+        auto scope = g_profiler.scope("depth_prepass");
+        glUseProgram(depth_program);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+        g_prepass_samples->begin();
+        // The static scene first, it is what occludes the objects
+        glUniformMatrix4fv(depth_PVM_matrix_loc, 1, GL_FALSE, glm::value_ptr(projection_view));
+        g_static_batch->draw([](const StaticBatch::Group&) {});
+        g_render_stats.draw_calls += g_static_batch->get_draw_calls();
+        if (culling) {
+            g_occlusion->begin_frame();
+        }
+        for (const auto& entry : g_render_queue.get_entries()) {
+            const auto& item = g_draw_items[entry.item];
+            // Two references fit into std::function without a heap allocation
+            auto draw = [&item, &projection_view]() {
+                const glm::mat4 pvm = projection_view * item.model_matrix();
+                glUniformMatrix4fv(depth_PVM_matrix_loc, 1, GL_FALSE, glm::value_ptr(pvm));
+                draw_geometry(item);
+            };
+            if (culling) {
+                g_occlusion->draw_depth(item, projection_view, eye, draw);
+            } else {
+                draw();
+            }
+        }
+        if (culling) {
+            g_occlusion->end_frame();
+            g_render_stats.draw_calls += g_occlusion->get_boxes();
+        }
+        g_prepass_samples->end();
+        g_render_stats.prepass_samples = g_prepass_samples->get_result();
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        // Only the nearest surface passes from now on
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
     }
 
+    // After the prepass the depth decides what is shaded, the order can
+    // save state changes instead
+    const auto& entries = game_opts.depth_prepass
+        ? g_render_queue.get_by_state() : g_render_queue.get_entries();
+    g_render_stats.state_changes = RenderQueue::count_state_changes(entries);
+
+    LightingPass pass;
+    pass.view_matrix = view_matrix;
+    pass.eye = eye;
+    pass.prepared.fill(false);
+    g_light_clusters->bind_textures();
+
+    glActiveTexture(GL_TEXTURE0);
+    g_shaded_samples->begin();
+    g_render_stats.triangles = 0;
+    {
+        auto scope = g_profiler.scope("draw_objects");
+        for (const auto& entry : entries) {
+            const auto& item = g_draw_items[entry.item];
+            const auto& u = use_variant(pass,
+                ShaderVariants::features_of(item.material, item.tex));
+            g_render_stats.triangles += item.triangles();
+            set_material(u, item.material);
+
+            glUniform1f(u.tex_scale, item.tex_scale);
+            model_matrix = item.model_matrix();
+
+            PVM_matrix = projection_view * model_matrix;
+            normal_matrix = glm::inverse(glm::transpose(glm::mat3(model_matrix)));
+            glUniformMatrix4fv(u.model_matrix, 1, GL_FALSE, glm::value_ptr(model_matrix));
+            glUniformMatrix4fv(u.PVM_matrix, 1, GL_FALSE, glm::value_ptr(PVM_matrix));
+            glUniformMatrix3fv(u.normal_matrix, 1, GL_FALSE, glm::value_ptr(normal_matrix));
+
+            glBindTexture(GL_TEXTURE_2D, item.tex);
+            if (culling) {
+                g_occlusion->draw_color(item, [&item]() { draw_geometry(item); });
+            } else {
+                draw_geometry(item);
+            }
+        }
+    }
+    {
+        // The batch is already in the world space
+        auto scope = g_profiler.scope("draw_static");
+        g_static_batch->draw([&pass, &projection_view](const StaticBatch::Group& group) {
+            const auto& u = use_variant(pass,
+                ShaderVariants::features_of(group.material, group.tex));
+            glUniformMatrix4fv(u.model_matrix, 1, GL_FALSE, glm::value_ptr(glm::mat4(1.f)));
+            glUniformMatrix4fv(u.PVM_matrix, 1, GL_FALSE, glm::value_ptr(projection_view));
+            glUniformMatrix3fv(u.normal_matrix, 1, GL_FALSE, glm::value_ptr(glm::mat3(1.f)));
+            glUniform1f(u.tex_scale, 1.f);
+            set_material(u, group.material);
+            glBindTexture(GL_TEXTURE_2D, group.tex);
+        });
+        g_render_stats.triangles += g_static_batch->get_triangles();
+        g_render_stats.draw_calls += g_static_batch->get_draw_calls();
+    }
+    g_shaded_samples->end();
+    {
+        // Unlit, not counted as shaded samples
+        auto scope = g_profiler.scope("draw_particles");
+        draw_particles();
+    }
+    g_render_stats.shaded_samples = g_shaded_samples->get_result();
+    g_render_stats.pixels = uint64_t(win_width) * win_height;
+    g_render_stats.program_switches = pass.switches;
+    g_render_stats.visible_objects = culling ? g_occlusion->get_visible() : 0;
+    g_render_stats.occluded_objects = culling ? g_occlusion->get_occluded() : 0;
+
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
     glBindVertexArray(0);
     glUseProgram(0);
 }
@@ -459,47 +777,242 @@ void GLAPIENTRY simple_debug_callback(GLenum source, GLenum type, GLuint id,
 }
 
 void get_resolution() {
+    if (game_opts.width > 0 && game_opts.height > 0) {
+        win_width = game_opts.width;
+        win_height = game_opts.height;
+        return;
+    }
+    if (game_opts.offscreen) {
+        win_width = 1280;
+        win_height = 720;
+        return;
+    }
     const GLFWvidmode * mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
 
     win_width = mode->width;
     win_height = mode->height;
 }
 
-int alive_enemies() {
-    return std::count_if(g_enemies.begin(), g_enemies.end(), [](const auto& enemy) {
-        return std::static_pointer_cast<Enemy>(enemy)->is_alive();
-    });
+// Color and depth renderbuffers of the window size, left bound for the
+// whole run so the scene and the overlay both go there
+bool create_offscreen()
+{
+    // Four bytes a pixel each, depth 24 is padded
+    const size_t bytes = size_t(win_width) * win_height * 4;
+    g_offscreen_color = GpuRenderbuffer::create();
+    g_offscreen_color.set_bytes(bytes);
+    glBindRenderbuffer(GL_RENDERBUFFER, g_offscreen_color.get());
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, win_width, win_height);
+    g_offscreen_depth = GpuRenderbuffer::create();
+    g_offscreen_depth.set_bytes(bytes);
+    glBindRenderbuffer(GL_RENDERBUFFER, g_offscreen_depth.get());
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, win_width, win_height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &g_offscreen_fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, g_offscreen_fbo);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+        GL_RENDERBUFFER, g_offscreen_color.get());
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+        GL_RENDERBUFFER, g_offscreen_depth.get());
+    glViewport(0, 0, win_width, win_height);
+    return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
 }
 
+void destroy_offscreen()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &g_offscreen_fbo);
+    g_offscreen_fbo = 0;
+    g_offscreen_color.reset();
+    g_offscreen_depth.reset();
+}
+
+// Offscreen the camera circles the arena looking at its center, one lap
+// every LAP_FRAMES frames, so every run draws the same views
+void fly_camera(const uint64_t frame)
+{
+    constexpr uint32_t LAP_FRAMES = 600;
+    const float angle = 2 * glm::pi<float>() * (frame % LAP_FRAMES) / LAP_FRAMES;
+    const glm::vec3 center((bounds[0][0] + bounds[0][1]) / 2,
+        (bounds[1][0] + bounds[1][1]) / 2, (bounds[2][0] + bounds[2][1]) / 2);
+    const float radius = 0.4f * std::min(bounds[0][1] - bounds[0][0],
+        bounds[2][1] - bounds[2][0]);
+    my_camera.SetView(center + radius * glm::vec3(std::sin(angle), 0, std::cos(angle)),
+        angle, -0.2f);
+}
+
+// The camera moves every frame, the simulation picks up its latest position
+// on the next tick
 void step_game() {
-    if (fire && last_fired + 0.1 < app_time_s) {
-        fire_ball();
-        last_fired = app_time_s;
-    }
-    if (player_alive) {
-        for (const auto& enemy : g_enemies) {
-            const auto pos = my_camera.get_position();
-            if (std::static_pointer_cast<Enemy>(enemy)->kills_player(pos)) {
-                player_alive = false;
-                SoundEngine->play2D("audio/death_player.mp3", GL_FALSE);
-            }
-        }
+    if (game_opts.offscreen) {
+        fly_camera(g_frames.size());
+    } else {
+        my_camera.ProcessArrowKeys(arrows_pressed, app_time_s - prev_time_s);
+    }
+    g_simulation->set_input(my_camera.get_position(),
+        my_camera.get_direction(), fire);
+    if (!game_opts.threaded_simulation) {
+        g_simulation->advance();
     }
-    if (app_time_s > 30.f) {
-        float time_delta = app_time_s - prev_time_s;
-        for (const auto& enemy : g_enemies) {
-            std::static_pointer_cast<Enemy>(enemy)->follow_player(time_delta,
-                my_camera.get_position());
+}
+
+const std::vector<PhaseTiming>& last_timings()
+{
+    return g_profiler.get_phases();
+}
+
+const RenderStats& last_render_stats()
+{
+    return g_render_stats;
+}
+
+const std::vector<FrameRecord>& last_frames()
+{
+    return g_frames;
+}
+
+// Status lines of the overlay
+void draw_overlay()
+{
+    int remaining_enemies = g_latest->alive_enemies;
+    if (!game_over) {
+        ImGui::Text(" ---- PLAY! ----");
+        ImGui::Text("REMAINING ENEMIES: %d", remaining_enemies);
+        ImGui::Text("REMAINING TIME: %ds", int(game_opts.game_time - g_latest->world_time));
+    } else {
+        fire = false;
+        if (remaining_enemies == 0) {
+            ImGui::Text(" ---- YOU WON! ---- ");
+        } else {
+            ImGui::Text(" ---- YOU LOST! ---- ");
+        }
+        if (close_time_s == std::numeric_limits<float>::max()) {
+            close_time_s = app_time_s + 10.;
         }
     }
+    ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    ImGui::Text("SCENE: seed %u, %d objects", g_world->get_scene().seed,
+        int(game_opts.scene.object_count()));
+    ImGui::Text("OBJECTS: %d", int(g_latest->items.size()));
+    ImGui::Text("STATIC SCENE: %d objects in %d %s draws",
+        int(g_static_batch->get_command_count()), int(g_static_batch->get_draw_calls()),
+        g_static_batch->is_indirect() ? "indirect" : "base vertex");
+    ImGui::Text("TRIANGLES: %llu", (unsigned long long)g_render_stats.triangles);
+    ImGui::Text("OVERDRAW: %.2f shaded samples per pixel",
+        double(g_render_stats.shaded_samples)
+            / std::max<uint64_t>(g_render_stats.pixels, 1));
+    ImGui::Text("GPU: %.3f ms, %u draw calls",
+        g_gpu_time->get_result() / 1e6, g_render_stats.draw_calls);
+    ImGui::Text("STATE CHANGES: %u, %u program switches",
+        g_render_stats.state_changes, g_render_stats.program_switches);
+    if (game_opts.depth_prepass && game_opts.occlusion_culling) {
+        ImGui::Text("OCCLUSION: %u visible, %u occluded",
+            g_render_stats.visible_objects, g_render_stats.occluded_objects);
+    }
+    ImGui::Text("GPU MEMORY: %.1f MB, %.1f MB buffers, %.1f MB textures",
+        GpuLedger::total_bytes() / 1048576.,
+        GpuLedger::get(GpuKind::BUFFER).bytes / 1048576.,
+        GpuLedger::get(GpuKind::TEXTURE).bytes / 1048576.);
+    const auto& integrator = g_latest->integrator_stats;
+    ImGui::Text("SUBSTEPS: %u for %u fast bodies, %llu steps capped",
+        integrator.substeps, integrator.fast_bodies,
+        (unsigned long long)integrator.capped_steps);
+    const auto& particles = g_latest->particle_stats;
+    ImGui::Text("PARTICLES: %u / %u, capacity %u, %llu dropped",
+        particles.count, particles.budget, particles.capacity,
+        (unsigned long long)particles.dropped);
+    ImGui::Text("LIGHTS: %d, at most %u per cluster",
+        int(g_light_clusters->get_light_count()),
+        g_light_clusters->get_max_per_cluster());
+    for (size_t i = 0; i < g_sphere_lod->get_level_count(); ++i) {
+        ImGui::Text("BALL LOD %d: %4u balls %7llu triangles", int(i),
+            g_sphere_lod->get_objects()[i],
+            (unsigned long long)g_sphere_lod->get_triangles()[i]);
+    }
+    ImGui::Text("FRAME ARENA: %.1f KB, %.1f KB at most",
+        g_frame_arena.get_used() / 1024., g_frame_arena.get_high_water() / 1024.);
+    for (const auto& phase : g_profiler.get_phases()) {
+        ImGui::Text("%-12s %7.3f ms %4llu allocs", phase.name.c_str(), phase.avg_ms,
+            (unsigned long long)phase.last_allocations);
+    }
+    for (const auto& phase : g_latest->phases) {
+        ImGui::Text("%-12s %7.3f ms %4llu allocs", phase.name.c_str(), phase.avg_ms,
+            (unsigned long long)phase.last_allocations);
+    }
+}
+
+// Tasks of a frame. The simulation, the light binning and the sorting run on
+// the workers, the GL calls and the window on this thread once they are done.
+void build_frame_graph()
+{
+    using Affinity = TaskGraph::Affinity;
+    g_frame_graph.reset(new TaskGraph());
+    auto& graph = *g_frame_graph;
+    const auto input = graph.add("input", []() {
+        glfwPollEvents();
+        ImGui_ImplGlfwGL3_NewFrame();
+        timer();
+    }, {}, Affinity::MAIN);
+    const auto simulate = graph.add("simulate", step_game, {input});
+    const auto interpolate = graph.add("interpolate", []() {
+        g_latest = &g_simulation->interpolate(g_draw_items, g_lights);
+        game_over = g_latest->over;
+        update_view();
+    }, {simulate});
+    const auto lights = graph.add("lights", []() {
+        g_light_clusters->prepare(g_lights, g_view.view, g_view.fov, g_view.aspect,
+            0.1f, 100.0f);
+    }, {interpolate});
+    const auto bin_lights = graph.add_parallel("bin_lights", LightClusters::SLICES,
+        [](const size_t slice) {
+            g_light_clusters->bin_slice(slice);
+        },
+        {lights});
+    const auto light_grid = graph.add("light_grid", []() {
+        g_light_clusters->finish();
+    }, {bin_lights});
+    // The only user of the frame arena in a frame
+    const auto sort = graph.add("sort", sort_items, {interpolate});
+    // These two only wait for the GPU, they overlap with the simulation
+    const auto stream_wait = graph.add("stream_wait", []() {
+        g_stream->begin_frame();
+    }, {}, Affinity::MAIN);
+    const auto shaders = graph.add("shaders", []() {
+        g_programs->update();
+    }, {}, Affinity::MAIN);
+    const auto draw = graph.add("draw", []() {
+        g_gpu_time->begin();
+        render();
+    }, {light_grid, sort, stream_wait, shaders}, Affinity::MAIN);
+    const auto overlay = graph.add("overlay", draw_overlay, {draw}, Affinity::MAIN);
+    graph.add("imgui", []() {
+        ImGui::Render();
+        g_gpu_time->end();
+        g_stream->end_frame();
+    }, {overlay}, Affinity::MAIN);
 }
 
 int run_game(const GameOptions& opts)
 {
     srand(time(NULL));
-    SoundEngine = createIrrKlangDevice();
+    g_profiler.clear();
+    g_sim_profiler.clear();
+    g_render_stats = RenderStats();
+    g_frames.clear();
+    // Growing the records would count as allocations of the frames
+    g_frames.reserve(opts.frames);
     exit_game = false;
     game_opts = opts;
+    // on_frame may hold a Python callable, which must not live on in the
+    // global until the interpreter is gone
+    struct ClearCallback {
+        ~ClearCallback() {
+            game_opts.on_frame = nullptr;
+        }
+    } clear_callback;
+    // Benchmarks run where there may be no sound device
+    SoundEngine = game_opts.offscreen ? nullptr : createIrrKlangDevice();
 
     GLFWwindow* window;
     /* Initialize the library */
@@ -513,8 +1026,16 @@ int run_game(const GameOptions& opts)
     get_resolution();
 
     /* Create a windowed mode window and its OpenGL context */
-    window = glfwCreateWindow(win_width, win_height, "The Game",
-        glfwGetPrimaryMonitor(), NULL);
+    if (game_opts.offscreen) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        window = glfwCreateWindow(win_width, win_height, "The Game", NULL, NULL);
+    } else {
+        window = glfwCreateWindow(win_width, win_height, "The Game",
+            glfwGetPrimaryMonitor(), NULL);
+    }
+    // The hints outlive the window, a later run in the process must not be
+    // hidden
+    glfwDefaultWindowHints();
     if (!window) {
         glfwTerminate();
         return -1;
@@ -534,45 +1055,105 @@ int run_game(const GameOptions& opts)
     // Initialize DevIL library
     ilInit();
 
+    if (game_opts.offscreen && !create_offscreen()) {
+        std::cout << "Cannot create the offscreen framebuffer" << std::endl;
+        destroy_offscreen();
+        GpuLedger::flush();
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return -1;
+    }
+    g_gpu_time.reset(new QueryCounter(GL_TIME_ELAPSED));
+
+    g_stream.reset(new StreamBuffer(STREAM_FRAME_SIZE));
+    ImGui_ImplGlfwGL3_SetStreamBuffer(g_stream.get());
     init_imgui(window);
+    g_jobs.reset(new JobSystem());
     init();
+    build_frame_graph();
+    game_over = false;
+    if (game_opts.threaded_simulation) {
+        g_simulation->start();
+    }
 
     /* Loop until the user closes the window */
-    while (!glfwWindowShouldClose(window) && !exit_game && close_time_s >= app_time_s)
+    while (!glfwWindowShouldClose(window) && !exit_game && close_time_s >= app_time_s
+            && (game_opts.frames == 0 || g_frames.size() < game_opts.frames))
     {
-        /* Poll for and process events */
-        glfwPollEvents();
-        ImGui_ImplGlfwGL3_NewFrame();
-        timer();
-        step_game();
-
-        int remaining_enemies = alive_enemies();
-        if (app_time_s < game_opts.game_time && remaining_enemies != 0 && player_alive) {
-            ImGui::Text(" ---- PLAY! ----");
-            ImGui::Text("REMAINING ENEMIES: %d", alive_enemies());
-            ImGui::Text("REMAINING TIME: %ds", int(game_opts.game_time - app_time_s));
-        } else {
-            fire = false;
-            if (remaining_enemies == 0) {
-                ImGui::Text(" ---- YOU WON! ---- ");
-            } else {
-                ImGui::Text(" ---- YOU LOST! ---- ");
-            }
-            if (close_time_s == std::numeric_limits<float>::max()) {
-                close_time_s = app_time_s + 10.;
-            }
+        const auto frame_start = std::chrono::steady_clock::now();
+        const uint64_t frame_allocations = AllocationProbe::count();
+        auto frame_scope = g_profiler.scope("frame");
+        g_frame_arena.reset();
+        const uint64_t run_allocations = AllocationProbe::count();
+        g_jobs->run(*g_frame_graph);
+        g_profiler.append(g_frame_graph->get_timings());
+        // The tasks count their own allocations on whichever thread ran them,
+        // the probe of this thread already has the ones of the MAIN tasks
+        uint64_t worker_allocations = 0;
+        for (const auto& task : g_frame_graph->get_timings()) {
+            worker_allocations += task.last_allocations;
         }
-        ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
-
-        render();
-        ImGui::Render();
+        worker_allocations -= AllocationProbe::count() - run_allocations;
 
         /* Swap front and back buffers */
         glfwSwapBuffers(window);
+        // Objects released during the frame are deleted between frames
+        GpuLedger::flush();
+
+        if (game_opts.frames > 0) {
+            FrameRecord record;
+            record.cpu_ms = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - frame_start).count();
+            record.gpu_ms = g_gpu_time->get_result() / 1e6;
+            record.draw_calls = g_render_stats.draw_calls;
+            record.triangles = g_render_stats.triangles;
+            record.allocations = AllocationProbe::count() - frame_allocations
+                + worker_allocations;
+            g_frames.push_back(record);
+        }
+
+        if (game_opts.render_rate > 0) {
+            std::this_thread::sleep_until(frame_start
+                + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(1. / game_opts.render_rate)));
+        }
     }
 
+    g_simulation->stop();
+    g_profiler.append(g_sim_profiler.get_phases());
+    if (game_opts.verbose) {
+        g_profiler.dump(std::cout);
+        g_frame_graph->dump(std::cout);
+    }
+    g_frame_graph.reset();
+    g_jobs.reset();
+    g_simulation.reset();
+    g_world.reset();
+    g_static_batch.reset();
+    g_sphere_lod.reset();
+    g_light_clusters.reset();
+    g_prepass_samples.reset();
+    g_shaded_samples.reset();
+    g_occlusion.reset();
+    g_particle_vao.reset();
+    g_variants.reset();
+    g_programs.reset();
     ImGui_ImplGlfwGL3_Shutdown();
-    SoundEngine->drop();
+    ImGui_ImplGlfwGL3_SetStreamBuffer(nullptr);
+    g_stream.reset();
+    g_gpu_time.reset();
+    g_textures.clear();
+    if (g_offscreen_fbo != 0) {
+        destroy_offscreen();
+    }
+    // Whatever is still alive now leaks into the next run
+    GpuLedger::flush();
+    if (game_opts.verbose || GpuLedger::total_objects() != 0) {
+        GpuLedger::dump(std::cout);
+    }
+    if (SoundEngine) {
+        SoundEngine->drop();
+    }
     glfwDestroyWindow(window);
     return 0;
 }
@@ -0,0 +1,99 @@
+#include <iomanip>
+#include "game/gpu_resource.hpp"
+
+std::array<GpuLedger::Entry, size_t(GpuKind::COUNT)> GpuLedger::s_entries;
+std::mutex GpuLedger::s_mutex;
+std::vector<GpuLedger::Garbage> GpuLedger::s_garbage;
+
+const char*
+GpuLedger::name(const GpuKind kind) {
+    switch (kind) {
+    case GpuKind::BUFFER:       return "buffers";
+    case GpuKind::VERTEX_ARRAY: return "vertex arrays";
+    case GpuKind::TEXTURE:      return "textures";
+    case GpuKind::RENDERBUFFER: return "renderbuffers";
+    case GpuKind::PROGRAM:      return "programs";
+    default:                    return "?";
+    }
+}
+
+int64_t
+GpuLedger::total_bytes() {
+    int64_t bytes = 0;
+    for (const auto& entry : s_entries) {
+        bytes += entry.bytes;
+    }
+    return bytes;
+}
+
+int64_t
+GpuLedger::total_objects() {
+    int64_t objects = 0;
+    for (const auto& entry : s_entries) {
+        objects += entry.objects;
+    }
+    return objects;
+}
+
+void
+GpuLedger::created(const GpuKind kind, const size_t bytes) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto& entry = s_entries[size_t(kind)];
+    ++entry.objects;
+    entry.bytes += bytes;
+}
+
+void
+GpuLedger::resized(const GpuKind kind, const size_t from, const size_t to) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_entries[size_t(kind)].bytes += int64_t(to) - int64_t(from);
+}
+
+void
+GpuLedger::release(const GpuKind kind, const GLuint id, const size_t bytes) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    s_garbage.push_back({kind, id, bytes});
+}
+
+void
+GpuLedger::flush() {
+    std::vector<Garbage> garbage;
+    {
+        std::lock_guard<std::mutex> lock(s_mutex);
+        garbage.swap(s_garbage);
+        for (const auto& g : garbage) {
+            auto& entry = s_entries[size_t(g.kind)];
+            --entry.objects;
+            entry.bytes -= g.bytes;
+        }
+    }
+    for (const auto& g : garbage) {
+        switch (g.kind) {
+        case GpuKind::BUFFER:       glDeleteBuffers(1, &g.id);       break;
+        case GpuKind::VERTEX_ARRAY: glDeleteVertexArrays(1, &g.id);  break;
+        case GpuKind::TEXTURE:      glDeleteTextures(1, &g.id);      break;
+        case GpuKind::RENDERBUFFER: glDeleteRenderbuffers(1, &g.id); break;
+        case GpuKind::PROGRAM:      glDeleteProgram(g.id);           break;
+        default:                                                     break;
+        }
+    }
+}
+
+void
+GpuLedger::dump(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(s_mutex);
+    out << std::left << std::setw(16) << "gpu objects"
+        << std::right << std::setw(10) << "live"
+        << std::setw(14) << "KiB" << std::setw(10) << "pending" << '\n';
+    for (size_t k = 0; k < size_t(GpuKind::COUNT); ++k) {
+        size_t pending = 0;
+        for (const auto& g : s_garbage) {
+            pending += size_t(g.kind) == k;
+        }
+        out << std::left << std::setw(16) << GpuLedger::name(GpuKind(k))
+            << std::right << std::setw(10) << s_entries[k].objects
+            << std::setw(14) << std::fixed << std::setprecision(1)
+            << s_entries[k].bytes / 1024.
+            << std::setw(10) << pending << '\n';
+    }
+}
@@ -0,0 +1,75 @@
+#include <algorithm>
+#include <cmath>
+#include "game/integrator.hpp"
+#include "game/object.hpp"
+
+namespace {
+
+// Bodies thinner than this are taken as this thin
+constexpr float MIN_WIDTH = 1e-3f;
+
+}
+
+Integrator::Integrator(const IntegratorParams& params)
+ : m_params(params)
+{}
+
+float
+Integrator::clamp(const float time_delta) {
+    if (time_delta <= m_params.max_time_delta) {
+        return time_delta;
+    }
+    m_stats.clamped_time += time_delta - m_params.max_time_delta;
+    return m_params.max_time_delta;
+}
+
+uint32_t
+Integrator::substeps(const BodyStore& bodies, const float time_delta) {
+    // The gravity of the step counts in, a body at rest may start falling
+    const float fall = Motion::GRAVITY * time_delta;
+    const uint32_t limit = std::max<uint32_t>(m_params.max_substeps, 1);
+    // One more than the limit stands for any more
+    uint32_t wanted = 1;
+    m_stats.fast_bodies = 0;
+    for (size_t i = 0; i < bodies.size(); ++i) {
+        if (bodies.kind[i] == BodyStore::STATIC) {
+            continue;
+        }
+        const auto& h = bodies.halfwidth[i];
+        const float width = std::max(2 * std::min(std::min(h.x, h.y), h.z), MIN_WIDTH);
+        const float travel = (glm::length(bodies.velocity[i]) + fall) * time_delta;
+        const float count = std::ceil(travel / (m_params.max_travel * width));
+        if (count > 1) {
+            ++m_stats.fast_bodies;
+            wanted = std::max(wanted, count > limit ? limit + 1 : uint32_t(count));
+        }
+    }
+    if (wanted > limit) {
+        ++m_stats.capped_steps;
+    }
+    m_stats.substeps = std::min(wanted, limit);
+    return m_stats.substeps;
+}
+
+void
+Integrator::begin(const BodyStore& bodies) {
+    if (m_params.method == IntegratorParams::VELOCITY_VERLET) {
+        m_start_velocity.assign(bodies.velocity.begin(), bodies.velocity.end());
+    }
+}
+
+void
+Integrator::integrate(const std::vector<std::shared_ptr<Object>>& objects,
+        const BodyStore& bodies, const float time_delta) const {
+    if (m_params.method == IntegratorParams::VELOCITY_VERLET) {
+        for (const auto& obj : objects) {
+            const uint32_t row = obj->get_row();
+            obj->integrate(time_delta,
+                0.5f * (m_start_velocity[row] + bodies.velocity[row]));
+        }
+        return;
+    }
+    for (const auto& obj : objects) {
+        obj->integrate(time_delta, bodies.velocity[obj->get_row()]);
+    }
+}
@@ -0,0 +1,280 @@
+#include <algorithm>
+#include <iomanip>
+#include "game/job_system.hpp"
+
+namespace {
+
+int64_t
+now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+TaskGraph::TaskId
+TaskGraph::add(const char* name, std::function<void()> function,
+        const std::vector<TaskId>& dependencies, const Affinity affinity) {
+    const TaskId id = this->add_parallel(name, 1,
+        [function](size_t) {
+            function();
+        },
+        dependencies);
+    m_tasks[id]->affinity = affinity;
+    return id;
+}
+
+TaskGraph::TaskId
+TaskGraph::add_parallel(const char* name, const size_t count,
+        std::function<void(size_t)> function,
+        const std::vector<TaskId>& dependencies) {
+    const TaskId id = m_tasks.size();
+    std::unique_ptr<Task> task(new Task());
+    task->name = name;
+    task->function = std::move(function);
+    task->count = std::max<size_t>(count, 1);
+    task->affinity = Affinity::ANY;
+    task->dependencies = dependencies.size();
+    for (const auto dependency : dependencies) {
+        m_tasks.at(dependency)->successors.push_back(id);
+    }
+    m_tasks.push_back(std::move(task));
+
+    // The timing of a task has the same index as the task, names are unique
+    PhaseTiming timing;
+    timing.name = name;
+    m_timings.append({timing});
+    return id;
+}
+
+void
+TaskGraph::dump(std::ostream& out) const {
+    for (TaskId id = 0; id < m_tasks.size(); ++id) {
+        const auto& task = *m_tasks[id];
+        out << task.name << (task.affinity == Affinity::MAIN ? " (main)" : "");
+        if (task.count > 1) {
+            out << " x" << task.count;
+        }
+        const char* separator = " after ";
+        for (const auto& other : m_tasks) {
+            const auto& s = other->successors;
+            if (std::find(s.begin(), s.end(), id) != s.end()) {
+                out << separator << other->name;
+                separator = ", ";
+            }
+        }
+        out << "\n";
+    }
+}
+
+void
+TaskGraph::dump_timeline(std::ostream& out) const {
+    constexpr size_t BAR = 40;
+    int64_t end_ns = m_run_ns;
+    size_t width = 0;
+    for (const auto& task : m_tasks) {
+        end_ns = std::max(end_ns, task->end_ns);
+        width = std::max(width, task->name.size());
+    }
+    const double total_ms = (end_ns - m_run_ns) / 1e6;
+    double busy_ms = 0;
+    for (const auto& task : m_tasks) {
+        const double start_ms = (task->start_ns - m_run_ns) / 1e6;
+        const double end_ms = (task->end_ns - m_run_ns) / 1e6;
+        busy_ms += end_ms - start_ms;
+        const size_t first = total_ms > 0 ? size_t(start_ms / total_ms * BAR) : 0;
+        const size_t last = total_ms > 0 ? size_t(end_ms / total_ms * BAR) : 0;
+        out << std::left << std::setw(width + 2) << task->name << std::right
+            << std::fixed << std::setprecision(3) << std::setw(10) << start_ms
+            << std::setw(10) << end_ms << "  |" << std::string(first, ' ')
+            << std::string(std::max<size_t>(last - first, 1), '#')
+            << std::string(BAR - std::min(BAR, std::max(last, first + 1)), ' ')
+            << "|\n";
+    }
+    out << m_tasks.size() << " tasks, " << busy_ms << " ms of work in "
+        << total_ms << " ms\n";
+}
+
+JobSystem::JobSystem(const uint32_t threads) {
+    const uint32_t total = threads != 0 ? threads
+        : std::max(1u, std::thread::hardware_concurrency());
+    // A queue per thread and one for the MAIN jobs
+    for (uint32_t i = 0; i <= total; ++i) {
+        m_queues.emplace_back(new Queue());
+    }
+    for (uint32_t i = 1; i < total; ++i) {
+        m_workers.emplace_back(&JobSystem::worker, this, i);
+    }
+}
+
+JobSystem::~JobSystem() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start_cv.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void
+JobSystem::run(TaskGraph& graph) {
+    size_t jobs = 0;
+    for (auto& task : graph.m_tasks) {
+        task->waiting_for = task->dependencies;
+        task->jobs_left = task->count;
+        task->start_ns = 0;
+        task->end_ns = 0;
+        task->allocations = 0;
+        jobs += task->count;
+    }
+    for (auto& queue : m_queues) {
+        // A worker may still be looking at the queues of the last run
+        std::lock_guard<std::mutex> lock(queue->mutex);
+        // Only grows when the graph does, the steady state does not allocate
+        queue->jobs.reserve(jobs);
+        queue->jobs.clear();
+        queue->front = 0;
+    }
+    m_graph = &graph;
+    graph.m_run_ns = now_ns();
+    m_ready = 0;
+    m_main_ready = 0;
+    m_tasks_left = graph.m_tasks.size();
+    for (TaskGraph::TaskId id = 0; id < graph.m_tasks.size(); ++id) {
+        if (graph.m_tasks[id]->dependencies == 0) {
+            this->push(0, id);
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_generation;
+    }
+    m_start_cv.notify_all();
+    this->work(0);
+}
+
+void
+JobSystem::push(const size_t thread, const TaskGraph::TaskId task) {
+    const auto& t = *m_graph->m_tasks[task];
+    const bool main = t.affinity == TaskGraph::Affinity::MAIN;
+    auto& queue = main ? this->main_queue() : *m_queues[thread];
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        // Reversed, so the thread takes the first index first
+        for (size_t i = t.count; i-- > 0; ) {
+            queue.jobs.push_back({task, uint32_t(i)});
+        }
+        (main ? m_main_ready : m_ready) += t.count;
+    }
+    this->wake();
+}
+
+void
+JobSystem::wake() {
+    // Taking the lock orders the change before the check of a thread that is
+    // about to sleep
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+    }
+    m_ready_cv.notify_all();
+}
+
+bool
+JobSystem::has_work(const size_t thread) const {
+    return m_tasks_left == 0 || m_ready != 0 || (thread == 0 && m_main_ready != 0);
+}
+
+bool
+JobSystem::pop(const size_t thread, Job& job) {
+    auto try_pop = [&job](Queue& queue, std::atomic<size_t>& ready) {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.size() == queue.front) {
+            return false;
+        }
+        job = queue.jobs.back();
+        queue.jobs.pop_back();
+        --ready;
+        return true;
+    };
+    // The GL thread prefers its own jobs, the others can do the rest
+    return (thread == 0 && try_pop(this->main_queue(), m_main_ready))
+        || try_pop(*m_queues[thread], m_ready);
+}
+
+bool
+JobSystem::steal(const size_t thread, Job& job) {
+    const size_t threads = m_workers.size() + 1;
+    for (size_t i = 1; i < threads; ++i) {
+        auto& queue = *m_queues[(thread + i) % threads];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (queue.jobs.size() != queue.front) {
+            job = queue.jobs[queue.front++];
+            --m_ready;
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+JobSystem::execute(const size_t thread, const Job& job) {
+    auto& task = *m_graph->m_tasks[job.task];
+    int64_t expected = 0;
+    task.start_ns.compare_exchange_strong(expected, now_ns());
+    const uint64_t allocations = AllocationProbe::count();
+    task.function(job.index);
+    task.allocations += AllocationProbe::count() - allocations;
+    if (--task.jobs_left != 0) {
+        return;
+    }
+
+    // The last job of the task records it and releases the successors
+    task.end_ns = now_ns();
+    m_graph->m_timings.record(job.task, (task.end_ns - task.start_ns) / 1e6,
+        task.allocations);
+    for (const auto successor : task.successors) {
+        if (--m_graph->m_tasks[successor]->waiting_for == 0) {
+            this->push(thread, successor);
+        }
+    }
+    if (--m_tasks_left == 0) {
+        this->wake();
+    }
+}
+
+void
+JobSystem::work(const size_t thread) {
+    constexpr uint32_t SPINS = 64;
+    Job job;
+    uint32_t idle = 0;
+    while (m_tasks_left != 0) {
+        if (this->pop(thread, job) || this->steal(thread, job)) {
+            this->execute(thread, job);
+            idle = 0;
+        } else if (++idle < SPINS) {
+            std::this_thread::yield();
+        } else {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_ready_cv.wait(lock, [&] { return this->has_work(thread); });
+            idle = 0;
+        }
+    }
+}
+
+void
+JobSystem::worker(const size_t thread) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start_cv.wait(lock, [&] { return m_stop || m_generation != seen; });
+            if (m_stop) {
+                return;
+            }
+            seen = m_generation;
+        }
+        this->work(thread);
+    }
+}
@@ -0,0 +1,197 @@
+#include <algorithm>
+#include <cmath>
+#include "game/light_clusters.hpp"
+
+constexpr uint32_t LightClusters::TILES_X;
+constexpr uint32_t LightClusters::TILES_Y;
+constexpr uint32_t LightClusters::SLICES;
+constexpr uint32_t LightClusters::CLUSTERS;
+constexpr uint32_t LightClusters::MAX_LIGHTS;
+constexpr GLint LightClusters::LIGHTS_UNIT;
+constexpr GLint LightClusters::GRID_UNIT;
+constexpr GLint LightClusters::INDICES_UNIT;
+
+namespace {
+
+void
+upload(GpuBuffer& buffer, const void* data, const size_t size) {
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer.get());
+    // New storage every time, the previous frame may still read the old one
+    glBufferData(GL_TEXTURE_BUFFER, size, data, GL_STREAM_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    buffer.set_bytes(size);
+}
+
+float
+distance_squared(const glm::vec3& p, const glm::vec3& min, const glm::vec3& max) {
+    float d = 0;
+    for (int i = 0; i < 3; ++i) {
+        const float v = std::min(std::max(p[i], min[i]), max[i]) - p[i];
+        d += v * v;
+    }
+    return d;
+}
+
+} // namespace
+
+LightClusters::LightClusters()
+ : m_bounds(CLUSTERS), m_cluster_lights(CLUSTERS),
+   m_grid(2 * CLUSTERS, 0)
+{
+    auto create = [](BufferTexture& tex, const GLenum format) {
+        tex.buffer = GpuBuffer::create();
+        // Buffer textures must not be empty
+        ::upload(tex.buffer, nullptr, 16);
+        tex.texture = GpuTexture::create();
+        glBindTexture(GL_TEXTURE_BUFFER, tex.texture.get());
+        glTexBuffer(GL_TEXTURE_BUFFER, format, tex.buffer.get());
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    };
+    create(m_lights_tex, GL_RGBA32F);
+    create(m_grid_tex, GL_RG32UI);
+    create(m_indices_tex, GL_R32UI);
+}
+
+LightClusters::Uniforms
+LightClusters::set_program(const GLuint program) const {
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "light_data"), LIGHTS_UNIT);
+    glUniform1i(glGetUniformLocation(program, "cluster_grid"), GRID_UNIT);
+    glUniform1i(glGetUniformLocation(program, "light_indices"), INDICES_UNIT);
+    glUseProgram(0);
+    Uniforms uniforms;
+    uniforms.view_matrix = glGetUniformLocation(program, "view_matrix");
+    uniforms.tile_size = glGetUniformLocation(program, "cluster_tile_size");
+    uniforms.depth = glGetUniformLocation(program, "cluster_depth");
+    uniforms.count = glGetUniformLocation(program, "cluster_count");
+    return uniforms;
+}
+
+void
+LightClusters::compute_bounds() {
+    const float tan_y = std::tan(m_fov / 2);
+    const float tan_x = tan_y * m_aspect;
+    for (uint32_t z = 0; z < SLICES; ++z) {
+        const float near = m_near * std::pow(m_far / m_near, float(z) / SLICES);
+        const float far = m_near * std::pow(m_far / m_near, float(z + 1) / SLICES);
+        for (uint32_t y = 0; y < TILES_Y; ++y) {
+            const float y0 = (-1 + 2.f * y / TILES_Y) * tan_y;
+            const float y1 = (-1 + 2.f * (y + 1) / TILES_Y) * tan_y;
+            for (uint32_t x = 0; x < TILES_X; ++x) {
+                const float x0 = (-1 + 2.f * x / TILES_X) * tan_x;
+                const float x1 = (-1 + 2.f * (x + 1) / TILES_X) * tan_x;
+                // The tile widens with the depth, the box has to hold both ends
+                auto& b = m_bounds[(z * TILES_Y + y) * TILES_X + x];
+                b.min = glm::vec3(std::min(x0 * near, x0 * far),
+                    std::min(y0 * near, y0 * far), -far);
+                b.max = glm::vec3(std::max(x1 * near, x1 * far),
+                    std::max(y1 * near, y1 * far), -near);
+            }
+        }
+    }
+}
+
+uint32_t
+LightClusters::slice_of(const float depth) const {
+    if (depth <= m_near) {
+        return 0;
+    }
+    const float slice = std::log(depth / m_near) / std::log(m_far / m_near) * SLICES;
+    return std::min<uint32_t>(slice, SLICES - 1);
+}
+
+void
+LightClusters::bin_slice(const uint32_t slice) {
+    const uint32_t first = slice * TILES_X * TILES_Y;
+    for (uint32_t c = first; c < first + TILES_X * TILES_Y; ++c) {
+        m_cluster_lights[c].clear();
+    }
+    for (uint32_t i = 0; i < m_view_lights.size(); ++i) {
+        const auto center = glm::vec3(m_view_lights[i]);
+        const float radius = m_view_lights[i].w;
+        const float depth = -center.z;
+        if (depth + radius < m_near || depth - radius > m_far
+                || slice < this->slice_of(depth - radius)
+                || slice > this->slice_of(depth + radius)) {
+            continue;
+        }
+        for (uint32_t c = first; c < first + TILES_X * TILES_Y; ++c) {
+            if (distance_squared(center, m_bounds[c].min, m_bounds[c].max)
+                    <= radius * radius) {
+                m_cluster_lights[c].push_back(i);
+            }
+        }
+    }
+}
+
+void
+LightClusters::prepare(const std::vector<PointLight>& lights,
+        const glm::mat4& view, const float fov, const float aspect,
+        const float near, const float far) {
+    if (fov != m_fov || aspect != m_aspect || near != m_near || far != m_far) {
+        m_fov = fov;
+        m_aspect = aspect;
+        m_near = near;
+        m_far = far;
+        this->compute_bounds();
+    }
+
+    const size_t count = std::min<size_t>(lights.size(), MAX_LIGHTS);
+    m_lights.clear();
+    m_view_lights.clear();
+    for (size_t i = 0; i < count; ++i) {
+        const auto& light = lights[i];
+        m_lights.emplace_back(light.position, light.radius);
+        m_lights.emplace_back(light.color, 0.f);
+        m_view_lights.emplace_back(glm::vec3(view * glm::vec4(light.position, 1.f)),
+            light.radius);
+    }
+}
+
+void
+LightClusters::finish() {
+    m_indices.clear();
+    m_max_per_cluster = 0;
+    for (uint32_t c = 0; c < CLUSTERS; ++c) {
+        const auto& list = m_cluster_lights[c];
+        m_grid[2 * c] = m_indices.size();
+        m_grid[2 * c + 1] = list.size();
+        m_indices.insert(m_indices.end(), list.begin(), list.end());
+        m_max_per_cluster = std::max<uint32_t>(m_max_per_cluster, list.size());
+    }
+    if (m_indices.empty()) {
+        m_indices.push_back(0);
+    }
+    if (m_lights.empty()) {
+        m_lights.emplace_back(0.f);
+    }
+}
+
+void
+LightClusters::upload() {
+    ::upload(m_lights_tex.buffer, m_lights.data(), m_lights.size() * sizeof(glm::vec4));
+    ::upload(m_grid_tex.buffer, m_grid.data(), m_grid.size() * sizeof(uint32_t));
+    ::upload(m_indices_tex.buffer, m_indices.data(), m_indices.size() * sizeof(uint32_t));
+}
+
+void
+LightClusters::set_uniforms(const Uniforms& uniforms, const glm::mat4& view,
+        const int width, const int height) const {
+    glUniformMatrix4fv(uniforms.view_matrix, 1, GL_FALSE, glm::value_ptr(view));
+    glUniform2f(uniforms.tile_size, float(width) / TILES_X, float(height) / TILES_Y);
+    // Slice of a view depth d is log(d) * x + y
+    const float scale = SLICES / std::log(m_far / m_near);
+    glUniform2f(uniforms.depth, scale, -std::log(m_near) * scale);
+    glUniform3i(uniforms.count, TILES_X, TILES_Y, SLICES);
+}
+
+void
+LightClusters::bind_textures() const {
+    glActiveTexture(GL_TEXTURE0 + LIGHTS_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, m_lights_tex.texture.get());
+    glActiveTexture(GL_TEXTURE0 + GRID_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, m_grid_tex.texture.get());
+    glActiveTexture(GL_TEXTURE0 + INDICES_UNIT);
+    glBindTexture(GL_TEXTURE_BUFFER, m_indices_tex.texture.get());
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,558 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <numeric>
+#include "game/binned_sah.hpp"
+#include "game/mesh_bvh.hpp"
+
+namespace {
+
+constexpr char MAGIC[4] = {'B', 'V', 'H', '1'};
+constexpr uint32_t CACHE_LINE = 64;
+// Cost of visiting a node relative to testing a triangle
+constexpr float TRAVERSAL_COST = 1.f;
+// Levels split in start(), one subtree per range below them
+constexpr uint32_t TOP_DEPTH = 4;
+static_assert(1u << TOP_DEPTH == MeshBvh::Builder::SUBTREES,
+    "the top levels end in a range per subtree");
+
+struct Header {
+    char magic[4];
+    uint64_t key;
+    uint32_t nodes;
+    uint32_t triangles;
+};
+
+// FNV-1a over the bytes of the positions
+uint64_t
+hash(const std::vector<glm::vec3>& positions) {
+    uint64_t h = 14695981039346656037ull;
+    const auto bytes = reinterpret_cast<const uint8_t*>(positions.data());
+    for (size_t i = 0; i < positions.size() * sizeof(glm::vec3); ++i) {
+        h = (h ^ bytes[i]) * 1099511628211ull;
+    }
+    return h;
+}
+
+// Point of the triangle 'abc' closest to 'p', see Real-Time Collision
+// Detection 5.1.5
+glm::vec3
+closest_point(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b,
+        const glm::vec3& c) {
+    const glm::vec3 ab = b - a;
+    const glm::vec3 ac = c - a;
+    const glm::vec3 ap = p - a;
+    const float d1 = glm::dot(ab, ap);
+    const float d2 = glm::dot(ac, ap);
+    if (d1 <= 0 && d2 <= 0) {
+        return a;
+    }
+    const glm::vec3 bp = p - b;
+    const float d3 = glm::dot(ab, bp);
+    const float d4 = glm::dot(ac, bp);
+    if (d3 >= 0 && d4 <= d3) {
+        return b;
+    }
+    const float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0 && d1 >= 0 && d3 <= 0) {
+        return a + d1 / (d1 - d3) * ab;
+    }
+    const glm::vec3 cp = p - c;
+    const float d5 = glm::dot(ab, cp);
+    const float d6 = glm::dot(ac, cp);
+    if (d6 >= 0 && d5 <= d6) {
+        return c;
+    }
+    const float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0 && d2 >= 0 && d6 <= 0) {
+        return a + d2 / (d2 - d6) * ac;
+    }
+    const float va = d3 * d6 - d5 * d4;
+    if (va <= 0 && d4 - d3 >= 0 && d5 - d6 >= 0) {
+        return b + (d4 - d3) / ((d4 - d3) + (d5 - d6)) * (c - b);
+    }
+    const float denominator = 1 / (va + vb + vc);
+    return a + vb * denominator * ab + vc * denominator * ac;
+}
+
+// Whether 'p' on the plane of the triangle lies in it, 'n' is along the
+// cross of its edges 'ab' and 'ac'
+bool
+inside(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b,
+        const glm::vec3& c, const glm::vec3& n) {
+    return glm::dot(glm::cross(b - a, p - a), n) >= 0
+        && glm::dot(glm::cross(c - b, p - b), n) >= 0
+        && glm::dot(glm::cross(a - c, p - c), n) >= 0;
+}
+
+// Cast against the side of the capsule around the edge 'pq', its ends are
+// the spheres around the corners
+bool
+cast_edge(const glm::vec3& p, const glm::vec3& q, const glm::vec3& origin,
+        const glm::vec3& direction, const float radius, float& distance,
+        glm::vec3& normal) {
+    // Where the distance from the line through the edge is 'radius', see
+    // Real-Time Collision Detection 5.3.7
+    const glm::vec3 e = q - p;
+    const glm::vec3 m = origin - p;
+    const float ee = glm::dot(e, e);
+    const float md = glm::dot(m, e);
+    const float nd = glm::dot(direction, e);
+    const float a = ee - nd * nd;
+    const float b = ee * glm::dot(m, direction) - nd * md;
+    const float c = ee * (glm::dot(m, m) - radius * radius) - md * md;
+    if (a < 1e-9f * ee) {
+        return false;
+    }
+    const float discriminant = b * b - a * c;
+    if (discriminant < 0) {
+        return false;
+    }
+    const float t = c < 0 ? 0.f : (-b - std::sqrt(discriminant)) / a;
+    const float s = md + t * nd;
+    if (t < 0 || t >= distance || s < 0 || s > ee) {
+        return false;
+    }
+    distance = t;
+    if (t == 0) {
+        normal = -direction;
+    } else {
+        normal = (m + t * direction - s / ee * e) / radius;
+    }
+    return true;
+}
+
+// Cast against the triangle 'abc' from both of its sides
+bool
+cast_triangle(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c,
+        const glm::vec3& origin, const glm::vec3& direction, const float radius,
+        float& distance, glm::vec3& normal) {
+    const glm::vec3 face = glm::cross(b - a, c - a);
+    const float area = glm::length(face);
+    if (area < 1e-12f) {
+        return false;
+    }
+    // Facing the cast, which then approaches the plane
+    const glm::vec3 n = glm::dot(face, direction) > 0 ? -face / area : face / area;
+    const float height = glm::dot(origin - a, n);
+    const float approach = -glm::dot(n, direction);
+    if (height <= -radius || (height >= radius && approach <= 0)) {
+        return false;
+    }
+    // Nothing of the face is touched before its plane, and touching the
+    // plane inside the face comes before touching the edges
+    const float t = std::max((height - radius) / approach, 0.f);
+    if (t >= distance) {
+        return false;
+    }
+    const glm::vec3 p = origin + t * direction - std::min(height, radius) * n;
+    if (inside(p, a, b, c, face)) {
+        distance = t;
+        normal = t == 0 ? -direction : n;
+        return true;
+    }
+    if (radius == 0) {
+        return false;
+    }
+    bool hit = false;
+    hit |= cast_edge(a, b, origin, direction, radius, distance, normal);
+    hit |= cast_edge(b, c, origin, direction, radius, distance, normal);
+    hit |= cast_edge(c, a, origin, direction, radius, distance, normal);
+    hit |= ::cast(a, 0, origin, direction, radius, distance, normal);
+    hit |= ::cast(b, 0, origin, direction, radius, distance, normal);
+    hit |= ::cast(c, 0, origin, direction, radius, distance, normal);
+    return hit;
+}
+
+} // namespace
+
+constexpr uint32_t MeshBvh::MAX_LEAF;
+constexpr uint32_t MeshBvh::MAX_DEPTH;
+constexpr uint32_t MeshBvh::Builder::SUBTREES;
+
+std::shared_ptr<const MeshBvh>
+MeshBvh::build(const std::vector<glm::vec3>& positions, const std::string& cache,
+        ThreadPool* pool) {
+    Builder builder(positions, cache);
+    builder.start();
+    if (pool != nullptr) {
+        pool->parallel_for(Builder::SUBTREES, [&builder](size_t subtree) {
+            builder.build(subtree);
+        });
+    } else {
+        for (size_t subtree = 0; subtree < Builder::SUBTREES; ++subtree) {
+            builder.build(subtree);
+        }
+    }
+    return builder.finish();
+}
+
+bool
+MeshBvh::cast(const glm::vec3& position, const glm::vec3& scale,
+        const glm::vec3& origin, const glm::vec3& direction, const float radius,
+        float& distance, glm::vec3& normal) const {
+    if (m_node_count == 0) {
+        return false;
+    }
+    const glm::vec3 inverse = 1.f / direction;
+    const glm::vec3 grow(radius);
+    bool hit = false;
+
+    // The nearer child is on top, the farther one is skipped once the cast
+    // touched something before it
+    uint32_t stack[MAX_DEPTH];
+    uint32_t size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+        const Node& node = m_nodes[stack[--size]];
+        if (!node.is_leaf()) {
+            const uint32_t first = &node - m_nodes.get() + 1;
+            const Node& a = m_nodes[first];
+            const Node& b = m_nodes[node.offset];
+            float ta, tb;
+            const bool in_a = enters(position + scale * a.min - grow,
+                position + scale * a.max + grow, origin, inverse, distance, ta);
+            const bool in_b = enters(position + scale * b.min - grow,
+                position + scale * b.max + grow, origin, inverse, distance, tb);
+            if (in_a && in_b && tb < ta) {
+                stack[size++] = first;
+                stack[size++] = node.offset;
+            } else if (in_a && in_b) {
+                stack[size++] = node.offset;
+                stack[size++] = first;
+            } else if (in_a || in_b) {
+                stack[size++] = in_a ? first : node.offset;
+            }
+            continue;
+        }
+        for (uint32_t t = node.offset; t < node.offset + node.count; ++t) {
+            hit |= cast_triangle(position + scale * m_corners[3 * t],
+                position + scale * m_corners[3 * t + 1],
+                position + scale * m_corners[3 * t + 2],
+                origin, direction, radius, distance, normal);
+        }
+    }
+    return hit;
+}
+
+void
+MeshBvh::allocate(const uint32_t nodes) {
+    void* memory = nullptr;
+    if (nodes != 0 && posix_memalign(&memory, CACHE_LINE, nodes * sizeof(Node)) != 0) {
+        throw std::bad_alloc();
+    }
+    m_nodes.reset(static_cast<Node*>(memory));
+    m_node_count = nodes;
+}
+
+bool
+MeshBvh::collide(const glm::vec3& position, const glm::vec3& scale,
+        const glm::vec3& center, const float radius, Penetration& out) const {
+    if (m_node_count == 0) {
+        return false;
+    }
+    // Bounds of the sphere in the space of the mesh
+    const glm::vec3 low = (center - glm::vec3(radius) - position) / scale;
+    const glm::vec3 high = (center + glm::vec3(radius) - position) / scale;
+    float best = radius * radius;
+    uint32_t best_triangle = 0;
+    glm::vec3 closest;
+    bool found = false;
+
+    uint32_t stack[MAX_DEPTH];
+    uint32_t size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+        const uint32_t index = stack[--size];
+        const Node& node = m_nodes[index];
+        if (glm::any(glm::lessThan(node.max, low)) || glm::any(glm::greaterThan(node.min, high))) {
+            continue;
+        }
+        if (!node.is_leaf()) {
+            // The first child is on top, it is visited first
+            stack[size++] = node.offset;
+            stack[size++] = index + 1;
+            continue;
+        }
+        for (uint32_t t = node.offset; t < node.offset + node.count; ++t) {
+            const glm::vec3 p = closest_point(center,
+                position + scale * m_corners[3 * t],
+                position + scale * m_corners[3 * t + 1],
+                position + scale * m_corners[3 * t + 2]);
+            const glm::vec3 d = center - p;
+            if (glm::dot(d, d) < best) {
+                best = glm::dot(d, d);
+                best_triangle = t;
+                closest = p;
+                found = true;
+            }
+        }
+    }
+    if (!found) {
+        return false;
+    }
+    const float distance = std::sqrt(best);
+    glm::vec3 normal;
+    if (distance > 1e-6f) {
+        normal = (center - closest) / distance;
+    } else {
+        // The center is on the surface, out along the face
+        const auto* corner = &m_corners[3 * best_triangle];
+        normal = glm::normalize(glm::cross(scale * (corner[1] - corner[0]),
+            scale * (corner[2] - corner[0])));
+    }
+    const float depth = radius - distance;
+    out.count = 0;
+    out.normal = normal;
+    out.add(closest - 0.5f * depth * normal, depth);
+    return true;
+}
+
+bool
+MeshBvh::load(const std::string& path, const uint64_t key, const uint32_t triangles) {
+    std::ifstream file(path, std::ios::binary);
+    Header header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+            || std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+            || header.key != key || header.triangles != triangles
+            || header.nodes == 0) {
+        return false;
+    }
+    this->allocate(header.nodes);
+    m_corners.resize(3 * size_t(header.triangles));
+    file.read(reinterpret_cast<char*>(m_nodes.get()), header.nodes * sizeof(Node));
+    file.read(reinterpret_cast<char*>(m_corners.data()),
+        m_corners.size() * sizeof(glm::vec3));
+    if (!file) {
+        return false;
+    }
+    // Children come after their parent, so one pass finds every depth and a
+    // broken file cannot make collide() loop or overflow its stack
+    std::vector<uint32_t> depth(header.nodes, 0);
+    for (uint32_t i = 0; i < header.nodes; ++i) {
+        const Node& node = m_nodes[i];
+        if (node.is_leaf()) {
+            if (uint64_t(node.offset) + node.count > header.triangles) {
+                return false;
+            }
+            continue;
+        }
+        if (i + 1 >= header.nodes || node.offset <= i + 1 || node.offset >= header.nodes
+                || depth[i] + 1 >= MAX_DEPTH) {
+            return false;
+        }
+        depth[i + 1] = depth[node.offset] = depth[i] + 1;
+    }
+    m_key = key;
+    return true;
+}
+
+void
+MeshBvh::save(const std::string& path) const {
+    // Zeroed padding too, the same tree makes the same file
+    Header header = Header();
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.key = m_key;
+    header.nodes = m_node_count;
+    header.triangles = this->triangle_count();
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(m_nodes.get()), m_node_count * sizeof(Node));
+    file.write(reinterpret_cast<const char*>(m_corners.data()),
+        m_corners.size() * sizeof(glm::vec3));
+    if (!file) {
+        std::cout << "Cannot write the BVH cache " << path << std::endl;
+    }
+}
+
+MeshBvh::Builder::Builder(const std::vector<glm::vec3>& positions,
+        const std::string& cache)
+ : m_cache(cache),
+   m_positions(positions.begin(), positions.begin() + positions.size() / 3 * 3),
+   m_key(hash(m_positions))
+{ }
+
+void
+MeshBvh::Builder::start() {
+    if (!m_cache.empty()) {
+        m_cached.reset(new MeshBvh());
+        if (m_cached->load(m_cache, m_key, m_positions.size() / 3)) {
+            return;
+        }
+        m_cached.reset();
+    }
+    const uint32_t triangles = m_positions.size() / 3;
+    m_bounds.resize(triangles);
+    m_centroids.resize(triangles);
+    for (uint32_t t = 0; t < triangles; ++t) {
+        const auto* corner = &m_positions[3 * t];
+        m_bounds[t].min = glm::min(glm::min(corner[0], corner[1]), corner[2]);
+        m_bounds[t].max = glm::max(glm::max(corner[0], corner[1]), corner[2]);
+        m_centroids[t] = (corner[0] + corner[1] + corner[2]) / 3.f;
+    }
+    m_order.resize(triangles);
+    std::iota(m_order.begin(), m_order.end(), 0);
+    m_top.clear();
+    m_roots.clear();
+    if (triangles > 0) {
+        this->build_top({0, triangles}, 0);
+    }
+    m_subtrees.assign(m_roots.size(), {});
+}
+
+void
+MeshBvh::Builder::build(const size_t subtree) {
+    if (m_cached || subtree >= m_roots.size()) {
+        return;
+    }
+    const Top& top = m_top[m_roots[subtree]];
+    this->build(top.range, m_subtrees[subtree], top.depth);
+}
+
+std::shared_ptr<const MeshBvh>
+MeshBvh::Builder::finish() {
+    if (m_cached || m_positions.empty()) {
+        return m_cached;
+    }
+    std::shared_ptr<MeshBvh> bvh(new MeshBvh());
+    uint32_t nodes = 0;
+    for (const auto& top : m_top) {
+        nodes += top.subtree < 0;
+    }
+    for (const auto& subtree : m_subtrees) {
+        nodes += subtree.size();
+    }
+    bvh->allocate(nodes);
+    uint32_t next = 0;
+    if (!m_top.empty()) {
+        this->emit(m_top[0], *bvh, next);
+    }
+    bvh->m_corners.resize(m_positions.size());
+    for (size_t i = 0; i < m_order.size(); ++i) {
+        std::copy_n(&m_positions[3 * m_order[i]], 3, &bvh->m_corners[3 * i]);
+    }
+    bvh->m_key = m_key;
+    if (!m_cache.empty() && nodes != 0) {
+        bvh->save(m_cache);
+    }
+    return bvh;
+}
+
+MeshBvh::Builder::Bounds
+MeshBvh::Builder::bounds(const Range& range) const {
+    Bounds b = {glm::vec3(std::numeric_limits<float>::max()),
+        glm::vec3(std::numeric_limits<float>::lowest())};
+    for (uint32_t i = range.first; i < range.first + range.count; ++i) {
+        b.min = glm::min(b.min, m_bounds[m_order[i]].min);
+        b.max = glm::max(b.max, m_bounds[m_order[i]].max);
+    }
+    return b;
+}
+
+bool
+MeshBvh::Builder::split(const Range& range, const Bounds& bounds, uint32_t& middle) {
+    if (range.count <= 1) {
+        return false;
+    }
+    const auto first = m_order.begin() + range.first;
+    const auto last = first + range.count;
+    glm::vec3 low(std::numeric_limits<float>::max());
+    glm::vec3 high(std::numeric_limits<float>::lowest());
+    for (auto t = first; t != last; ++t) {
+        low = glm::min(low, m_centroids[*t]);
+        high = glm::max(high, m_centroids[*t]);
+    }
+    BinnedSah sah(low, high);
+    for (uint32_t axis = 0; axis < 3; ++axis) {
+        if (high[axis] <= low[axis]) {
+            continue;
+        }
+        sah.begin(axis);
+        for (auto t = first; t != last; ++t) {
+            sah.add(m_centroids[*t][axis], m_bounds[*t].min, m_bounds[*t].max);
+        }
+        sah.sweep();
+    }
+
+    const auto& best = sah.get_best();
+    if (!best.found()) {
+        // Every centroid at the same spot, halve a range too big for a leaf
+        if (range.count <= MAX_LEAF) {
+            return false;
+        }
+        middle = range.first + range.count / 2;
+        return true;
+    }
+    const float cost = TRAVERSAL_COST + best.cost
+        / std::max(BinnedSah::area(bounds.min, bounds.max), std::numeric_limits<float>::min());
+    if (cost >= range.count && range.count <= MAX_LEAF) {
+        return false;
+    }
+    middle = std::partition(first, last, [&](const uint32_t t) {
+        return sah.bin_of(m_centroids[t][best.axis], best.axis) < best.bin;
+    }) - m_order.begin();
+    return true;
+}
+
+void
+MeshBvh::Builder::build(const Range& range, std::vector<Node>& nodes,
+        const uint32_t depth) {
+    const uint32_t index = nodes.size();
+    const Bounds b = this->bounds(range);
+    nodes.push_back({b.min, range.first, b.max, range.count});
+    uint32_t middle;
+    // The deepest level is all leaves, however big
+    if (depth + 1 >= MAX_DEPTH || !this->split(range, b, middle)) {
+        return;
+    }
+    nodes[index].count = 0;
+    this->build({range.first, middle - range.first}, nodes, depth + 1);
+    nodes[index].offset = nodes.size();
+    this->build({middle, range.first + range.count - middle}, nodes, depth + 1);
+}
+
+int32_t
+MeshBvh::Builder::build_top(const Range& range, const uint32_t depth) {
+    const int32_t index = m_top.size();
+    Top top;
+    top.bounds = this->bounds(range);
+    top.range = range;
+    top.depth = depth;
+    m_top.push_back(top);
+    uint32_t middle;
+    if (depth < TOP_DEPTH && this->split(range, top.bounds, middle)) {
+        const int32_t left = this->build_top({range.first, middle - range.first},
+            depth + 1);
+        const int32_t right = this->build_top(
+            {middle, range.first + range.count - middle}, depth + 1);
+        m_top[index].left = left;
+        m_top[index].right = right;
+    } else {
+        m_top[index].subtree = m_roots.size();
+        m_roots.push_back(index);
+    }
+    return index;
+}
+
+void
+MeshBvh::Builder::emit(const Top& top, MeshBvh& bvh, uint32_t& next) const {
+    if (top.subtree >= 0) {
+        // Offsets of the inner nodes are relative to the subtree
+        const uint32_t base = next;
+        for (auto node : m_subtrees[top.subtree]) {
+            if (!node.is_leaf()) {
+                node.offset += base;
+            }
+            bvh.m_nodes[next++] = node;
+        }
+        return;
+    }
+    const uint32_t index = next++;
+    bvh.m_nodes[index] = {top.bounds.min, 0, top.bounds.max, 0};
+    this->emit(m_top[top.left], bvh, next);
+    bvh.m_nodes[index].offset = next;
+    this->emit(m_top[top.right], bvh, next);
+}
@@ -0,0 +1,53 @@
+#include <algorithm>
+#include "game/mesh_lod.hpp"
+
+constexpr float MeshLod::HYSTERESIS;
+
+MeshLod::MeshLod(std::vector<Level> levels)
+ : m_levels(std::move(levels)), m_objects(m_levels.size(), 0),
+   m_triangles(m_levels.size(), 0)
+{
+    m_levels.back().min_pixels = 0;
+}
+
+uint8_t
+MeshLod::level_of(const float pixels) const {
+    uint8_t level = 0;
+    while (pixels < m_levels[level].min_pixels) {
+        ++level;
+    }
+    return level;
+}
+
+void
+MeshLod::begin_frame() {
+    m_next.clear();
+    m_cursor = 0;
+    std::fill(m_objects.begin(), m_objects.end(), 0);
+    std::fill(m_triangles.begin(), m_triangles.end(), 0);
+}
+
+void
+MeshLod::select(DrawItem& item, const float pixels) {
+    // The band of levels the size allows with the hysteresis either way
+    const uint8_t finest = this->level_of(pixels * (1 + HYSTERESIS));
+    const uint8_t coarsest = this->level_of(pixels / (1 + HYSTERESIS));
+
+    while (m_cursor < m_current.size() && m_current[m_cursor].first < item.id) {
+        ++m_cursor;
+    }
+    uint8_t level = this->level_of(pixels);
+    if (m_cursor < m_current.size() && m_current[m_cursor].first == item.id) {
+        level = std::min(std::max(m_current[m_cursor].second, finest), coarsest);
+    }
+    m_next.emplace_back(item.id, level);
+
+    PV112::SetDrawGeometry(item, m_levels[level].geometry);
+    ++m_objects[level];
+    m_triangles[level] += item.triangles();
+}
+
+void
+MeshLod::end_frame() {
+    std::swap(m_current, m_next);
+}
@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include "game/obb.hpp"
+
+namespace {
+
+// Crosses of nearly parallel edges are no axis at all
+constexpr float PARALLEL = 1e-5f;
+// A later axis has to overlap this much less to be taken instead of an
+// earlier one, so the manifold does not flip between almost equal axes from
+// one step to the next. Faces come first, the face of 'a' before the one of
+// 'b', then edges.
+constexpr float RELATIVE_TOLERANCE = 0.95f;
+constexpr float ABSOLUTE_TOLERANCE = 0.01f;
+// Clipping a quad by four planes gives at most eight corners
+constexpr uint32_t MAX_CLIPPED = 8;
+
+struct Polygon {
+    std::array<glm::vec3, MAX_CLIPPED> points;
+    uint32_t count = 0;
+};
+
+bool
+better(const float separation, const float best) {
+    return separation > RELATIVE_TOLERANCE * best + ABSOLUTE_TOLERANCE;
+}
+
+// Half of the extent of 'box' along the unit 'axis'
+float
+radius(const OBB& box, const glm::vec3& axis) {
+    return box.halfwidths.x * std::abs(glm::dot(box.axes[0], axis))
+        + box.halfwidths.y * std::abs(glm::dot(box.axes[1], axis))
+        + box.halfwidths.z * std::abs(glm::dot(box.axes[2], axis));
+}
+
+// Keeps the part of 'polygon' where dot(p, normal) <= offset
+void
+clip(const Polygon& polygon, const glm::vec3& normal, const float offset,
+        Polygon& out) {
+    out.count = 0;
+    for (uint32_t i = 0; i < polygon.count; ++i) {
+        const auto& p = polygon.points[i];
+        const auto& q = polygon.points[(i + 1) % polygon.count];
+        const float dp = glm::dot(p, normal) - offset;
+        const float dq = glm::dot(q, normal) - offset;
+        if (dp <= 0) {
+            out.points[out.count++] = p;
+        }
+        if ((dp < 0 && dq > 0) || (dp > 0 && dq < 0)) {
+            out.points[out.count++] = p + dp / (dp - dq) * (q - p);
+        }
+    }
+}
+
+// Keeps the deepest point and the three that span the largest area with it
+void
+reduce(const Polygon& points, const std::array<float, MAX_CLIPPED>& depths,
+        Penetration& out) {
+    if (points.count <= Penetration::MAX_POINTS) {
+        for (uint32_t i = 0; i < points.count; ++i) {
+            out.add(points.points[i], depths[i]);
+        }
+        return;
+    }
+    std::array<uint32_t, Penetration::MAX_POINTS> chosen;
+    auto pick = [&points](auto score) {
+        uint32_t best = 0;
+        float best_score = std::numeric_limits<float>::lowest();
+        for (uint32_t i = 0; i < points.count; ++i) {
+            const float s = score(points.points[i]);
+            if (s > best_score) {
+                best = i;
+                best_score = s;
+            }
+        }
+        return best;
+    };
+    chosen[0] = std::max_element(depths.begin(), depths.begin() + points.count)
+        - depths.begin();
+    const auto p0 = points.points[chosen[0]];
+    chosen[1] = pick([&](const glm::vec3& p) {
+        return glm::dot(p - p0, p - p0);
+    });
+    const auto p1 = points.points[chosen[1]];
+    chosen[2] = pick([&](const glm::vec3& p) {
+        const auto c = glm::cross(p1 - p0, p - p0);
+        return glm::dot(c, c);
+    });
+    const auto p2 = points.points[chosen[2]];
+    chosen[3] = pick([&](const glm::vec3& p) {
+        return std::min(std::min(glm::dot(p - p0, p - p0), glm::dot(p - p1, p - p1)),
+            glm::dot(p - p2, p - p2));
+    });
+    for (const auto i : chosen) {
+        out.add(points.points[i], depths[i]);
+    }
+}
+
+// The face of 'reference' along 'axis' and facing 'normal' against the
+// incident face of the other box, the one most opposite to it
+void
+face_contact(const OBB& reference, const OBB& incident, const uint32_t axis,
+        const glm::vec3& normal, Penetration& out) {
+    uint32_t face = 0;
+    float alignment = 0;
+    for (uint32_t i = 0; i < 3; ++i) {
+        const float a = std::abs(glm::dot(incident.axes[i], normal));
+        if (a > alignment) {
+            face = i;
+            alignment = a;
+        }
+    }
+    const float side = glm::dot(incident.axes[face], normal) > 0 ? -1.f : 1.f;
+    const glm::vec3 center = incident.center
+        + side * incident.halfwidths[face] * incident.axes[face];
+    const glm::vec3 u = incident.halfwidths[(face + 1) % 3] * incident.axes[(face + 1) % 3];
+    const glm::vec3 v = incident.halfwidths[(face + 2) % 3] * incident.axes[(face + 2) % 3];
+    Polygon polygon;
+    polygon.count = 4;
+    polygon.points = {{center + u + v, center - u + v, center - u - v, center + u - v}};
+
+    // By the four sides of the reference face
+    Polygon clipped;
+    for (uint32_t i = 1; i < 3; ++i) {
+        const auto& side_normal = reference.axes[(axis + i) % 3];
+        const float extent = reference.halfwidths[(axis + i) % 3];
+        const float offset = glm::dot(reference.center, side_normal);
+        clip(polygon, side_normal, offset + extent, clipped);
+        clip(clipped, -side_normal, extent - offset, polygon);
+    }
+
+    // Only the corners below the reference face touch it
+    const float face_offset = glm::dot(reference.center, normal)
+        + reference.halfwidths[axis];
+    Polygon touching;
+    std::array<float, MAX_CLIPPED> depths;
+    for (uint32_t i = 0; i < polygon.count; ++i) {
+        const auto& p = polygon.points[i];
+        const float depth = face_offset - glm::dot(p, normal);
+        if (depth >= 0) {
+            depths[touching.count] = depth;
+            touching.points[touching.count++] = p + 0.5f * depth * normal;
+        }
+    }
+    reduce(touching, depths, out);
+}
+
+// The edges of 'a' along 'i' and of 'b' along 'j' closest to each other
+void
+edge_contact(const OBB& a, const OBB& b, const uint32_t i, const uint32_t j,
+        const glm::vec3& normal, const float depth, Penetration& out) {
+    glm::vec3 pa = a.center;
+    glm::vec3 pb = b.center;
+    for (uint32_t k = 0; k < 3; ++k) {
+        if (k != i) {
+            const float side = glm::dot(a.axes[k], normal) > 0 ? 1.f : -1.f;
+            pa += side * a.halfwidths[k] * a.axes[k];
+        }
+        if (k != j) {
+            const float side = glm::dot(b.axes[k], normal) > 0 ? -1.f : 1.f;
+            pb += side * b.halfwidths[k] * b.axes[k];
+        }
+    }
+    const auto& u = a.axes[i];
+    const auto& v = b.axes[j];
+    const glm::vec3 w = pa - pb;
+    const float uv = glm::dot(u, v);
+    const float e = glm::dot(u, w);
+    const float f = glm::dot(v, w);
+    // The axis is not there for parallel edges, the denominator is not zero
+    const float s = glm::clamp((uv * f - e) / (1 - uv * uv),
+        -a.halfwidths[i], a.halfwidths[i]);
+    const float t = glm::clamp(f + s * uv, -b.halfwidths[j], b.halfwidths[j]);
+    out.add(0.5f * (pa + s * u + pb + t * v), depth);
+}
+
+} // namespace
+
+bool
+collide(const OBB& a, const OBB& b, Penetration& out) {
+    const glm::vec3 d = b.center - a.center;
+    out.count = 0;
+
+    // Separation along every axis, positive when the boxes are apart on it
+    auto separation = [&](const glm::vec3& axis) {
+        return std::abs(glm::dot(d, axis)) - radius(a, axis) - radius(b, axis);
+    };
+    float a_separation = std::numeric_limits<float>::lowest();
+    float b_separation = std::numeric_limits<float>::lowest();
+    uint32_t a_axis = 0, b_axis = 0;
+    for (uint32_t i = 0; i < 3; ++i) {
+        const float sa = separation(a.axes[i]);
+        const float sb = separation(b.axes[i]);
+        if (sa > 0 || sb > 0) {
+            return false;
+        }
+        if (sa > a_separation) {
+            a_separation = sa;
+            a_axis = i;
+        }
+        if (sb > b_separation) {
+            b_separation = sb;
+            b_axis = i;
+        }
+    }
+    const bool face_of_a = !better(b_separation, a_separation);
+    const float face_separation = face_of_a ? a_separation : b_separation;
+    const uint32_t face_axis = face_of_a ? a_axis : b_axis;
+    float edge_separation = std::numeric_limits<float>::lowest();
+    uint32_t edge_i = 0, edge_j = 0;
+    glm::vec3 edge_axis;
+    for (uint32_t i = 0; i < 3; ++i) {
+        for (uint32_t j = 0; j < 3; ++j) {
+            glm::vec3 axis = glm::cross(a.axes[i], b.axes[j]);
+            const float length = glm::length(axis);
+            if (length < PARALLEL) {
+                continue;
+            }
+            axis /= length;
+            const float s = separation(axis);
+            if (s > 0) {
+                return false;
+            }
+            if (s > edge_separation) {
+                edge_separation = s;
+                edge_i = i;
+                edge_j = j;
+                edge_axis = axis;
+            }
+        }
+    }
+
+    if (better(edge_separation, face_separation)) {
+        out.normal = glm::dot(d, edge_axis) < 0 ? -edge_axis : edge_axis;
+        edge_contact(a, b, edge_i, edge_j, out.normal, -edge_separation, out);
+        return true;
+    }
+    const glm::vec3 axis = (face_of_a ? a : b).axes[face_axis];
+    out.normal = glm::dot(d, axis) < 0 ? -axis : axis;
+    if (face_of_a) {
+        face_contact(a, b, face_axis, out.normal, out);
+    } else {
+        face_contact(b, a, face_axis, -out.normal, out);
+    }
+    return out.count > 0;
+}
+
+bool
+collide_aligned(const OBB& a, const OBB& b, Penetration& out) {
+    const glm::vec3 offset = b.center - a.center;
+    const glm::vec3 overlap = a.halfwidths + b.halfwidths - glm::abs(offset);
+    uint32_t axis = 0;
+    for (uint32_t i = 0; i < 3; ++i) {
+        if (overlap[i] <= 0) {
+            return false;
+        }
+        if (overlap[i] < overlap[axis]) {
+            axis = i;
+        }
+    }
+    out.count = 0;
+    out.normal = glm::vec3(0);
+    out.normal[axis] = offset[axis] < 0 ? -1 : 1;
+    // The corners of the rectangle the two boxes share, halfway between the
+    // touching faces
+    const glm::vec3 low = glm::max(a.center - a.halfwidths, b.center - b.halfwidths);
+    const glm::vec3 high = glm::min(a.center + a.halfwidths, b.center + b.halfwidths);
+    const uint32_t u = (axis + 1) % 3;
+    const uint32_t v = (axis + 2) % 3;
+    glm::vec3 corner;
+    corner[axis] = 0.5f * (low[axis] + high[axis]);
+    for (uint32_t i = 0; i < 4; ++i) {
+        corner[u] = i & 1 ? high[u] : low[u];
+        corner[v] = i & 2 ? high[v] : low[v];
+        out.add(corner, overlap[axis]);
+    }
+    return true;
+}
+
+bool
+collide(const OBB& box, const glm::vec3& center, const float radius,
+        Penetration& out) {
+    // In the space of the box, where it is an AABB around the origin
+    const glm::vec3 local = glm::transpose(box.axes) * (center - box.center);
+    const glm::vec3 closest = glm::clamp(local, -box.halfwidths, box.halfwidths);
+    const glm::vec3 d = local - closest;
+    const float distance = glm::length(d);
+    if (distance >= radius) {
+        return false;
+    }
+    glm::vec3 normal;
+    glm::vec3 point;
+    float depth;
+    if (distance > 1e-6f) {
+        normal = d / distance;
+        depth = radius - distance;
+        point = closest - 0.5f * depth * normal;
+    } else {
+        // The center is inside, out through the nearest face
+        const glm::vec3 gap = box.halfwidths - glm::abs(local);
+        uint32_t axis = 0;
+        for (uint32_t i = 1; i < 3; ++i) {
+            if (gap[i] < gap[axis]) {
+                axis = i;
+            }
+        }
+        normal = glm::vec3(0);
+        normal[axis] = local[axis] < 0 ? -1 : 1;
+        depth = radius + gap[axis];
+        point = local;
+    }
+    out.count = 0;
+    out.normal = box.axes * normal;
+    out.add(box.center + box.axes * point, depth);
+    return true;
+}
+
+bool
+cast(const OBB& box, const glm::vec3& origin, const glm::vec3& direction,
+        const float radius, float& distance, glm::vec3& normal) {
+    // In the space of the box, where the slabs are along the axes
+    const glm::vec3 o = glm::transpose(box.axes) * (origin - box.center);
+    const glm::vec3 d = glm::transpose(box.axes) * direction;
+    const glm::vec3 h = box.halfwidths + glm::vec3(radius);
+    float entry = std::numeric_limits<float>::lowest();
+    float leave = std::numeric_limits<float>::max();
+    uint32_t axis = 0;
+    for (uint32_t i = 0; i < 3; ++i) {
+        if (std::abs(d[i]) < PARALLEL) {
+            if (std::abs(o[i]) > h[i]) {
+                return false;
+            }
+            continue;
+        }
+        const float t0 = (-h[i] - o[i]) / d[i];
+        const float t1 = (h[i] - o[i]) / d[i];
+        if (std::min(t0, t1) > entry) {
+            entry = std::min(t0, t1);
+            axis = i;
+        }
+        leave = std::min(leave, std::max(t0, t1));
+    }
+    if (entry > leave || leave < 0 || entry >= distance) {
+        return false;
+    }
+    if (entry < 0) {
+        distance = 0;
+        normal = -direction;
+        return true;
+    }
+    distance = entry;
+    normal = d[axis] < 0 ? box.axes[axis] : -box.axes[axis];
+    return true;
+}
+
+bool
+cast(const glm::vec3& center, const float sphere_radius, const glm::vec3& origin,
+        const glm::vec3& direction, const float radius, float& distance,
+        glm::vec3& normal) {
+    const float reach = sphere_radius + radius;
+    const glm::vec3 m = origin - center;
+    const float b = glm::dot(m, direction);
+    const float c = glm::dot(m, m) - reach * reach;
+    if (c > 0 && b > 0) {
+        return false;
+    }
+    if (c <= 0) {
+        distance = 0;
+        normal = -direction;
+        return true;
+    }
+    const float discriminant = b * b - c;
+    if (discriminant < 0) {
+        return false;
+    }
+    const float t = -b - std::sqrt(discriminant);
+    if (t >= distance) {
+        return false;
+    }
+    distance = t;
+    normal = (m + t * direction) / reach;
+    return true;
+}
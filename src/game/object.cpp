@@ -1,2 +1,52 @@
 #include "game/object.hpp"
-uint32_t Object::COUNT = 0;
+std::atomic<uint32_t> Object::COUNT(0);
+constexpr float Motion::GRAVITY;
+
+void
+BodyStore::remove(const uint32_t index) {
+    const uint32_t last = owner.size() - 1;
+    if (index != last) {
+        position[index] = position[last];
+        velocity[index] = velocity[last];
+        orientation[index] = orientation[last];
+        angular_velocity[index] = angular_velocity[last];
+        halfwidth[index] = halfwidth[last];
+        hits[index] = hits[last];
+        id[index] = id[last];
+        kind[index] = kind[last];
+        owner[index] = owner[last];
+        owner[index]->m_body = index;
+    }
+    position.pop_back();
+    velocity.pop_back();
+    orientation.pop_back();
+    angular_velocity.pop_back();
+    halfwidth.pop_back();
+    hits.pop_back();
+    id.pop_back();
+    kind.pop_back();
+    owner.pop_back();
+}
+
+glm::mat3
+Object::inverse_inertia() const {
+    if (!m_motion.active || !m_motion.rotates) {
+        return glm::mat3(0.f);
+    }
+    // R * I^-1 * R^T with I diagonal in the axes of the body
+    const glm::mat3 r = glm::mat3_cast(this->orientation());
+    const glm::vec3 inverse = 1.f / this->inertia();
+    glm::mat3 scaled = r;
+    for (uint32_t i = 0; i < 3; ++i) {
+        scaled[i] *= inverse[i];
+    }
+    return scaled * glm::transpose(r);
+}
+
+void
+Object::integrate_rotation(const float time_delta) {
+    if (m_motion.rotates) {
+        this->orientation() = turned(this->orientation(), this->angular_velocity(),
+            time_delta);
+    }
+}
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <limits>
+#include "game/occlusion_culler.hpp"
+#include "game/PV112.h"
+
+namespace {
+
+// Margin around the boxes, a box must not hide behind the depth of its own
+// object from the last frame or clip into the near plane
+constexpr float BOX_MARGIN = 0.05f;
+
+} // namespace
+
+OcclusionCuller::OcclusionCuller(const GLint position_loc, const GLint pvm_loc)
+ : m_pvm_loc(pvm_loc)
+{
+    const float vertices[] = {
+        0, 0, 0,  1, 0, 0,  0, 1, 0,  1, 1, 0,
+        0, 0, 1,  1, 0, 1,  0, 1, 1,  1, 1, 1,
+    };
+    const GLuint indices[] = {
+        0, 2, 1,  1, 2, 3,  4, 5, 6,  5, 7, 6,
+        0, 1, 4,  1, 5, 4,  2, 6, 3,  3, 6, 7,
+        0, 4, 2,  2, 4, 6,  1, 3, 5,  3, 7, 5,
+    };
+    m_box_vao = GpuVertexArray::create();
+    glBindVertexArray(m_box_vao.get());
+    m_box_vertices = GpuBuffer::create();
+    m_box_vertices.set_bytes(sizeof(vertices));
+    glBindBuffer(GL_ARRAY_BUFFER, m_box_vertices.get());
+    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(position_loc);
+    glVertexAttribPointer(position_loc, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    m_box_indices = GpuBuffer::create();
+    m_box_indices.set_bytes(sizeof(indices));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_box_indices.get());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+OcclusionCuller::~OcclusionCuller() {
+    for (auto& state : m_states) {
+        glDeleteQueries(1, &state.second.query);
+    }
+}
+
+bool
+OcclusionCuller::bounds(const DrawItem& item, glm::vec3& min, glm::vec3& max) {
+    if (item.mesh == nullptr || item.mesh->Positions.empty()) {
+        return false;
+    }
+    auto found = m_mesh_bounds.find(item.mesh);
+    if (found == m_mesh_bounds.end()) {
+        auto b = std::make_pair(glm::vec3(std::numeric_limits<float>::max()),
+            glm::vec3(std::numeric_limits<float>::lowest()));
+        for (const auto& p : item.mesh->Positions) {
+            b.first = glm::min(b.first, p);
+            b.second = glm::max(b.second, p);
+        }
+        found = m_mesh_bounds.emplace(item.mesh, b).first;
+    }
+    // The scaled mesh box turned by the rotation, and the AABB around it
+    const auto a = item.scale * found->second.first;
+    const auto b = item.scale * found->second.second;
+    const glm::mat3 r = glm::mat3_cast(item.rotation);
+    const glm::vec3 center = item.position + r * (0.5f * (a + b));
+    const glm::vec3 half = 0.5f * glm::abs(b - a);
+    glm::vec3 fitted(0);
+    for (uint32_t i = 0; i < 3; ++i) {
+        fitted += half[i] * glm::abs(r[i]);
+    }
+    min = center - fitted - BOX_MARGIN;
+    max = center + fitted + BOX_MARGIN;
+    return true;
+}
+
+void
+OcclusionCuller::begin_frame() {
+    ++m_frame;
+    m_visible = 0;
+    m_occluded = 0;
+    m_boxes = 0;
+    for (auto& entry : m_states) {
+        auto& state = entry.second;
+        state.issued = false;
+        if (state.pending) {
+            GLint available = GL_FALSE;
+            glGetQueryObjectiv(state.query, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                GLint any = GL_FALSE;
+                glGetQueryObjectiv(state.query, GL_QUERY_RESULT, &any);
+                state.visible = any != GL_FALSE;
+                state.pending = false;
+            }
+        }
+        if (state.visible) {
+            ++m_visible;
+        } else {
+            ++m_occluded;
+        }
+    }
+}
+
+void
+OcclusionCuller::draw_depth(const DrawItem& item,
+        const glm::mat4& projection_view, const glm::vec3& eye,
+        const std::function<void()>& draw) {
+    glm::vec3 min, max;
+    if (!this->bounds(item, min, max)) {
+        draw();
+        return;
+    }
+    auto& state = m_states[item.id];
+    state.frame = m_frame;
+    if (state.query == 0) {
+        glGenQueries(1, &state.query);
+    }
+    // The query is still in flight, keep the last result for another frame
+    if (state.pending) {
+        draw();
+        return;
+    }
+    const bool inside = glm::all(glm::greaterThanEqual(eye, min))
+        && glm::all(glm::lessThanEqual(eye, max));
+
+    if (state.visible || inside) {
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, state.query);
+        draw();
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+    } else {
+        const glm::mat4 box = glm::scale(glm::translate(glm::mat4(1.f), min), max - min);
+        glUniformMatrix4fv(m_pvm_loc, 1, GL_FALSE, glm::value_ptr(projection_view * box));
+        glDepthMask(GL_FALSE);
+        glBeginQuery(GL_ANY_SAMPLES_PASSED, state.query);
+        glBindVertexArray(m_box_vao.get());
+        glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, nullptr);
+        ++m_boxes;
+        glEndQuery(GL_ANY_SAMPLES_PASSED);
+        glDepthMask(GL_TRUE);
+        // Waits on the GPU only, the CPU goes on
+        glBeginConditionalRender(state.query, GL_QUERY_WAIT);
+        draw();
+        glEndConditionalRender();
+    }
+    state.pending = true;
+    state.issued = true;
+}
+
+void
+OcclusionCuller::draw_color(const DrawItem& item,
+        const std::function<void()>& draw) const {
+    const auto found = m_states.find(item.id);
+    if (found == m_states.end() || !found->second.issued) {
+        draw();
+        return;
+    }
+    glBeginConditionalRender(found->second.query, GL_QUERY_WAIT);
+    draw();
+    glEndConditionalRender();
+}
+
+void
+OcclusionCuller::end_frame() {
+    for (auto it = m_states.begin(); it != m_states.end(); ) {
+        if (it->second.frame != m_frame) {
+            glDeleteQueries(1, &it->second.query);
+            it = m_states.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
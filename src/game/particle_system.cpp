@@ -0,0 +1,204 @@
+#include <algorithm>
+#include <cmath>
+#include "game/particle_system.hpp"
+#include "game/object.hpp"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+#if defined(__SSE2__)
+inline __m128 blend(const __m128 mask, const __m128 a, const __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Clamps the positions between 'low' and 'high' and sends the particles that
+// were out back in, slowed by 'restitution'. Returns the ones below 'low'.
+inline __m128 bounce(__m128& p, __m128& v, const __m128 low, const __m128 high,
+        const __m128 restitution) {
+    const __m128 sign = _mm_set1_ps(-0.f);
+    const __m128 below = _mm_cmplt_ps(p, low);
+    const __m128 above = _mm_cmpgt_ps(p, high);
+    const __m128 speed = _mm_mul_ps(_mm_andnot_ps(sign, v), restitution);
+    v = blend(below, speed, blend(above, _mm_or_ps(speed, sign), v));
+    p = _mm_min_ps(_mm_max_ps(p, low), high);
+    return below;
+}
+#endif
+
+inline bool bounce(float& p, float& v, const float low, const float high,
+        const float restitution) {
+    if (p < low) {
+        p = low;
+        v = std::abs(v) * restitution;
+        return true;
+    }
+    if (p > high) {
+        p = high;
+        v = -std::abs(v) * restitution;
+    }
+    return false;
+}
+
+}
+
+constexpr float ParticleSystem::FADE_TIME;
+
+ParticleSystem::ParticleSystem(const ParticleParams& params, const uint32_t seed)
+ : m_params(params), m_rng(seed)
+{}
+
+size_t
+ParticleSystem::emit(const Burst& burst) {
+    const size_t count = std::min<size_t>(burst.count,
+        m_params.budget - std::min<size_t>(m_count, m_params.budget));
+    m_emitted += count;
+    m_dropped += burst.count - count;
+    if (count == 0) {
+        return 0;
+    }
+    this->grow(m_count + count);
+
+    std::normal_distribution<float> scatter(0.f, burst.spread);
+    std::uniform_real_distribution<float> life(0.5f * burst.life, burst.life);
+    for (size_t i = m_count; i < m_count + count; ++i) {
+        m_px[i] = burst.position.x;
+        m_py[i] = burst.position.y;
+        m_pz[i] = burst.position.z;
+        m_vx[i] = burst.velocity.x + scatter(m_rng);
+        m_vy[i] = burst.velocity.y + scatter(m_rng);
+        m_vz[i] = burst.velocity.z + scatter(m_rng);
+        m_life[i] = life(m_rng);
+        m_size[i] = burst.size;
+        m_color[i] = burst.color;
+    }
+    m_count += count;
+    return count;
+}
+
+void
+ParticleSystem::step(const float time_delta) {
+    if (m_count == 0) {
+        return;
+    }
+    this->integrate(time_delta);
+    this->remove_dead();
+}
+
+void
+ParticleSystem::integrate(const float time_delta) {
+    const size_t n = m_count;
+    const float fall = time_delta * Motion::GRAVITY;
+    // Sliding speed kept by the particles on the floor
+    const float keep = std::max(0.f, 1.f - m_params.friction * time_delta);
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 dt = _mm_set1_ps(time_delta);
+    const __m128 g = _mm_set1_ps(fall);
+    const __m128 restitution = _mm_set1_ps(m_params.restitution);
+    const __m128 slide = _mm_set1_ps(keep);
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 min_x = _mm_set1_ps(m_min.x), max_x = _mm_set1_ps(m_max.x);
+    const __m128 min_y = _mm_set1_ps(m_min.y), max_y = _mm_set1_ps(m_max.y);
+    const __m128 min_z = _mm_set1_ps(m_min.z), max_z = _mm_set1_ps(m_max.z);
+    for (; i + 4 <= n; i += 4) {
+        __m128 vx = _mm_loadu_ps(&m_vx[i]);
+        __m128 vy = _mm_sub_ps(_mm_loadu_ps(&m_vy[i]), g);
+        __m128 vz = _mm_loadu_ps(&m_vz[i]);
+        __m128 px = _mm_add_ps(_mm_loadu_ps(&m_px[i]), _mm_mul_ps(vx, dt));
+        __m128 py = _mm_add_ps(_mm_loadu_ps(&m_py[i]), _mm_mul_ps(vy, dt));
+        __m128 pz = _mm_add_ps(_mm_loadu_ps(&m_pz[i]), _mm_mul_ps(vz, dt));
+
+        bounce(px, vx, min_x, max_x, restitution);
+        const __m128 floor = bounce(py, vy, min_y, max_y, restitution);
+        bounce(pz, vz, min_z, max_z, restitution);
+        const __m128 scale = blend(floor, slide, one);
+        vx = _mm_mul_ps(vx, scale);
+        vz = _mm_mul_ps(vz, scale);
+
+        _mm_storeu_ps(&m_px[i], px);
+        _mm_storeu_ps(&m_py[i], py);
+        _mm_storeu_ps(&m_pz[i], pz);
+        _mm_storeu_ps(&m_vx[i], vx);
+        _mm_storeu_ps(&m_vy[i], vy);
+        _mm_storeu_ps(&m_vz[i], vz);
+        _mm_storeu_ps(&m_life[i], _mm_sub_ps(_mm_loadu_ps(&m_life[i]), dt));
+    }
+#endif
+    for (; i < n; ++i) {
+        m_vy[i] -= fall;
+        m_px[i] += m_vx[i] * time_delta;
+        m_py[i] += m_vy[i] * time_delta;
+        m_pz[i] += m_vz[i] * time_delta;
+
+        bounce(m_px[i], m_vx[i], m_min.x, m_max.x, m_params.restitution);
+        if (bounce(m_py[i], m_vy[i], m_min.y, m_max.y, m_params.restitution)) {
+            m_vx[i] *= keep;
+            m_vz[i] *= keep;
+        }
+        bounce(m_pz[i], m_vz[i], m_min.z, m_max.z, m_params.restitution);
+        m_life[i] -= time_delta;
+    }
+}
+
+void
+ParticleSystem::remove_dead() {
+    size_t i = 0;
+    while (i < m_count) {
+        if (m_life[i] > 0) {
+            ++i;
+            continue;
+        }
+        // The last one may be dead too, it is checked again in its new place
+        const size_t last = --m_count;
+        m_px[i] = m_px[last];
+        m_py[i] = m_py[last];
+        m_pz[i] = m_pz[last];
+        m_vx[i] = m_vx[last];
+        m_vy[i] = m_vy[last];
+        m_vz[i] = m_vz[last];
+        m_life[i] = m_life[last];
+        m_size[i] = m_size[last];
+        m_color[i] = m_color[last];
+    }
+}
+
+void
+ParticleSystem::grow(const size_t count) {
+    if (count <= m_px.size()) {
+        return;
+    }
+    // Doubling, but never past the budget
+    const size_t capacity = std::min<size_t>(std::max<size_t>(count, 2 * m_px.size()),
+        std::max<size_t>(count, m_params.budget));
+    for (auto array : {&m_px, &m_py, &m_pz, &m_vx, &m_vy, &m_vz, &m_life, &m_size}) {
+        array->resize(capacity);
+    }
+    m_color.resize(capacity);
+}
+
+void
+ParticleSystem::describe(std::vector<ParticleVertex>& vertices) const {
+    const size_t first = vertices.size();
+    vertices.resize(first + m_count);
+    for (size_t i = 0; i < m_count; ++i) {
+        auto& vertex = vertices[first + i];
+        vertex.position = glm::vec3(m_px[i], m_py[i], m_pz[i]);
+        vertex.size = m_size[i] * std::min(1.f, m_life[i] / FADE_TIME);
+        vertex.velocity = glm::vec3(m_vx[i], m_vy[i], m_vz[i]);
+        vertex.color = m_color[i];
+    }
+}
+
+ParticleSystem::Stats
+ParticleSystem::get_stats() const {
+    Stats stats;
+    stats.count = m_count;
+    stats.capacity = m_px.size();
+    stats.budget = m_params.budget;
+    stats.emitted = m_emitted;
+    stats.dropped = m_dropped;
+    return stats;
+}
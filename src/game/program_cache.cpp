@@ -0,0 +1,330 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "game/program_cache.hpp"
+#include "game/PV112.h"
+
+namespace {
+
+// FNV-1a, the strings are separated so "ab" + "c" differs from "a" + "bc"
+uint64_t
+hash(uint64_t h, const std::string& s) {
+    for (const char c : s) {
+        h = (h ^ uint8_t(c)) * 1099511628211ull;
+    }
+    return (h ^ 0xff) * 1099511628211ull;
+}
+
+std::string
+file_name(const std::string& path) {
+    const auto slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Puts the defines after the #version line, which has to come first
+std::string
+with_defines(const std::string& source, const std::string& defines) {
+    if (defines.empty()) {
+        return source;
+    }
+    size_t line = 0;
+    const auto version = source.find("#version");
+    if (version != std::string::npos) {
+        line = source.find('\n', version);
+        line = line == std::string::npos ? source.size() : line + 1;
+    }
+    return source.substr(0, line) + defines + source.substr(line);
+}
+
+std::string
+gl_string(const GLenum name) {
+    const auto s = reinterpret_cast<const char*>(glGetString(name));
+    return s ? s : "";
+}
+
+} // namespace
+
+ProgramCache::ProgramCache(const std::string& directory)
+ : m_directory(directory),
+   m_binaries(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)
+{
+    if (m_binaries) {
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        m_binaries = formats > 0;
+    }
+    if (m_binaries && mkdir(m_directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        std::cout << "Cannot create the shader cache " << m_directory << std::endl;
+        m_binaries = false;
+    }
+    m_driver = gl_string(GL_VENDOR) + "\n" + gl_string(GL_RENDERER) + "\n"
+        + gl_string(GL_VERSION);
+}
+
+ProgramCache::~ProgramCache() {
+    if (m_inotify >= 0) {
+        close(m_inotify);
+    }
+}
+
+bool
+ProgramCache::read(const Program& program, std::string& vertex_source,
+        std::string& fragment_source) const {
+    vertex_source = PV112::LoadFileToString(program.vertex.c_str());
+    fragment_source = PV112::LoadFileToString(program.fragment.c_str());
+    if (vertex_source.empty() || fragment_source.empty()) {
+        return false;
+    }
+    vertex_source = with_defines(vertex_source, program.defines);
+    fragment_source = with_defines(fragment_source, program.defines);
+    return true;
+}
+
+uint64_t
+ProgramCache::key(const Program& program, const std::string& vertex_source,
+        const std::string& fragment_source) const {
+    uint64_t h = 14695981039346656037ull;
+    h = hash(h, m_driver);
+    h = hash(h, vertex_source);
+    h = hash(h, fragment_source);
+    for (const auto& attribute : program.attributes) {
+        h = hash(h, std::to_string(attribute.first) + attribute.second);
+    }
+    return h;
+}
+
+std::string
+ProgramCache::path(const uint64_t key) const {
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", (unsigned long long)key);
+    return m_directory + "/" + name + ".bin";
+}
+
+GLuint
+ProgramCache::load_binary(const uint64_t key) {
+    if (!m_binaries) {
+        return 0;
+    }
+    std::ifstream file(this->path(key), std::ios::binary | std::ios::ate);
+    if (!file || file.tellg() <= std::streamoff(sizeof(GLenum))) {
+        return 0;
+    }
+    std::vector<char> binary(size_t(file.tellg()) - sizeof(GLenum));
+    GLenum format;
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(&format), sizeof(format));
+    file.read(binary.data(), binary.size());
+    if (!file) {
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, binary.data(), binary.size());
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status == GL_FALSE) {
+        // A driver update may reject old binaries, the sources are rebuilt
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+size_t
+ProgramCache::binary_size(const GLuint program) const {
+    if (!m_binaries) {
+        return 0;
+    }
+    GLint size = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+    return std::max(size, 0);
+}
+
+void
+ProgramCache::store_binary(const uint64_t key, const GLuint program) const {
+    const size_t size = this->binary_size(program);
+    if (size == 0) {
+        return;
+    }
+    std::vector<char> binary(size);
+    GLenum format;
+    glGetProgramBinary(program, size, nullptr, &format, binary.data());
+    std::ofstream file(this->path(key), std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char*>(&format), sizeof(format));
+    file.write(binary.data(), binary.size());
+}
+
+GLuint
+ProgramCache::compile(const Program& program, const std::string& vertex_source,
+        const std::string& fragment_source) const {
+    const GLuint vs = PV112::CompileShader(GL_VERTEX_SHADER, vertex_source,
+        program.vertex.c_str());
+    if (vs == 0) {
+        return 0;
+    }
+    const GLuint fs = PV112::CompileShader(GL_FRAGMENT_SHADER, fragment_source,
+        program.fragment.c_str());
+    if (fs == 0) {
+        glDeleteShader(vs);
+        return 0;
+    }
+    GLuint id = glCreateProgram();
+    glAttachShader(id, vs);
+    glAttachShader(id, fs);
+    for (const auto& attribute : program.attributes) {
+        glBindAttribLocation(id, attribute.first, attribute.second.c_str());
+    }
+    if (m_binaries) {
+        glProgramParameteri(id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(id);
+    // The shaders go away with the program
+    glDetachShader(id, vs);
+    glDetachShader(id, fs);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    return id;
+}
+
+bool
+ProgramCache::linked(const GLuint program, const Program& source) const {
+    if (program == 0) {
+        return false;
+    }
+    GLint status = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &status);
+    if (status != GL_FALSE) {
+        return true;
+    }
+    std::cout << "Failed to link program with vertex shader " << source.vertex
+              << " and fragment shader " << source.fragment << std::endl;
+    GLint length = 0;
+    glGetProgramiv(program, GL_INFO_LOG_LENGTH, &length);
+    std::string log(std::max(length, 1), '\0');
+    glGetProgramInfoLog(program, length, nullptr, &log[0]);
+    std::cout << log.c_str() << std::endl;
+    return false;
+}
+
+GLuint
+ProgramCache::load(const std::string& vertex, const std::string& fragment,
+        const Attributes& attributes, const std::string& defines,
+        ReloadCallback on_reload) {
+    std::unique_ptr<Program> program(new Program());
+    program->vertex = vertex;
+    program->fragment = fragment;
+    program->attributes = attributes;
+    program->defines = defines;
+    program->on_reload = std::move(on_reload);
+
+    std::string vertex_source, fragment_source;
+    if (!this->read(*program, vertex_source, fragment_source)) {
+        std::cout << "Shader " << vertex << " or " << fragment
+                  << " is empty or failed to load" << std::endl;
+        return 0;
+    }
+    const uint64_t key = this->key(*program, vertex_source, fragment_source);
+    GLuint id = this->load_binary(key);
+    if (id != 0) {
+        ++m_hits;
+        program->id = GpuProgram(id);
+    } else {
+        ++m_misses;
+        program->id = GpuProgram(this->compile(*program, vertex_source, fragment_source));
+        if (!this->linked(program->id.get(), *program)) {
+            return 0;
+        }
+        this->store_binary(key, program->id.get());
+    }
+    program->id.set_bytes(this->binary_size(program->id.get()));
+    m_programs.push_back(std::move(program));
+    return m_programs.back()->id.get();
+}
+
+bool
+ProgramCache::watch(const std::string& directory) {
+    if (m_inotify < 0) {
+        m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+    // Editors either rewrite the file or move a new one over it
+    if (m_inotify < 0 || inotify_add_watch(m_inotify, directory.c_str(),
+            IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        std::cout << "Cannot watch " << directory << " for shader changes"
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void
+ProgramCache::poll_watcher() {
+    alignas(inotify_event) char buffer[4096];
+    while (true) {
+        const ssize_t length = ::read(m_inotify, buffer, sizeof(buffer));
+        if (length <= 0) {
+            return;
+        }
+        for (ssize_t offset = 0; offset < length; ) {
+            const auto event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + event->len;
+            if (event->len == 0) {
+                continue;
+            }
+            const std::string name(event->name);
+            for (auto& program : m_programs) {
+                if (file_name(program->vertex) == name
+                        || file_name(program->fragment) == name) {
+                    program->changed = true;
+                }
+            }
+        }
+    }
+}
+
+void
+ProgramCache::start_reload(Program& program) {
+    std::string vertex_source, fragment_source;
+    if (!this->read(program, vertex_source, fragment_source)) {
+        // Caught in the middle of a save, the next event tries again
+        return;
+    }
+    program.pending_key = this->key(program, vertex_source, fragment_source);
+    // Going back to an earlier version finds it in the cache
+    GLuint pending = this->load_binary(program.pending_key);
+    if (pending == 0) {
+        pending = this->compile(program, vertex_source, fragment_source);
+    }
+    program.pending = GpuProgram(pending);
+}
+
+void
+ProgramCache::update() {
+    if (m_inotify >= 0) {
+        this->poll_watcher();
+    }
+    for (auto& program : m_programs) {
+        if (program->pending) {
+            // A program that failed to link is released with the handle
+            GpuProgram pending = std::move(program->pending);
+            if (this->linked(pending.get(), *program)) {
+                this->store_binary(program->pending_key, pending.get());
+                pending.set_bytes(this->binary_size(pending.get()));
+                if (program->on_reload) {
+                    program->on_reload(pending.get());
+                }
+                // The old program is deleted between frames
+                program->id = std::move(pending);
+                ++m_reloads;
+            }
+        }
+        if (program->changed) {
+            program->changed = false;
+            this->start_reload(*program);
+        }
+    }
+}
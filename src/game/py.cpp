@@ -1,5 +1,15 @@
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <pybind11/functional.h>
+#include <pybind11/numpy.h>
 #include "game/py.hpp"
 #include "game/game.hpp"
+#include "game/scene_query.hpp"
+#include "game/vec_world.hpp"
+#include "game/world.hpp"
 
 PYBIND11_PLUGIN(_game) {
     pybind11::module m("_game");
@@ -9,14 +19,473 @@ PYBIND11_PLUGIN(_game) {
 
 namespace game {
 
+namespace {
+
+using FloatArray = py::array_t<float, py::array::c_style | py::array::forcecast>;
+using IdArray = py::array_t<uint32_t, py::array::c_style | py::array::forcecast>;
+
+// What Python holds of the bodies of a world. It shares the world, so the
+// world outlives it and every array viewing the bodies, past the end of the
+// game or the rebuild of a batched world.
+struct Bodies {
+    std::shared_ptr<World> world;
+
+    BodyStore& store() const {
+        return world->get_bodies();
+    }
+};
+
+// What Python holds of the queries of a world. Like Bodies it shares the
+// world, and it asks the world for its tree on every call, so the tree is
+// rebuilt after the world changed instead of reading objects that moved or
+// went away.
+struct Queries {
+    std::shared_ptr<World> world;
+
+    const SceneQuery& get() const {
+        return world->queries();
+    }
+};
+
+// View of one column of the bodies of 'self', a Bodies object. The array
+// keeps 'self' alive, which keeps the world and the arrays its store moved
+// out of alive. 'stride' is the bytes from one row to the next.
+template <class T>
+py::array_t<T> column(py::object self, T* data, const size_t stride,
+        const size_t width) {
+    const size_t count = self.cast<const Bodies&>().store().size();
+    if (width == 1) {
+        return py::array_t<T>({count}, {stride}, data, self);
+    }
+    return py::array_t<T>({count, width}, {stride, sizeof(T)}, data, self);
+}
+
+py::array_t<float> vec3_column(py::object self,
+        std::vector<glm::vec3> BodyStore::*member) {
+    auto& store = self.cast<const Bodies&>().store();
+    auto data = reinterpret_cast<float*>((store.*member).data());
+    return column(self, data, sizeof(glm::vec3), 3);
+}
+
+// Number of rows of 'array', which has to be (count, width) or (count,)
+size_t rows(const FloatArray& array, const size_t width, const char* name) {
+    const auto info = array.request();
+    const bool ok = width == 1 ? info.ndim == 1
+        : info.ndim == 2 && size_t(info.shape[1]) == width;
+    if (!ok) {
+        throw std::invalid_argument(std::string(name) + " has a wrong shape");
+    }
+    return info.shape[0];
+}
+
+void check_count(const size_t count, const size_t expected) {
+    if (count != expected) {
+        throw std::invalid_argument("arrays differ in length");
+    }
+}
+
+// The game calls the callback on its simulation thread. The wrapper takes the
+// GIL to call the Python function and to drop the last reference to it.
+std::function<void(float)> with_gil(py::object callback) {
+    if (callback.is_none()) {
+        return nullptr;
+    }
+    std::shared_ptr<py::object> function(new py::object(std::move(callback)),
+        [](py::object* f) {
+            py::gil_scoped_acquire gil;
+            delete f;
+        });
+    return [function](const float time_delta) {
+        py::gil_scoped_acquire gil;
+        (*function)(time_delta);
+    };
+}
+
+py::array_t<uint32_t> to_array(const std::vector<uint32_t>& ids) {
+    return py::array_t<uint32_t>(ids.size(), ids.data());
+}
+
+glm::vec3 to_vec3(const FloatArray& array, const char* name) {
+    check_count(rows(array, 1, name), 3);
+    return glm::make_vec3(array.data());
+}
+
+py::tuple to_tuple(const glm::vec3& v) {
+    return py::make_tuple(v.x, v.y, v.z);
+}
+
+// Batched hits as arrays of ids, NO_HIT for a miss, distances, points and
+// normals
+py::tuple to_arrays(const std::vector<SceneQuery::Hit>& hits) {
+    py::array_t<uint32_t> ids(hits.size());
+    py::array_t<float> distances(hits.size());
+    py::array_t<float> points({hits.size(), size_t(3)});
+    py::array_t<float> normals({hits.size(), size_t(3)});
+    for (size_t i = 0; i < hits.size(); ++i) {
+        ids.mutable_data()[i] = hits[i].id;
+        distances.mutable_data()[i] = hits[i].distance;
+        std::copy_n(glm::value_ptr(hits[i].point), 3, points.mutable_data() + 3 * i);
+        std::copy_n(glm::value_ptr(hits[i].normal), 3, normals.mutable_data() + 3 * i);
+    }
+    return py::make_tuple(ids, distances, points, normals);
+}
+
+}
+
 void py_bind(py::module& m) {
+    py::class_<SceneParams>(m, "SceneParams")
+    .def(py::init<>())
+    .def_readwrite("seed",              &SceneParams::seed)
+    .def_readwrite("arena_half_extent", &SceneParams::arena_half_extent)
+    .def_readwrite("box_count",         &SceneParams::box_count)
+    .def_readwrite("enemy_count",       &SceneParams::enemy_count)
+    .def_readwrite("ball_count",        &SceneParams::ball_count)
+    .def("scaled",       &SceneParams::scaled)
+    .def("object_count", &SceneParams::object_count);
+
+    py::class_<SolverParams>(m, "SolverParams")
+    .def(py::init<>())
+    .def_readwrite("velocity_iterations", &SolverParams::velocity_iterations)
+    .def_readwrite("position_iterations", &SolverParams::position_iterations)
+    .def_readwrite("baumgarte",           &SolverParams::baumgarte)
+    .def_readwrite("slop",                &SolverParams::slop)
+    .def_readwrite("restitution",         &SolverParams::restitution)
+    .def_readwrite("restitution_threshold", &SolverParams::restitution_threshold)
+    .def_readwrite("friction",            &SolverParams::friction)
+    .def_readwrite("warm_start",          &SolverParams::warm_start)
+    .def_readwrite("rotation",            &SolverParams::rotation);
+
+    // The method is one of the module constants SEMI_IMPLICIT_EULER and
+    // VELOCITY_VERLET
+    m.attr("SEMI_IMPLICIT_EULER") = py::int_(int(IntegratorParams::SEMI_IMPLICIT_EULER));
+    m.attr("VELOCITY_VERLET")     = py::int_(int(IntegratorParams::VELOCITY_VERLET));
+    py::class_<IntegratorParams>(m, "IntegratorParams")
+    .def(py::init<>())
+    .def_property("method",
+        [](const IntegratorParams& p) { return int(p.method); },
+        [](IntegratorParams& p, int method) {
+            if (method != IntegratorParams::SEMI_IMPLICIT_EULER
+                    && method != IntegratorParams::VELOCITY_VERLET) {
+                throw std::invalid_argument("unknown integration method");
+            }
+            p.method = IntegratorParams::Method(method);
+        })
+    .def_readwrite("max_time_delta", &IntegratorParams::max_time_delta)
+    .def_readwrite("max_travel",     &IntegratorParams::max_travel)
+    .def_readwrite("max_substeps",   &IntegratorParams::max_substeps);
+
+    py::class_<Integrator::Stats>(m, "IntegratorStats")
+    .def_readonly("substeps",     &Integrator::Stats::substeps)
+    .def_readonly("fast_bodies",  &Integrator::Stats::fast_bodies)
+    .def_readonly("capped_steps", &Integrator::Stats::capped_steps)
+    .def_readonly("clamped_time", &Integrator::Stats::clamped_time);
+
+    py::class_<ParticleParams>(m, "ParticleParams")
+    .def(py::init<>())
+    .def_readwrite("budget",           &ParticleParams::budget)
+    .def_readwrite("restitution",      &ParticleParams::restitution)
+    .def_readwrite("friction",         &ParticleParams::friction)
+    .def_readwrite("sparks_per_hit",   &ParticleParams::sparks_per_hit)
+    .def_readwrite("debris_per_death", &ParticleParams::debris_per_death);
+
+    py::class_<ParticleSystem::Stats>(m, "ParticleStats")
+    .def_readonly("count",    &ParticleSystem::Stats::count)
+    .def_readonly("capacity", &ParticleSystem::Stats::capacity)
+    .def_readonly("budget",   &ParticleSystem::Stats::budget)
+    .def_readonly("emitted",  &ParticleSystem::Stats::emitted)
+    .def_readonly("dropped",  &ParticleSystem::Stats::dropped);
+
     py::class_<GameOptions>(m, "Options")
     .def(py::init<>())
     .def_readwrite("machine_gun", &GameOptions::machine_gun)
     .def_readwrite("game_time",   &GameOptions::game_time)
-    .def_readwrite("ball_time",   &GameOptions::ball_time);
+    .def_readwrite("ball_time",   &GameOptions::ball_time)
+    .def_readwrite("enemy_delay", &GameOptions::enemy_delay)
+    .def_readwrite("scene",       &GameOptions::scene)
+    .def_readwrite("solver",      &GameOptions::solver)
+    .def_readwrite("integrator",  &GameOptions::integrator)
+    .def_readwrite("particles",   &GameOptions::particles)
+    .def_readwrite("tick_rate",   &GameOptions::tick_rate)
+    .def_readwrite("render_rate", &GameOptions::render_rate)
+    .def_readwrite("threaded_simulation", &GameOptions::threaded_simulation)
+    .def_readwrite("depth_prepass", &GameOptions::depth_prepass)
+    .def_readwrite("occlusion_culling", &GameOptions::occlusion_culling)
+    .def_readwrite("hot_reload_shaders", &GameOptions::hot_reload_shaders)
+    .def_readwrite("verbose",     &GameOptions::verbose)
+    .def_readwrite("offscreen",   &GameOptions::offscreen)
+    .def_readwrite("width",       &GameOptions::width)
+    .def_readwrite("height",      &GameOptions::height)
+    .def_readwrite("frames",      &GameOptions::frames)
+    .def_property("on_frame",
+        [](const GameOptions& o) { return o.on_frame; },
+        [](GameOptions& o, py::object callback) { o.on_frame = with_gil(callback); })
+    .def_property("enemy_count",
+        [](const GameOptions& o) { return o.scene.enemy_count; },
+        [](GameOptions& o, uint32_t count) { o.scene.enemy_count = count; });
+
+    py::class_<PhaseTiming>(m, "PhaseTiming")
+    .def_readonly("name",    &PhaseTiming::name)
+    .def_readonly("last_ms", &PhaseTiming::last_ms)
+    .def_readonly("avg_ms",  &PhaseTiming::avg_ms)
+    .def_readonly("max_ms",  &PhaseTiming::max_ms)
+    .def_readonly("samples", &PhaseTiming::samples)
+    .def_readonly("last_allocations", &PhaseTiming::last_allocations);
+
+    py::class_<RenderStats>(m, "RenderStats")
+    .def_readonly("triangles",       &RenderStats::triangles)
+    .def_readonly("pixels",          &RenderStats::pixels)
+    .def_readonly("shaded_samples",  &RenderStats::shaded_samples)
+    .def_readonly("prepass_samples", &RenderStats::prepass_samples)
+    .def_readonly("state_changes",   &RenderStats::state_changes)
+    .def_readonly("program_switches", &RenderStats::program_switches)
+    .def_readonly("draw_calls",      &RenderStats::draw_calls)
+    .def_readonly("visible_objects", &RenderStats::visible_objects)
+    .def_readonly("occluded_objects", &RenderStats::occluded_objects)
+    .def_property_readonly("overdraw", [](const RenderStats& s) {
+        return s.pixels ? double(s.shaded_samples) / s.pixels : 0.;
+    });
+
+    py::class_<FrameRecord>(m, "FrameRecord")
+    .def_readonly("cpu_ms",     &FrameRecord::cpu_ms)
+    .def_readonly("gpu_ms",     &FrameRecord::gpu_ms)
+    .def_readonly("draw_calls", &FrameRecord::draw_calls)
+    .def_readonly("triangles",  &FrameRecord::triangles)
+    .def_readonly("allocations", &FrameRecord::allocations);
+
+    // Arrays returned by the properties share memory with the simulation.
+    // They have to be fetched again after spawning or despawning objects,
+    // and an array of a world that was rebuilt or whose store grew past its
+    // capacity shows the bodies as they were then.
+    py::class_<Bodies>(m, "Bodies")
+    .def("__len__", [](const Bodies& self) {
+        return self.store().size();
+    })
+    .def_property_readonly("capacity", [](const Bodies& self) {
+        return self.store().capacity();
+    })
+    .def_property_readonly("positions", [](py::object self) {
+        return vec3_column(self, &BodyStore::position);
+    })
+    .def_property_readonly("velocities", [](py::object self) {
+        return vec3_column(self, &BodyStore::velocity);
+    })
+    // Unit quaternions as x, y, z, w, the AABB of a static body is not
+    // refitted when they are written
+    .def_property_readonly("orientations", [](py::object self) {
+        auto& store = self.cast<const Bodies&>().store();
+        auto data = reinterpret_cast<float*>(store.orientation.data());
+        return column(self, data, sizeof(glm::quat), 4);
+    })
+    .def_property_readonly("angular_velocities", [](py::object self) {
+        return vec3_column(self, &BodyStore::angular_velocity);
+    })
+    // AABB of a body is its position +- halfwidths
+    .def_property_readonly("halfwidths", [](py::object self) {
+        return vec3_column(self, &BodyStore::halfwidth);
+    })
+    .def_property_readonly("hits", [](py::object self) {
+        auto& store = self.cast<const Bodies&>().store();
+        return column(self, store.hits.data(), sizeof(uint32_t), 1);
+    })
+    .def_property_readonly("ids", [](py::object self) {
+        auto& store = self.cast<const Bodies&>().store();
+        return column(self, store.id.data(), sizeof(uint32_t), 1);
+    })
+    .def_property_readonly("kinds", [](py::object self) {
+        auto& store = self.cast<const Bodies&>().store();
+        return column(self, store.kind.data(), sizeof(uint8_t), 1);
+    });
+
+    m.attr("STATIC") = py::int_(int(BodyStore::STATIC));
+    m.attr("BALL")   = py::int_(int(BodyStore::BALL));
+    m.attr("BOX")    = py::int_(int(BodyStore::BOX));
+    m.attr("ENEMY")  = py::int_(int(BodyStore::ENEMY));
+
+    m.attr("NO_HIT")    = py::int_(SceneQuery::NONE);
+    m.attr("ALL_KINDS") = py::int_(SceneQuery::ALL_KINDS);
+
+    py::class_<SceneQuery::Hit>(m, "Hit")
+    .def_readonly("id",       &SceneQuery::Hit::id)
+    .def_readonly("distance", &SceneQuery::Hit::distance)
+    .def_property_readonly("point", [](const SceneQuery::Hit& hit) {
+        return to_tuple(hit.point);
+    })
+    .def_property_readonly("normal", [](const SceneQuery::Hit& hit) {
+        return to_tuple(hit.normal);
+    });
+
+    // Queries read the objects in place, ask them while the world does not
+    // step, e.g. in on_frame. The tree is rebuilt when the world changed
+    // since the last query. 'kinds' is a mask of 1 << STATIC, BALL, ... and
+    // 'ignore' an id never hit. The batched variants take (count, 3) arrays.
+    const float FAR = std::numeric_limits<float>::infinity();
+    py::class_<Queries>(m, "SceneQuery")
+    .def("__len__", [](const Queries& self) {
+        return self.get().size();
+    })
+    .def("raycast", [](const Queries& self, FloatArray origin,
+            FloatArray direction, float max_distance, uint32_t kinds,
+            uint32_t ignore) -> py::object {
+        SceneQuery::Hit hit;
+        if (!self.get().raycast(to_vec3(origin, "origin"),
+                to_vec3(direction, "direction"), max_distance, hit, {kinds, ignore})) {
+            return py::none();
+        }
+        return py::cast(hit);
+    }, py::arg("origin"), py::arg("direction"), py::arg("max_distance") = FAR,
+        py::arg("kinds") = SceneQuery::ALL_KINDS, py::arg("ignore") = SceneQuery::NONE)
+    .def("raycast_all", [](const Queries& self, FloatArray origin,
+            FloatArray direction, float max_distance, uint32_t kinds,
+            uint32_t ignore) {
+        std::vector<SceneQuery::Hit> hits;
+        self.get().raycast_all(to_vec3(origin, "origin"),
+            to_vec3(direction, "direction"), max_distance, hits, {kinds, ignore});
+        return hits;
+    }, py::arg("origin"), py::arg("direction"), py::arg("max_distance") = FAR,
+        py::arg("kinds") = SceneQuery::ALL_KINDS, py::arg("ignore") = SceneQuery::NONE)
+    .def("sweep", [](const Queries& self, FloatArray center, float radius,
+            FloatArray direction, float max_distance, uint32_t kinds,
+            uint32_t ignore) -> py::object {
+        SceneQuery::Hit hit;
+        if (!self.get().sweep(to_vec3(center, "center"), radius,
+                to_vec3(direction, "direction"), max_distance, hit, {kinds, ignore})) {
+            return py::none();
+        }
+        return py::cast(hit);
+    }, py::arg("center"), py::arg("radius"), py::arg("direction"),
+        py::arg("max_distance") = FAR, py::arg("kinds") = SceneQuery::ALL_KINDS,
+        py::arg("ignore") = SceneQuery::NONE)
+    .def("overlap", [](const Queries& self, FloatArray min, FloatArray max,
+            uint32_t kinds, uint32_t ignore) {
+        std::vector<uint32_t> ids;
+        self.get().overlap(to_vec3(min, "min"), to_vec3(max, "max"), ids, {kinds, ignore});
+        return to_array(ids);
+    }, py::arg("min"), py::arg("max"), py::arg("kinds") = SceneQuery::ALL_KINDS,
+        py::arg("ignore") = SceneQuery::NONE)
+    .def("raycast_batch", [](const Queries& self, FloatArray origins,
+            FloatArray directions, float max_distance, uint32_t kinds,
+            uint32_t ignore) {
+        const size_t count = rows(origins, 3, "origins");
+        check_count(rows(directions, 3, "directions"), count);
+        std::vector<SceneQuery::Hit> hits(count);
+        {
+            py::gil_scoped_release release;
+            self.get().raycast(origins.data(), directions.data(), count, max_distance,
+                hits.data(), {kinds, ignore});
+        }
+        return to_arrays(hits);
+    }, py::arg("origins"), py::arg("directions"), py::arg("max_distance") = FAR,
+        py::arg("kinds") = SceneQuery::ALL_KINDS, py::arg("ignore") = SceneQuery::NONE)
+    .def("sweep_batch", [](const Queries& self, FloatArray centers,
+            float radius, FloatArray directions, float max_distance,
+            uint32_t kinds, uint32_t ignore) {
+        const size_t count = rows(centers, 3, "centers");
+        check_count(rows(directions, 3, "directions"), count);
+        std::vector<SceneQuery::Hit> hits(count);
+        {
+            py::gil_scoped_release release;
+            self.get().sweep(centers.data(), radius, directions.data(), count,
+                max_distance, hits.data(), {kinds, ignore});
+        }
+        return to_arrays(hits);
+    }, py::arg("centers"), py::arg("radius"), py::arg("directions"),
+        py::arg("max_distance") = FAR, py::arg("kinds") = SceneQuery::ALL_KINDS,
+        py::arg("ignore") = SceneQuery::NONE);
+
+    // The simulation thread needs the GIL for on_frame while the game runs
+    m.def("run", [](const GameOptions& opts) {
+        py::gil_scoped_release release;
+        return run_game(opts);
+    });
+    m.def("timings", last_timings);
+    m.def("render_stats", last_render_stats);
+    m.def("frames", last_frames);
+    m.def("bodies", [] {
+        return Bodies{game_world()};
+    });
+    m.def("queries", [] {
+        return Queries{game_world()};
+    });
+
+    m.def("spawn_balls", [](FloatArray positions, FloatArray velocities,
+            FloatArray radii) {
+        const size_t count = rows(positions, 3, "positions");
+        check_count(rows(velocities, 3, "velocities"), count);
+        check_count(rows(radii, 1, "radii"), count);
+        return to_array(spawn_balls(positions.data(), velocities.data(),
+            radii.data(), count));
+    });
+    m.def("spawn_boxes", [](FloatArray positions, FloatArray velocities) {
+        const size_t count = rows(positions, 3, "positions");
+        check_count(rows(velocities, 3, "velocities"), count);
+        return to_array(spawn_boxes(positions.data(), velocities.data(), count));
+    });
+    m.def("spawn_enemies", [](FloatArray positions, FloatArray scales) {
+        const size_t count = rows(positions, 3, "positions");
+        check_count(rows(scales, 1, "scales"), count);
+        return to_array(spawn_enemies(positions.data(), scales.data(), count));
+    });
+    m.def("despawn", [](IdArray ids) {
+        return despawn(ids.data(), ids.size());
+    });
 
-    m.def("run", run_game);
+    // Observations, rewards and dones are fresh arrays written by the worlds
+    // directly, the GIL is released while the worlds are stepped.
+    py::class_<VecWorld>(m, "VecWorld")
+    .def(py::init<const GameOptions&, uint32_t, uint32_t>(),
+        py::arg("opts"), py::arg("count"), py::arg("threads") = 0)
+    .def("__len__", &VecWorld::size)
+    .def_property_readonly_static("action_size", [](py::object) {
+        return VecWorld::ACTION_SIZE;
+    })
+    .def_property_readonly_static("observation_size", [](py::object) {
+        return VecWorld::OBSERVATION_SIZE;
+    })
+    .def("reset", [](VecWorld& self) {
+        py::array_t<float> obs({self.size(), size_t(VecWorld::OBSERVATION_SIZE)});
+        float* obs_data = obs.mutable_data();
+        {
+            py::gil_scoped_release release;
+            self.reset(obs_data);
+        }
+        return obs;
+    })
+    .def("step", [](VecWorld& self, FloatArray actions, const float time_delta) {
+        const auto info = actions.request();
+        if (info.ndim != 2 || size_t(info.shape[0]) != self.size()
+                || info.shape[1] != VecWorld::ACTION_SIZE) {
+            throw std::invalid_argument("actions have to be (worlds, action_size)");
+        }
+        py::array_t<float> obs({self.size(), size_t(VecWorld::OBSERVATION_SIZE)});
+        py::array_t<float> rewards(self.size());
+        py::array_t<bool> dones(self.size());
+        const float* action_data = actions.data();
+        float* obs_data = obs.mutable_data();
+        float* reward_data = rewards.mutable_data();
+        auto done_data = reinterpret_cast<uint8_t*>(dones.mutable_data());
+        {
+            py::gil_scoped_release release;
+            self.step(time_delta, action_data, obs_data, reward_data, done_data);
+        }
+        return py::make_tuple(obs, rewards, dones);
+    }, py::arg("actions"), py::arg("time_delta") = 1.f / 60)
+    // The batch stays alive as long as the bodies, the worlds record into its
+    // profilers
+    .def("bodies", [](VecWorld& self, size_t index) {
+        return Bodies{self.share(index)};
+    }, py::keep_alive<0, 1>())
+    .def("queries", [](VecWorld& self, size_t index) {
+        return Queries{self.share(index)};
+    }, py::keep_alive<0, 1>())
+    .def("integrator", [](VecWorld& self, size_t index) {
+        return self.get(index).get_integrator().get_stats();
+    })
+    .def("particles", [](VecWorld& self, size_t index) {
+        return self.get(index).get_particles().get_stats();
+    })
+    .def("timings", [](const VecWorld& self, size_t index) {
+        return self.get_profiler(index).get_phases();
+    });
 
 }
 
@@ -0,0 +1,39 @@
+#include "game/query_counter.hpp"
+
+constexpr size_t QueryCounter::FRAMES;
+
+QueryCounter::QueryCounter(const GLenum target)
+ : m_target(target)
+{
+    glGenQueries(FRAMES, m_queries.data());
+    m_pending.fill(false);
+}
+
+QueryCounter::~QueryCounter() {
+    glDeleteQueries(FRAMES, m_queries.data());
+}
+
+void
+QueryCounter::begin() {
+    // Collect the oldest query before reusing it
+    const GLuint query = m_queries[m_frame];
+    if (m_pending[m_frame]) {
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 result = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &result);
+            m_result = result;
+        }
+        // An unavailable result is dropped, beginning the query discards it
+        m_pending[m_frame] = false;
+    }
+    glBeginQuery(m_target, query);
+}
+
+void
+QueryCounter::end() {
+    glEndQuery(m_target);
+    m_pending[m_frame] = true;
+    m_frame = (m_frame + 1) % FRAMES;
+}
@@ -0,0 +1,74 @@
+#include <algorithm>
+#include <cmath>
+#include "game/render_queue.hpp"
+
+constexpr uint32_t RenderQueue::DEPTH_BITS;
+constexpr uint32_t RenderQueue::PROGRAM_BITS;
+constexpr uint32_t RenderQueue::ID_BITS;
+
+namespace {
+
+constexpr uint64_t
+mask(const uint32_t bits) {
+    return (uint64_t(1) << bits) - 1;
+}
+
+} // namespace
+
+void
+RenderQueue::begin(const float near, const float far) {
+    m_near = near;
+    m_far = far;
+    m_entries.clear();
+}
+
+void
+RenderQueue::push(const uint32_t item, const float depth, const GLuint program,
+        const GLuint tex, const GLuint vao) {
+    const float t = std::log(std::max(depth, m_near) / m_near)
+        / std::log(m_far / m_near);
+    const uint64_t bucket = std::min<uint64_t>(
+        uint64_t(std::max(t, 0.f) * mask(DEPTH_BITS)), mask(DEPTH_BITS));
+
+    uint64_t key = bucket;
+    key = (key << PROGRAM_BITS) | (program & mask(PROGRAM_BITS));
+    key = (key << ID_BITS) | (tex & mask(ID_BITS));
+    key = (key << ID_BITS) | (vao & mask(ID_BITS));
+    m_entries.push_back({key, item});
+}
+
+void
+RenderQueue::sort() {
+    std::sort(m_entries.begin(), m_entries.end(),
+        [](const Entry& a, const Entry& b) {
+            return a.key < b.key;
+        });
+    // The depth bucket moves below the state bits
+    constexpr uint32_t STATE_BITS = PROGRAM_BITS + 2 * ID_BITS;
+    // Ties keep the depth order of the full key. Not a stable_sort, that
+    // one takes a temporary buffer from the heap every frame.
+    m_by_state = m_entries;
+    std::sort(m_by_state.begin(), m_by_state.end(),
+        [](const Entry& a, const Entry& b) {
+            const uint64_t state_a = a.key & mask(STATE_BITS);
+            const uint64_t state_b = b.key & mask(STATE_BITS);
+            if (state_a != state_b) {
+                return state_a < state_b;
+            }
+            return a.key != b.key ? a.key < b.key : a.item < b.item;
+        });
+}
+
+uint32_t
+RenderQueue::count_state_changes(const std::vector<Entry>& entries) {
+    uint32_t changes = 0;
+    for (size_t i = 1; i < entries.size(); ++i) {
+        const uint64_t a = entries[i - 1].key;
+        const uint64_t b = entries[i].key;
+        changes += (a & mask(ID_BITS)) != (b & mask(ID_BITS));
+        changes += ((a >> ID_BITS) & mask(ID_BITS)) != ((b >> ID_BITS) & mask(ID_BITS));
+        changes += ((a >> 2 * ID_BITS) & mask(PROGRAM_BITS))
+            != ((b >> 2 * ID_BITS) & mask(PROGRAM_BITS));
+    }
+    return changes;
+}
@@ -0,0 +1,137 @@
+#include <cmath>
+#include <random>
+#include "game/scene_generator.hpp"
+
+namespace {
+
+// Size of the default arena, the hand-made layout is defined relative to it
+constexpr float DEFAULT_HALF_EXTENT = 15.f;
+constexpr float MIN_HALF_EXTENT = 6.f;
+constexpr float ARENA_HEIGHT = 7.f;
+constexpr float WALL_THICKNESS = 0.4f;
+
+// Walls, table and two light bulbs
+constexpr uint32_t FIXED_OBJECTS = 6 + 1 + 2;
+
+const std::array<std::array<int, 2>, 4> QUADRANTS = {{
+    {{1, 1}}, {{-1, 1}}, {{1, -1}}, {{-1, -1}}
+}};
+
+}
+
+SceneParams
+SceneParams::scaled(const float factor) const {
+    SceneParams params = *this;
+    params.arena_half_extent = arena_half_extent * std::sqrt(factor);
+    params.box_count = std::lround(box_count * factor);
+    params.enemy_count = std::lround(enemy_count * factor);
+    params.ball_count = std::lround(ball_count * factor);
+    return params;
+}
+
+uint32_t
+SceneParams::object_count() const {
+    return FIXED_OBJECTS + box_count + enemy_count + ball_count;
+}
+
+SceneDescription
+generate_scene(const SceneParams& params) {
+    SceneDescription scene;
+    scene.seed = params.seed != 0 ? params.seed : std::random_device()();
+    std::mt19937 rng(scene.seed);
+    auto uniform = [&rng](const float lo, const float hi) {
+        return std::uniform_real_distribution<float>(lo, hi)(rng);
+    };
+    auto sign = [&rng]() {
+        return rng() % 2 == 0 ? 1.f : -1.f;
+    };
+
+    const float h = std::max(params.arena_half_extent, MIN_HALF_EXTENT);
+    const float stretch = h / DEFAULT_HALF_EXTENT;
+    scene.bounds = {{ {{-h, h}}, {{0, ARENA_HEIGHT}}, {{-h, h}} }};
+    scene.lights = {{
+        glm::vec4(-5.5 * stretch, 6.6, -11 * stretch, 1.),
+        glm::vec4(5.5 * stretch, 6.6, 11 * stretch, 1.)
+    }};
+    auto random_position = [&](const float lo_y, const float hi_y) {
+        return glm::vec3(uniform(-h + 1, h - 1), uniform(lo_y, hi_y),
+            uniform(-h + 1, h - 1));
+    };
+    auto random_direction = [&]() {
+        glm::vec3 dir(uniform(-1, 1), uniform(-1, 1), uniform(-1, 1));
+        return glm::length(dir) > 1e-3f ? dir : glm::vec3(0, 1, 0);
+    };
+
+    // Walls
+    for (const auto dir : {0, 1}) {
+        for (uint32_t i = 0; i < 3; ++i) {
+            SceneDescription::Placement wall;
+            wall.center = glm::vec3(0);
+            wall.size = glm::vec3(h + 5);
+            wall.center[i] = scene.bounds[i][dir] + WALL_THICKNESS * (dir ? 1 : -1);
+            wall.size[i] = WALL_THICKNESS;
+            wall.direction = glm::vec3(0);
+            wall.speed = 0;
+            scene.walls.push_back(wall);
+        }
+    }
+
+    // Table in the middle
+    scene.table = {glm::vec3(0, 0, 0), glm::vec3(4.5, 4, 4.5), glm::vec3(0), 0};
+
+    // Balls, the first four lie on the table
+    for (uint32_t i = 0; i < params.ball_count; ++i) {
+        if (i < QUADRANTS.size()) {
+            scene.balls.push_back({
+                glm::vec3(QUADRANTS[i][0], 2. + i, QUADRANTS[i][1]), glm::vec3(0.25),
+                glm::vec3(0, 1, 0), 3.
+            });
+        } else {
+            scene.balls.push_back({
+                random_position(1, ARENA_HEIGHT - 1), glm::vec3(uniform(0.1, 0.3)),
+                random_direction(), uniform(0, 3)
+            });
+        }
+    }
+
+    // Boxes, two rows along X and Z first, the rest anywhere
+    {
+        const float spread = 3.;
+        const uint32_t per_row = 2 * h / spread;
+        for (uint32_t i = 0; i < params.box_count; ++i) {
+            SceneDescription::Placement box;
+            box.size = glm::vec3(0.5, 0.75, 0.4);
+            box.speed = 3.;
+            if (i < 2 * per_row) {
+                const uint32_t D = i < per_row ? 0 : 2;
+                const uint32_t k = i % per_row;
+                box.center = glm::vec3(0, std::fmod(k / 2., 5.) + 2, 0);
+                box.center[D] = -h + k * spread;
+                box.direction = glm::vec3(0, 1, 0);
+                box.direction[D] = sign();
+            } else {
+                box.center = random_position(2, ARENA_HEIGHT - 1);
+                box.direction = random_direction();
+            }
+            scene.boxes.push_back(box);
+        }
+    }
+
+    // Enemies, five rings of four heads around the table first
+    for (uint32_t k = 0; k < params.enemy_count; ++k) {
+        SceneDescription::Placement enemy;
+        enemy.direction = glm::vec3(0);
+        enemy.speed = 0;
+        if (k < 20) {
+            const uint32_t i = k / 4, j = k % 4;
+            const float s = 2.5 * (i + 1);
+            enemy.center = glm::vec3(s*QUADRANTS[j][0], i + 2, s*QUADRANTS[j][1]);
+            enemy.size = glm::vec3(1. / (i + 1));
+        } else {
+            enemy.center = random_position(2, ARENA_HEIGHT - 1);
+            enemy.size = glm::vec3(uniform(0.2, 0.5));
+        }
+        scene.enemies.push_back(enemy);
+    }
+    return scene;
+}
@@ -0,0 +1,260 @@
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#include "game/binned_sah.hpp"
+#include "game/scene_query.hpp"
+
+constexpr uint32_t SceneQuery::NONE;
+constexpr uint32_t SceneQuery::ALL_KINDS;
+constexpr uint32_t SceneQuery::MAX_LEAF;
+constexpr uint32_t SceneQuery::MAX_DEPTH;
+constexpr size_t SceneQuery::BATCH;
+
+void
+SceneQuery::build(const std::vector<std::shared_ptr<Object>>& objects) {
+    m_objects = &objects;
+    m_nodes.clear();
+    m_order.resize(objects.size());
+    std::iota(m_order.begin(), m_order.end(), 0);
+    m_min.resize(objects.size());
+    m_max.resize(objects.size());
+    for (uint32_t i = 0; i < objects.size(); ++i) {
+        const auto aabb = objects[i]->get_aabb();
+        m_min[i] = aabb.get_center() - aabb.get_halfwidths();
+        m_max[i] = aabb.get_center() + aabb.get_halfwidths();
+    }
+    if (!objects.empty()) {
+        this->build(0, objects.size(), 0);
+    }
+}
+
+uint32_t
+SceneQuery::build(const uint32_t first, const uint32_t count,
+        const uint32_t depth) {
+    Node node = {m_min[m_order[first]], 0, m_max[m_order[first]], 0};
+    glm::vec3 low = m_min[m_order[first]] + m_max[m_order[first]];
+    glm::vec3 high = low;
+    for (uint32_t i = first + 1; i < first + count; ++i) {
+        node.min = glm::min(node.min, m_min[m_order[i]]);
+        node.max = glm::max(node.max, m_max[m_order[i]]);
+        low = glm::min(low, m_min[m_order[i]] + m_max[m_order[i]]);
+        high = glm::max(high, m_min[m_order[i]] + m_max[m_order[i]]);
+    }
+    const uint32_t index = m_nodes.size();
+    if (count <= MAX_LEAF) {
+        node.offset = first;
+        node.count = count;
+        m_nodes.push_back(node);
+        return index;
+    }
+    m_nodes.push_back(node);
+
+    // Binned over twice the centers, which bin the same
+    BinnedSah sah(low, high);
+    // Halving the rest of a deep branch bounds the depth
+    for (uint32_t axis = 0; axis < 3 && depth < MAX_DEPTH / 2; ++axis) {
+        if (high[axis] <= low[axis]) {
+            continue;
+        }
+        sah.begin(axis);
+        for (uint32_t i = first; i < first + count; ++i) {
+            const uint32_t o = m_order[i];
+            sah.add(m_min[o][axis] + m_max[o][axis], m_min[o], m_max[o]);
+        }
+        sah.sweep();
+    }
+
+    uint32_t middle = first + count / 2;
+    const auto begin = m_order.begin() + first;
+    const auto& best = sah.get_best();
+    if (best.found()) {
+        middle = std::partition(begin, begin + count,
+            [&](const uint32_t o) {
+                return sah.bin_of(m_min[o][best.axis] + m_max[o][best.axis],
+                    best.axis) < best.bin;
+            }) - m_order.begin();
+    } else {
+        // At the median along the widest spread of the centers
+        const glm::vec3 spread = high - low;
+        const uint32_t axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2)
+            : (spread.y > spread.z ? 1 : 2);
+        std::nth_element(begin, begin + count / 2, begin + count,
+            [this, axis](const uint32_t a, const uint32_t b) {
+                return m_min[a][axis] + m_max[a][axis] < m_min[b][axis] + m_max[b][axis];
+            });
+    }
+    this->build(first, middle - first, depth + 1);
+    const uint32_t second = this->build(middle, first + count - middle, depth + 1);
+    m_nodes[index].offset = second;
+    return index;
+}
+
+bool
+SceneQuery::cast(const glm::vec3& origin, const glm::vec3& direction,
+        const float radius, const float max_distance, Hit& out,
+        std::vector<Hit>* all, const Filter& filter) const {
+    out = Hit();
+    const float length = glm::length(direction);
+    if (m_nodes.empty() || length == 0) {
+        return false;
+    }
+    const glm::vec3 unit = direction / length;
+    const glm::vec3 inverse = 1.f / unit;
+    const glm::vec3 grow(radius);
+    const size_t first_hit = all != nullptr ? all->size() : 0;
+    // Gathering every hit never shortens the ray
+    float limit = max_distance;
+
+    // Nodes with where the ray enters them, the nearer child is on top so
+    // that the closest hit shortens the ray before the farther one is
+    // reached, which is then skipped
+    std::pair<uint32_t, float> stack[MAX_DEPTH];
+    uint32_t size = 0;
+    float root_entry;
+    if (enters(m_nodes[0].min - grow, m_nodes[0].max + grow, origin, inverse,
+            limit, root_entry)) {
+        stack[size++] = {0, root_entry};
+    }
+    while (size > 0) {
+        const auto top = stack[--size];
+        if (top.second > limit) {
+            continue;
+        }
+        const Node& node = m_nodes[top.first];
+        if (!node.is_leaf()) {
+            const uint32_t first = top.first + 1;
+            const Node& a = m_nodes[first];
+            const Node& b = m_nodes[node.offset];
+            float ta, tb;
+            const bool in_a = enters(a.min - grow, a.max + grow, origin, inverse, limit, ta);
+            const bool in_b = enters(b.min - grow, b.max + grow, origin, inverse, limit, tb);
+            if (in_a && in_b && tb < ta) {
+                stack[size++] = {first, ta};
+                stack[size++] = {node.offset, tb};
+            } else if (in_a && in_b) {
+                stack[size++] = {node.offset, tb};
+                stack[size++] = {first, ta};
+            } else if (in_a) {
+                stack[size++] = {first, ta};
+            } else if (in_b) {
+                stack[size++] = {node.offset, tb};
+            }
+            continue;
+        }
+        for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+            const Object& obj = *(*m_objects)[m_order[i]];
+            if (!this->accepts(obj, filter)) {
+                continue;
+            }
+            float distance = limit;
+            glm::vec3 normal;
+            if (!obj.cast(origin, unit, radius, distance, normal)) {
+                continue;
+            }
+            Hit hit;
+            hit.id = obj.get_id();
+            hit.distance = distance;
+            hit.normal = normal;
+            hit.point = origin + distance * unit - radius * normal;
+            if (all != nullptr) {
+                all->push_back(hit);
+            } else if (distance < out.distance) {
+                out = hit;
+                limit = distance;
+            }
+        }
+    }
+    if (all != nullptr) {
+        std::sort(all->begin() + first_hit, all->end(), [](const Hit& a, const Hit& b) {
+            return a.distance < b.distance;
+        });
+        return all->size() > first_hit;
+    }
+    return out.id != NONE;
+}
+
+bool
+SceneQuery::raycast(const glm::vec3& origin, const glm::vec3& direction,
+        const float max_distance, Hit& out, const Filter& filter) const {
+    return this->cast(origin, direction, 0, max_distance, out, nullptr, filter);
+}
+
+size_t
+SceneQuery::raycast_all(const glm::vec3& origin, const glm::vec3& direction,
+        const float max_distance, std::vector<Hit>& out,
+        const Filter& filter) const {
+    const size_t before = out.size();
+    Hit unused;
+    this->cast(origin, direction, 0, max_distance, unused, &out, filter);
+    return out.size() - before;
+}
+
+bool
+SceneQuery::sweep(const glm::vec3& center, const float radius,
+        const glm::vec3& direction, const float max_distance, Hit& out,
+        const Filter& filter) const {
+    return this->cast(center, direction, radius, max_distance, out, nullptr, filter);
+}
+
+size_t
+SceneQuery::overlap(const glm::vec3& min, const glm::vec3& max,
+        std::vector<uint32_t>& out, const Filter& filter) const {
+    const size_t before = out.size();
+    if (m_nodes.empty()) {
+        return 0;
+    }
+    uint32_t stack[MAX_DEPTH];
+    uint32_t size = 0;
+    stack[size++] = 0;
+    while (size > 0) {
+        const uint32_t index = stack[--size];
+        const Node& node = m_nodes[index];
+        if (glm::any(glm::lessThan(node.max, min)) || glm::any(glm::greaterThan(node.min, max))) {
+            continue;
+        }
+        if (!node.is_leaf()) {
+            stack[size++] = node.offset;
+            stack[size++] = index + 1;
+            continue;
+        }
+        for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+            const uint32_t o = m_order[i];
+            const Object& obj = *(*m_objects)[o];
+            if (this->accepts(obj, filter)
+                    && !glm::any(glm::lessThan(m_max[o], min))
+                    && !glm::any(glm::greaterThan(m_min[o], max))) {
+                out.push_back(obj.get_id());
+            }
+        }
+    }
+    return out.size() - before;
+}
+
+void
+SceneQuery::raycast(const float* origins, const float* directions,
+        const size_t count, const float max_distance, Hit* out,
+        const Filter& filter, ThreadPool* pool) const {
+    this->sweep(origins, 0, directions, count, max_distance, out, filter, pool);
+}
+
+void
+SceneQuery::sweep(const float* centers, const float radius,
+        const float* directions, const size_t count, const float max_distance,
+        Hit* out, const Filter& filter, ThreadPool* pool) const {
+    auto batch = [&](const size_t index) {
+        const size_t end = std::min(count, (index + 1) * BATCH);
+        for (size_t i = index * BATCH; i < end; ++i) {
+            this->cast(glm::make_vec3(centers + 3 * i),
+                glm::make_vec3(directions + 3 * i), radius, max_distance, out[i],
+                nullptr, filter);
+        }
+    };
+    const size_t batches = (count + BATCH - 1) / BATCH;
+    if (pool != nullptr && batches > 1) {
+        pool->parallel_for(batches, batch);
+    } else {
+        for (size_t index = 0; index < batches; ++index) {
+            batch(index);
+        }
+    }
+}
@@ -0,0 +1,100 @@
+#include "game/shader_variants.hpp"
+
+constexpr uint8_t ShaderVariants::COUNT;
+
+namespace {
+
+// Specular needs the diffuse term, other sets never come from features_of()
+bool
+is_used(const uint8_t features) {
+    return !(features & ShaderVariants::SPECULAR) || (features & ShaderVariants::DIFFUSE);
+}
+
+} // namespace
+
+ShaderVariants::ShaderVariants(ProgramCache& programs,
+        const LightClusters& clusters, const std::string& vertex,
+        const std::string& fragment, const ProgramCache::Attributes& attributes)
+ : m_clusters(clusters)
+{
+    for (uint8_t features = 0; features < COUNT; ++features) {
+        if (!is_used(features)) {
+            continue;
+        }
+        const GLuint program = programs.load(vertex, fragment, attributes,
+            ShaderVariants::defines_of(features), [this, features](const GLuint p) {
+                this->resolve(features, p);
+            });
+        if (program != 0) {
+            this->resolve(features, program);
+        }
+    }
+}
+
+uint8_t
+ShaderVariants::features_of(const MaterialProperties& material, const GLuint tex) {
+    uint8_t features = 0;
+    if (tex != 0) {
+        features |= TEXTURED;
+    }
+    if (material.diffuse_color != glm::vec3(0.f)) {
+        features |= DIFFUSE;
+    }
+    if (material.specular_color != glm::vec3(0.f)) {
+        features |= DIFFUSE | SPECULAR;
+    }
+    return features;
+}
+
+std::string
+ShaderVariants::defines_of(const uint8_t features) {
+    std::string defines;
+    if (features & TEXTURED) {
+        defines += "#define TEXTURED\n";
+    }
+    if (features & DIFFUSE) {
+        defines += "#define DIFFUSE\n";
+    }
+    if (features & SPECULAR) {
+        defines += "#define SPECULAR\n";
+    }
+    return defines;
+}
+
+bool
+ShaderVariants::is_valid() const {
+    for (uint8_t features = 0; features < COUNT; ++features) {
+        if (is_used(features) && m_variants[features].program == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void
+ShaderVariants::resolve(const uint8_t features, const GLuint program) {
+    auto& variant = m_variants[features];
+    auto& u = variant.uniforms;
+    variant.program = program;
+    u.model_matrix = glGetUniformLocation(program, "model_matrix");
+    u.PVM_matrix = glGetUniformLocation(program, "PVM_matrix");
+    u.normal_matrix = glGetUniformLocation(program, "normal_matrix");
+    u.tex_scale = glGetUniformLocation(program, "tex_scale");
+
+    u.material_ambient_color = glGetUniformLocation(program, "material_ambient_color");
+    u.material_diffuse_color = glGetUniformLocation(program, "material_diffuse_color");
+    u.material_specular_color = glGetUniformLocation(program, "material_specular_color");
+    u.material_shininess = glGetUniformLocation(program, "material_shininess");
+
+    u.light_ambient_color = glGetUniformLocation(program, "light_ambient_color");
+    u.light_diffuse_color = glGetUniformLocation(program, "light_diffuse_color");
+    u.light_specular_color = glGetUniformLocation(program, "light_specular_color");
+
+    u.eye_position = glGetUniformLocation(program, "eye_position");
+    u.clusters = m_clusters.set_program(program);
+
+    // Every object samples texture unit 0
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "my_tex"), 0);
+    glUseProgram(0);
+}
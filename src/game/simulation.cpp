@@ -0,0 +1,153 @@
+#include <algorithm>
+#include "game/simulation.hpp"
+
+constexpr uint32_t Simulation::MAX_CATCH_UP;
+
+Simulation::Simulation(World& world, Profiler& profiler, const float tick_rate,
+        TickCallback on_tick)
+ : m_world(world), m_profiler(profiler), m_on_tick(std::move(on_tick)),
+   m_tick_length(1. / tick_rate), m_start(Clock::now().time_since_epoch().count()), m_stop(false)
+{
+    m_input.position = m_world.get_player();
+    m_input.aim = glm::vec3(0, 0, -1);
+}
+
+Simulation::~Simulation() {
+    this->stop();
+}
+
+void
+Simulation::start() {
+    this->set_start(Clock::now());
+    m_tick = 0;
+    m_thread = std::thread(&Simulation::run, this);
+}
+
+void
+Simulation::stop() {
+    m_stop = true;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void
+Simulation::advance() {
+    const double elapsed = this->now();
+    if (elapsed > (m_tick + MAX_CATCH_UP) * m_tick_length) {
+        // Too far behind, drop the ticks instead of spiralling down
+        this->set_start(Clock::now() - std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>(m_tick * m_tick_length)));
+    }
+    while (this->now() >= (m_tick + 1) * m_tick_length) {
+        this->tick();
+    }
+}
+
+void
+Simulation::set_input(const glm::vec3& position, const glm::vec3& aim,
+        const bool fire) {
+    std::lock_guard<std::mutex> lock(m_input_mutex);
+    m_input.position = position;
+    m_input.aim = aim;
+    m_input.fire = fire;
+}
+
+void
+Simulation::fire() {
+    std::lock_guard<std::mutex> lock(m_input_mutex);
+    ++m_input.shots;
+}
+
+void
+Simulation::tick() {
+    auto scope = m_profiler.scope("tick");
+    World::Input input;
+    {
+        std::lock_guard<std::mutex> lock(m_input_mutex);
+        input = m_input;
+        m_input.shots = 0;
+    }
+    m_world.step(m_tick_length, input);
+    if (m_on_tick) {
+        auto scope = m_profiler.scope("on_tick");
+        m_on_tick(m_tick_length);
+    }
+    ++m_tick;
+
+    auto& snapshot = m_snapshots.back();
+    snapshot.tick = m_tick;
+    snapshot.time = m_tick * m_tick_length;
+    snapshot.items.clear();
+    m_world.describe(snapshot.items);
+    snapshot.lights.clear();
+    m_world.describe_lights(snapshot.lights);
+    snapshot.particles.clear();
+    m_world.describe_particles(snapshot.particles);
+    snapshot.particle_stats = m_world.get_particles().get_stats();
+    snapshot.integrator_stats = m_world.get_integrator().get_stats();
+    snapshot.world_time = m_world.get_time();
+    snapshot.alive_enemies = m_world.alive_enemies();
+    snapshot.player_alive = m_world.is_player_alive();
+    snapshot.over = m_world.is_over();
+    snapshot.phases = m_profiler.get_phases();
+    m_snapshots.publish();
+}
+
+void
+Simulation::run() {
+    while (!m_stop) {
+        this->advance();
+        const auto next = this->get_start() + std::chrono::duration_cast<Clock::duration>(
+            std::chrono::duration<double>((m_tick + 1) * m_tick_length));
+        std::this_thread::sleep_until(next);
+    }
+}
+
+const Snapshot&
+Simulation::interpolate(std::vector<DrawItem>& items,
+        std::vector<PointLight>& lights) {
+    m_snapshots.acquire(m_previous);
+    const auto& current = m_snapshots.front();
+
+    // Draw one tick behind, so there is almost always a newer snapshot
+    const double render_time = this->now() - m_tick_length;
+    const double span = current.time - m_previous.time;
+    const float alpha = span > 0 ?
+        std::min(std::max((render_time - m_previous.time) / span, 0.), 1.) : 1.f;
+    m_render_lag = (1 - alpha) * span;
+
+    items = current.items;
+    // Both lists are sorted by id, objects new in 'current' keep their position
+    auto prev = m_previous.items.begin();
+    for (auto& item : items) {
+        while (prev != m_previous.items.end() && prev->id < item.id) {
+            ++prev;
+        }
+        if (prev != m_previous.items.end() && prev->id == item.id) {
+            item.position = glm::mix(prev->position, item.position, alpha);
+            item.rotation = glm::slerp(prev->rotation, item.rotation, alpha);
+        }
+    }
+
+    // Lights of objects move with them
+    lights = current.lights;
+    for (auto& light : lights) {
+        if (light.owner == PointLight::NO_OWNER) {
+            continue;
+        }
+        const auto item = std::lower_bound(items.begin(), items.end(), light.owner,
+            [](const DrawItem& item, const uint32_t id) {
+                return item.id < id;
+            });
+        if (item != items.end() && item->id == light.owner) {
+            light.position = item->position;
+        }
+    }
+    return current;
+}
+
+double
+Simulation::now() const {
+    return std::chrono::duration<double>(Clock::now() - this->get_start()).count();
+}
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <array>
+#include <map>
+#include "game/static_batch.hpp"
+#include "game/PV112.h"
+
+namespace {
+
+std::array<float, 10>
+material_key(const MaterialProperties& m) {
+    return {{m.ambient_color.x, m.ambient_color.y, m.ambient_color.z,
+        m.diffuse_color.x, m.diffuse_color.y, m.diffuse_color.z,
+        m.specular_color.x, m.specular_color.y, m.specular_color.z,
+        m.shininess}};
+}
+
+} // namespace
+
+StaticBatch::StaticBatch(const std::vector<DrawItem>& items,
+        const GLint position_loc, const GLint normal_loc,
+        const GLint tex_coord_loc)
+ : m_indirect(GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect)
+{
+    std::vector<const DrawItem*> batched;
+    for (const auto& item : items) {
+        if (StaticBatch::accepts(item)) {
+            batched.push_back(&item);
+        }
+    }
+    std::stable_sort(batched.begin(), batched.end(),
+        [](const DrawItem* a, const DrawItem* b) {
+            if (a->tex != b->tex) {
+                return a->tex < b->tex;
+            }
+            return material_key(a->material) < material_key(b->material);
+        });
+
+    // Position, normal and texture coordinates, like the .inl geometries
+    std::vector<float> vertices;
+    std::vector<GLuint> indices;
+    // Indices are shared by the objects with the same mesh
+    std::map<const PV112::MeshData*, std::pair<GLuint, GLuint>> ranges;
+
+    for (const auto item : batched) {
+        const auto& mesh = *item->mesh;
+        auto range = ranges.find(&mesh);
+        if (range == ranges.end()) {
+            const GLuint first = indices.size();
+            if (mesh.Indices.empty()) {
+                for (GLuint i = 0; i < mesh.Positions.size(); ++i) {
+                    indices.push_back(i);
+                }
+            } else {
+                indices.insert(indices.end(), mesh.Indices.begin(),
+                    mesh.Indices.end());
+            }
+            range = ranges.emplace(&mesh,
+                std::make_pair(first, GLuint(indices.size() - first))).first;
+        }
+
+        // Move the vertices to the world space, the batch is drawn as is
+        const glm::mat4 model = item->model_matrix();
+        const glm::mat3 normal_matrix = glm::inverse(glm::transpose(glm::mat3(model)));
+        const GLint base_vertex = vertices.size() / 8;
+        auto bounds = std::make_pair(glm::vec3(std::numeric_limits<float>::max()),
+            glm::vec3(std::numeric_limits<float>::lowest()));
+        for (size_t i = 0; i < mesh.Positions.size(); ++i) {
+            const auto p = glm::vec3(model * glm::vec4(mesh.Positions[i], 1.f));
+            bounds.first = glm::min(bounds.first, p);
+            bounds.second = glm::max(bounds.second, p);
+            const auto n = glm::normalize(normal_matrix * mesh.Normals[i]);
+            const auto t = mesh.TexCoords[i] * item->tex_scale;
+            vertices.insert(vertices.end(), {p.x, p.y, p.z, n.x, n.y, n.z, t.x, t.y});
+        }
+
+        if (m_groups.empty() || m_groups.back().tex != item->tex
+                || material_key(m_groups.back().material)
+                    != material_key(item->material)) {
+            Group group;
+            group.tex = item->tex;
+            group.material = item->material;
+            group.first_command = m_commands.size();
+            group.command_count = 0;
+            m_groups.push_back(group);
+        }
+        ++m_groups.back().command_count;
+        m_commands.push_back({range->second.second, 1, range->second.first,
+            base_vertex, 0});
+        m_ids.push_back(item->id);
+        m_bounds.push_back(bounds);
+    }
+    for (uint32_t i = 0; i < m_commands.size(); ++i) {
+        m_order.push_back(i);
+    }
+    for (uint32_t i = 0; i < m_groups.size(); ++i) {
+        m_group_order.push_back(i);
+    }
+
+    m_vertex_buffer = GpuBuffer::create();
+    m_vertex_buffer.set_bytes(vertices.size() * sizeof(float));
+    glBindBuffer(GL_ARRAY_BUFFER, m_vertex_buffer.get());
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float),
+        vertices.data(), GL_STATIC_DRAW);
+
+    m_index_buffer = GpuBuffer::create();
+    m_index_buffer.set_bytes(indices.size() * sizeof(GLuint));
+    m_vao = GpuVertexArray::create();
+    glBindVertexArray(m_vao.get());
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_index_buffer.get());
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint),
+        indices.data(), GL_STATIC_DRAW);
+    if (position_loc >= 0) {
+        glEnableVertexAttribArray(position_loc);
+        glVertexAttribPointer(position_loc, 3, GL_FLOAT, GL_FALSE,
+            sizeof(float) * 8, 0);
+    }
+    if (normal_loc >= 0) {
+        glEnableVertexAttribArray(normal_loc);
+        glVertexAttribPointer(normal_loc, 3, GL_FLOAT, GL_FALSE,
+            sizeof(float) * 8, (const void *)(sizeof(float) * 3));
+    }
+    if (tex_coord_loc >= 0) {
+        glEnableVertexAttribArray(tex_coord_loc);
+        glVertexAttribPointer(tex_coord_loc, 2, GL_FLOAT, GL_FALSE,
+            sizeof(float) * 8, (const void *)(sizeof(float) * 6));
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    if (m_indirect) {
+        m_command_buffer = GpuBuffer::create();
+        m_command_buffer.set_bytes(m_commands.size() * sizeof(DrawCommand));
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_command_buffer.get());
+        glBufferData(GL_DRAW_INDIRECT_BUFFER,
+            m_commands.size() * sizeof(DrawCommand), nullptr, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    this->rebuild();
+    this->upload();
+}
+
+bool
+StaticBatch::accepts(const DrawItem& item) {
+    return item.is_static && item.mesh != nullptr && item.mode == GL_TRIANGLES
+        && !item.mesh->Normals.empty() && !item.mesh->TexCoords.empty();
+}
+
+void
+StaticBatch::update(const std::vector<DrawItem>& items, FrameArena& arena) {
+    // Static objects are only ever removed, a matching count means no change
+    ArenaVector<uint32_t> present{ArenaAllocator<uint32_t>(arena)};
+    present.reserve(m_commands.size());
+    for (const auto& item : items) {
+        if (StaticBatch::accepts(item)) {
+            present.push_back(item.id);
+        }
+    }
+    if (present.size() == m_drawn) {
+        return;
+    }
+    // Items are sorted by id
+    for (size_t i = 0; i < m_commands.size(); ++i) {
+        m_commands[i].instance_count =
+            std::binary_search(present.begin(), present.end(), m_ids[i]);
+    }
+    this->rebuild();
+}
+
+void
+StaticBatch::sort(const glm::vec3& eye, FrameArena& arena) {
+    if (eye == m_eye) {
+        return;
+    }
+    m_eye = eye;
+
+    ArenaVector<float> distances(m_commands.size(), 0.f, ArenaAllocator<float>(arena));
+    for (size_t i = 0; i < m_commands.size(); ++i) {
+        const auto& b = m_bounds[i];
+        distances[i] = glm::length(glm::clamp(eye, b.first, b.second) - eye);
+    }
+    ArenaVector<float> nearest(m_groups.size(), 0.f, ArenaAllocator<float>(arena));
+    for (size_t g = 0; g < m_groups.size(); ++g) {
+        const auto first = m_order.begin() + m_groups[g].first_command;
+        const auto last = first + m_groups[g].command_count;
+        std::sort(first, last, [&distances](const uint32_t a, const uint32_t b) {
+            return distances[a] < distances[b];
+        });
+        nearest[g] = distances[*first];
+    }
+    // Ties by the index instead of a stable_sort, which allocates
+    std::sort(m_group_order.begin(), m_group_order.end(),
+        [&nearest](const uint32_t a, const uint32_t b) {
+            return nearest[a] != nearest[b] ? nearest[a] < nearest[b] : a < b;
+        });
+    this->rebuild();
+}
+
+void
+StaticBatch::rebuild() {
+    m_sorted.clear();
+    for (const auto i : m_order) {
+        m_sorted.push_back(m_commands[i]);
+    }
+    m_counts.clear();
+    m_offsets.clear();
+    m_base_vertices.clear();
+    m_drawn = 0;
+    m_triangles = 0;
+    for (const auto g : m_group_order) {
+        auto& group = m_groups[g];
+        group.first_visible = m_counts.size();
+        for (size_t i = group.first_command;
+                i < group.first_command + group.command_count; ++i) {
+            const auto& command = m_sorted[i];
+            if (command.instance_count == 0) {
+                continue;
+            }
+            m_counts.push_back(command.count);
+            m_offsets.push_back(reinterpret_cast<void*>(
+                command.first_index * sizeof(GLuint)));
+            m_base_vertices.push_back(command.base_vertex);
+            m_triangles += command.count / 3;
+        }
+        group.visible = m_counts.size() - group.first_visible;
+        m_drawn += group.visible;
+    }
+    m_dirty = true;
+}
+
+void
+StaticBatch::upload() {
+    if (m_indirect && m_dirty) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_command_buffer.get());
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0,
+            m_sorted.size() * sizeof(DrawCommand), m_sorted.data());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    m_dirty = false;
+}
+
+void
+StaticBatch::draw(const std::function<void(const Group&)>& bind_group) const {
+    glBindVertexArray(m_vao.get());
+    if (m_indirect) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_command_buffer.get());
+    }
+    for (const auto g : m_group_order) {
+        const auto& group = m_groups[g];
+        if (group.visible == 0) {
+            continue;
+        }
+        bind_group(group);
+        if (m_indirect) {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT,
+                reinterpret_cast<const void*>(group.first_command * sizeof(DrawCommand)),
+                group.command_count, 0);
+        } else {
+            glMultiDrawElementsBaseVertex(GL_TRIANGLES,
+                &m_counts[group.first_visible], GL_UNSIGNED_INT,
+                &m_offsets[group.first_visible], group.visible,
+                &m_base_vertices[group.first_visible]);
+        }
+    }
+    if (m_indirect) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+    glBindVertexArray(0);
+}
+
+size_t
+StaticBatch::get_draw_calls() const {
+    return std::count_if(m_groups.begin(), m_groups.end(), [](const Group& g) {
+        return g.visible > 0;
+    });
+}
@@ -0,0 +1,220 @@
+#include "game/steering.hpp"
+#include "game/enemy.hpp"
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace {
+
+#if defined(__SSE2__)
+inline float horizontal_sum(const __m128 v) {
+    __m128 shuf = _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1));
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    return _mm_cvtss_f32(_mm_add_ss(sums, shuf));
+}
+
+// Scales (x, z) down to at most 'limit' in length
+inline void clamp_length(__m128& x, __m128& z, const __m128 limit) {
+    const __m128 len2 = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(z, z));
+    const __m128 len = _mm_sqrt_ps(_mm_max_ps(len2, _mm_set1_ps(1e-12f)));
+    const __m128 scale = _mm_min_ps(_mm_set1_ps(1.f), _mm_div_ps(limit, len));
+    x = _mm_mul_ps(x, scale);
+    z = _mm_mul_ps(z, scale);
+}
+#endif
+
+inline void clamp_length(float& x, float& z, const float limit) {
+    const float len = std::sqrt(x*x + z*z);
+    if (len > limit) {
+        x *= limit / len;
+        z *= limit / len;
+    }
+}
+
+}
+
+void
+SteeringSystem::step(const std::vector<std::shared_ptr<Object>>& enemies,
+        const glm::vec3& target, const float time_delta,
+        const FlowField::Field* field) {
+    this->gather(enemies, target, time_delta, field);
+    if (m_enemies.empty()) {
+        return;
+    }
+    this->seek();
+    this->separate();
+    this->integrate(time_delta);
+
+    for (size_t i = 0; i < m_enemies.size(); ++i) {
+        m_enemies[i]->steer(target, m_vx[i], m_vz[i], time_delta);
+    }
+}
+
+void
+SteeringSystem::gather(const std::vector<std::shared_ptr<Object>>& enemies,
+        const glm::vec3& target, const float time_delta,
+        const FlowField::Field* field) {
+    m_raw_enemies.clear();
+    m_raw_x.clear();
+    m_raw_z.clear();
+    for (const auto& obj : enemies) {
+        auto enemy = static_cast<Enemy*>(obj.get());
+        if (!enemy->is_alive()) {
+            // Dead enemies only fall, they are not steered nor avoided
+            const auto v = enemy->get_velocity();
+            enemy->steer(target, v.x, v.z, time_delta);
+            continue;
+        }
+        const auto center = enemy->get_center();
+        m_raw_enemies.push_back(enemy);
+        m_raw_x.push_back(center.x);
+        m_raw_z.push_back(center.z);
+    }
+
+    const size_t n = m_raw_enemies.size();
+    m_grid.set_cell_size(m_params.neighbour_radius);
+    m_grid.build(m_raw_x.data(), m_raw_z.data(), n);
+
+    m_enemies.resize(n);
+    m_px.resize(n);
+    m_pz.resize(n);
+    m_hx.resize(n);
+    m_hz.resize(n);
+    m_vx.resize(n);
+    m_vz.resize(n);
+    m_fx.resize(n);
+    m_fz.resize(n);
+    const auto& order = m_grid.get_order();
+    for (size_t i = 0; i < n; ++i) {
+        const uint32_t src = order[i];
+        const auto v = m_raw_enemies[src]->get_velocity();
+        m_enemies[i] = m_raw_enemies[src];
+        m_px[i] = m_raw_x[src];
+        m_pz[i] = m_raw_z[src];
+        m_vx[i] = v.x;
+        m_vz[i] = v.z;
+
+        // O(1) lookup, falls back to a straight line where the field has no path
+        if (!field || !field->sample(m_px[i], m_pz[i], m_hx[i], m_hz[i])) {
+            m_hx[i] = target.x - m_px[i];
+            m_hz[i] = target.z - m_pz[i];
+        }
+    }
+}
+
+void
+SteeringSystem::seek() {
+    const size_t n = m_enemies.size();
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 speed = _mm_set1_ps(m_params.max_speed);
+    const __m128 eps = _mm_set1_ps(1e-6f);
+    for (; i + 4 <= n; i += 4) {
+        const __m128 dx = _mm_loadu_ps(&m_hx[i]);
+        const __m128 dz = _mm_loadu_ps(&m_hz[i]);
+        const __m128 len2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz));
+        const __m128 scale = _mm_div_ps(speed, _mm_sqrt_ps(_mm_max_ps(len2, eps)));
+        // Desired velocity minus the current one
+        _mm_storeu_ps(&m_fx[i], _mm_sub_ps(_mm_mul_ps(dx, scale), _mm_loadu_ps(&m_vx[i])));
+        _mm_storeu_ps(&m_fz[i], _mm_sub_ps(_mm_mul_ps(dz, scale), _mm_loadu_ps(&m_vz[i])));
+    }
+#endif
+    for (; i < n; ++i) {
+        const float dx = m_hx[i];
+        const float dz = m_hz[i];
+        const float scale = m_params.max_speed / std::sqrt(std::max(dx*dx + dz*dz, 1e-6f));
+        m_fx[i] = dx * scale - m_vx[i];
+        m_fz[i] = dz * scale - m_vz[i];
+    }
+}
+
+void
+SteeringSystem::separate() {
+    const float radius = m_params.neighbour_radius;
+    const float weight = m_params.separation_weight * m_params.max_speed;
+    const uint32_t dim_x = m_grid.get_dim_x();
+    const uint32_t dim_z = m_grid.get_dim_z();
+
+    for (size_t i = 0; i < m_enemies.size(); ++i) {
+        const uint32_t cx = m_grid.cell_x(m_px[i]);
+        const uint32_t cz = m_grid.cell_z(m_pz[i]);
+        float push_x = 0.f;
+        float push_z = 0.f;
+#if defined(__SSE2__)
+        const __m128 px = _mm_set1_ps(m_px[i]);
+        const __m128 pz = _mm_set1_ps(m_pz[i]);
+        const __m128 r2 = _mm_set1_ps(radius * radius);
+        const __m128 inv_r = _mm_set1_ps(1.f / radius);
+        const __m128 eps = _mm_set1_ps(1e-8f);
+        __m128 acc_x = _mm_setzero_ps();
+        __m128 acc_z = _mm_setzero_ps();
+#endif
+        for (uint32_t z = cz > 0 ? cz - 1 : 0; z <= std::min(cz + 1, dim_z - 1); ++z) {
+            for (uint32_t x = cx > 0 ? cx - 1 : 0; x <= std::min(cx + 1, dim_x - 1); ++x) {
+                uint32_t j = m_grid.cell_begin(x, z);
+                const uint32_t end = m_grid.cell_end(x, z);
+#if defined(__SSE2__)
+                for (; j + 4 <= end; j += 4) {
+                    const __m128 dx = _mm_sub_ps(px, _mm_loadu_ps(&m_px[j]));
+                    const __m128 dz = _mm_sub_ps(pz, _mm_loadu_ps(&m_pz[j]));
+                    const __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz));
+                    // Excludes the enemy itself as well as everything out of reach
+                    const __m128 mask = _mm_and_ps(_mm_cmplt_ps(d2, r2), _mm_cmpgt_ps(d2, eps));
+                    // Exact like the scalar tail, so the lane does not matter
+                    const __m128 inv_d = _mm_div_ps(_mm_set1_ps(1.f),
+                        _mm_sqrt_ps(_mm_max_ps(d2, eps)));
+                    // (1 - d/R) / d, i.e. stronger when closer
+                    const __m128 w = _mm_sub_ps(inv_d, inv_r);
+                    acc_x = _mm_add_ps(acc_x, _mm_and_ps(mask, _mm_mul_ps(dx, w)));
+                    acc_z = _mm_add_ps(acc_z, _mm_and_ps(mask, _mm_mul_ps(dz, w)));
+                }
+#endif
+                for (; j < end; ++j) {
+                    const float dx = m_px[i] - m_px[j];
+                    const float dz = m_pz[i] - m_pz[j];
+                    const float d2 = dx*dx + dz*dz;
+                    if (d2 < radius * radius && d2 > 1e-8f) {
+                        const float w = 1.f / std::sqrt(d2) - 1.f / radius;
+                        push_x += dx * w;
+                        push_z += dz * w;
+                    }
+                }
+            }
+        }
+#if defined(__SSE2__)
+        push_x += horizontal_sum(acc_x);
+        push_z += horizontal_sum(acc_z);
+#endif
+        m_fx[i] += weight * push_x;
+        m_fz[i] += weight * push_z;
+    }
+}
+
+void
+SteeringSystem::integrate(const float time_delta) {
+    const size_t n = m_enemies.size();
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128 dt = _mm_set1_ps(time_delta);
+    const __m128 max_force = _mm_set1_ps(m_params.max_force);
+    const __m128 max_speed = _mm_set1_ps(m_params.max_speed);
+    for (; i + 4 <= n; i += 4) {
+        __m128 fx = _mm_loadu_ps(&m_fx[i]);
+        __m128 fz = _mm_loadu_ps(&m_fz[i]);
+        clamp_length(fx, fz, max_force);
+        __m128 vx = _mm_add_ps(_mm_loadu_ps(&m_vx[i]), _mm_mul_ps(fx, dt));
+        __m128 vz = _mm_add_ps(_mm_loadu_ps(&m_vz[i]), _mm_mul_ps(fz, dt));
+        clamp_length(vx, vz, max_speed);
+        _mm_storeu_ps(&m_vx[i], vx);
+        _mm_storeu_ps(&m_vz[i], vz);
+    }
+#endif
+    for (; i < n; ++i) {
+        clamp_length(m_fx[i], m_fz[i], m_params.max_force);
+        m_vx[i] += m_fx[i] * time_delta;
+        m_vz[i] += m_fz[i] * time_delta;
+        clamp_length(m_vx[i], m_vz[i], m_params.max_speed);
+    }
+}
@@ -0,0 +1,113 @@
+#include <cstring>
+#include "game/stream_buffer.hpp"
+
+constexpr uint32_t StreamBuffer::FRAMES;
+
+StreamBuffer::StreamBuffer(const GLsizeiptr frame_size)
+ : m_frame_size(frame_size),
+   m_persistent(GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)
+{
+    this->create();
+}
+
+StreamBuffer::~StreamBuffer() {
+    this->destroy();
+}
+
+void
+StreamBuffer::create() {
+    m_buffer = GpuBuffer::create();
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer.get());
+    if (m_persistent) {
+        m_buffer.set_bytes(FRAMES * m_frame_size);
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT
+            | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_COPY_WRITE_BUFFER, FRAMES * m_frame_size, nullptr, flags);
+        m_mapped = static_cast<char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0,
+            FRAMES * m_frame_size, flags));
+    } else {
+        m_buffer.set_bytes(m_frame_size);
+        glBufferData(GL_COPY_WRITE_BUFFER, m_frame_size, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+void
+StreamBuffer::destroy() {
+    for (auto& fence : m_fences) {
+        if (fence) {
+            glDeleteSync(fence);
+            fence = 0;
+        }
+    }
+    if (m_mapped) {
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer.get());
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        m_mapped = nullptr;
+    }
+    // Draws still in flight keep the old storage alive
+    m_buffer.reset();
+}
+
+void
+StreamBuffer::begin_frame() {
+    m_used = 0;
+    if (m_overflow) {
+        m_overflow = false;
+        this->destroy();
+        m_frame_size *= 2;
+        this->create();
+    }
+
+    if (!m_persistent) {
+        // Orphan the storage, the driver hands out a fresh one
+        glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer.get());
+        glBufferData(GL_COPY_WRITE_BUFFER, m_frame_size, nullptr, GL_STREAM_DRAW);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return;
+    }
+
+    auto& fence = m_fences[m_frame];
+    if (fence) {
+        GLenum status = glClientWaitSync(fence, 0, 0);
+        if (status == GL_TIMEOUT_EXPIRED) {
+            ++m_stalls;
+            do {
+                status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                    1000000);
+            } while (status == GL_TIMEOUT_EXPIRED);
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+}
+
+void
+StreamBuffer::end_frame() {
+    if (m_persistent) {
+        m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        m_frame = (m_frame + 1) % FRAMES;
+    }
+}
+
+GLintptr
+StreamBuffer::write(const void* data, const GLsizeiptr size,
+        const GLsizeiptr alignment) {
+    const GLsizeiptr start = (m_used + alignment - 1) / alignment * alignment;
+    if (start + size > m_frame_size) {
+        m_overflow = true;
+        return -1;
+    }
+    m_used = start + size;
+
+    if (m_persistent) {
+        const GLintptr offset = m_frame * m_frame_size + start;
+        std::memcpy(m_mapped + offset, data, size);
+        return offset;
+    }
+    glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer.get());
+    glBufferSubData(GL_COPY_WRITE_BUFFER, start, size, data);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    return start;
+}
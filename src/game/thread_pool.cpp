@@ -0,0 +1,74 @@
+#include <algorithm>
+#include "game/thread_pool.hpp"
+
+ThreadPool::ThreadPool(const uint32_t threads)
+ : m_next(0)
+{
+    const uint32_t total = threads != 0 ? threads : ThreadPool::cores();
+    for (uint32_t i = 1; i < total; ++i) {
+        m_workers.emplace_back(&ThreadPool::run, this);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_start_cv.notify_all();
+    for (auto& worker : m_workers) {
+        worker.join();
+    }
+}
+
+void
+ThreadPool::parallel_for(const size_t count, std::function<void(size_t)> task) {
+    if (m_workers.empty()) {
+        for (size_t i = 0; i < count; ++i) {
+            task(i);
+        }
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_task = std::move(task);
+        m_count = count;
+        m_next = 0;
+        m_busy_workers = m_workers.size();
+        ++m_generation;
+    }
+    m_start_cv.notify_all();
+    this->work();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done_cv.wait(lock, [this] { return m_busy_workers == 0; });
+    m_task = nullptr;
+}
+
+void
+ThreadPool::work() {
+    for (size_t index = m_next++; index < m_count; index = m_next++) {
+        m_task(index);
+    }
+}
+
+void
+ThreadPool::run() {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start_cv.wait(lock, [&] { return m_stop || m_generation != seen; });
+            if (m_stop) {
+                return;
+            }
+            seen = m_generation;
+        }
+        this->work();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_busy_workers;
+        }
+        m_done_cv.notify_one();
+    }
+}
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <array>
+#include <random>
+#include "game/vec_world.hpp"
+#include "game/enemy.hpp"
+
+constexpr uint32_t VecWorld::ACTION_SIZE;
+constexpr uint32_t VecWorld::OBSERVED_ENEMIES;
+constexpr uint32_t VecWorld::OBSERVATION_SIZE;
+constexpr float VecWorld::KILL_REWARD;
+constexpr float VecWorld::DEATH_REWARD;
+
+VecWorld::VecWorld(const GameOptions& opts, const uint32_t count,
+        const uint32_t threads)
+ : m_opts(opts),
+   m_base_seed(opts.scene.seed != 0 ? opts.scene.seed : std::random_device()()),
+   m_profilers(count), m_worlds(count), m_episodes(count, 0),
+   m_pool(std::min(threads != 0 ? threads : ThreadPool::cores(),
+       std::max(count, 1u)))
+{
+    // The callback may hold a Python object, worlds are built without the GIL
+    m_opts.on_frame = nullptr;
+    m_res = WorldResources::headless(&m_pool);
+
+    this->parallel_for([this](const size_t index) {
+        this->build(index);
+    });
+}
+
+void
+VecWorld::build(const size_t index) {
+    auto opts = m_opts;
+    opts.scene.seed = m_base_seed + index + m_episodes[index] * m_worlds.size();
+    // Seed 0 means a random one
+    if (opts.scene.seed == 0) {
+        opts.scene.seed = 1;
+    }
+    m_worlds[index].reset();
+    m_worlds[index].reset(new World(opts, m_res, m_profilers[index], false));
+}
+
+void
+VecWorld::reset(float* observations) {
+    std::fill(m_episodes.begin(), m_episodes.end(), 0);
+    this->parallel_for([this, observations](const size_t index) {
+        this->build(index);
+        this->observe(index, observations + index * OBSERVATION_SIZE);
+    });
+}
+
+void
+VecWorld::step(const float time_delta, const float* actions,
+        float* observations, float* rewards, uint8_t* dones) {
+    this->parallel_for([=](const size_t index) {
+        auto& world = *m_worlds[index];
+        const float* action = actions + index * ACTION_SIZE;
+
+        World::Input input;
+        input.position = world.move_player(world.get_player(),
+            glm::vec3(action[0], 0, action[1]), time_delta);
+        input.fire = action[2] > 0.5f;
+        input.aim = glm::vec3(action[3], action[4], action[5]);
+        if (glm::length(input.aim) < 1e-4f) {
+            input.aim = glm::vec3(0, 0, -1);
+        }
+
+        const uint32_t alive_before = world.alive_enemies();
+        const bool player_before = world.is_player_alive();
+        world.step(time_delta, input);
+
+        float reward = KILL_REWARD * (alive_before - world.alive_enemies());
+        if (player_before && !world.is_player_alive()) {
+            reward += DEATH_REWARD;
+        }
+        rewards[index] = reward;
+        dones[index] = world.is_over();
+        if (dones[index]) {
+            ++m_episodes[index];
+            this->build(index);
+        }
+        this->observe(index, observations + index * OBSERVATION_SIZE);
+    });
+}
+
+void
+VecWorld::observe(const size_t index, float* observation) const {
+    const auto& world = *m_worlds[index];
+    const auto player = world.get_player();
+    std::fill(observation, observation + OBSERVATION_SIZE, 0.f);
+    observation[0] = player.x;
+    observation[1] = player.y;
+    observation[2] = player.z;
+    observation[3] = world.get_options().game_time - world.get_time();
+    observation[4] = world.is_player_alive();
+    observation[5] = world.alive_enemies();
+
+    // Nearest alive enemies, kept sorted by insertion on the stack so that
+    // observing does not allocate
+    std::array<std::pair<float, const Enemy*>, OBSERVED_ENEMIES> nearest;
+    size_t count = 0;
+    for (const auto& obj : world.get_enemies()) {
+        const auto enemy = static_cast<const Enemy*>(obj.get());
+        if (!enemy->is_alive()) {
+            continue;
+        }
+        const auto d = enemy->get_center() - player;
+        const float d2 = glm::dot(d, d);
+        if (count == OBSERVED_ENEMIES && d2 >= nearest[count - 1].first) {
+            continue;
+        }
+        size_t slot = std::min<size_t>(count, OBSERVED_ENEMIES - 1);
+        for (; slot > 0 && nearest[slot - 1].first > d2; --slot) {
+            nearest[slot] = nearest[slot - 1];
+        }
+        nearest[slot] = {d2, enemy};
+        count = std::min<size_t>(count + 1, OBSERVED_ENEMIES);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        const auto enemy = nearest[i].second;
+        const auto d = enemy->get_center() - player;
+        float* slot = observation + 6 + 4 * i;
+        slot[0] = d.x;
+        slot[1] = d.y;
+        slot[2] = d.z;
+        slot[3] = enemy->get_hits();
+    }
+}
+
+void
+VecWorld::parallel_for(std::function<void(size_t)> task) {
+    m_pool.parallel_for(m_worlds.size(), std::move(task));
+}
@@ -0,0 +1,436 @@
+#include <algorithm>
+#include <unordered_set>
+#include "game/world.hpp"
+#include "game/cuboid.hpp"
+#include "game/ball.hpp"
+#include "game/enemy.hpp"
+#include "game/static_mesh.hpp"
+
+namespace {
+
+// doom0.png to doom6.png
+constexpr uint32_t ENEMY_TEXTURES = 7;
+// Same as the speed of PV112Camera
+constexpr float PLAYER_SPEED = 10.f;
+constexpr float PLAYER_MARGIN = 0.4f;
+// Where PV112Camera starts
+const glm::vec3 PLAYER_START(11, 2, 2.5);
+// Of the particles off the enemies, RGBA with red in the lowest byte
+constexpr float SPARK_SPEED = 4.f;
+constexpr uint32_t SPARK_COLOR = 0xff40c0ff;
+constexpr float DEBRIS_SPEED = 2.5f;
+constexpr uint32_t DEBRIS_COLOR = 0xff203080;
+
+}
+
+WorldResources
+WorldResources::headless(ThreadPool* pool) {
+    // The meshes balls collide with are read whole for their triangles
+    auto load = [pool](const char* path, PV112::PV112Geometry& geometry) {
+        geometry.aabb = AABB(glm::vec3(0), glm::vec3(0));
+        const auto data = PV112::ReadOBJ(path, geometry.aabb);
+        if (!data) {
+            return std::shared_ptr<const MeshBvh>();
+        }
+        return MeshBvh::build(data->Positions, std::string(path) + ".bvh", pool);
+    };
+    WorldResources res;
+    res.cube.aabb = AABB(glm::vec3(0), glm::vec3(1));
+    res.sphere.aabb = AABB(glm::vec3(0), glm::vec3(1));
+    res.table_bvh = load("obj/table.obj", res.table);
+    res.box.aabb = PV112::LoadOBJBounds("obj/box.obj");
+    res.bulb_bvh = load("obj/bulb.obj", res.bulb);
+    res.enemy_textures.assign(ENEMY_TEXTURES, 0);
+    return res;
+}
+
+World::World(const GameOptions& opts, const WorldResources& resources,
+        Profiler& profiler, const bool threaded_flow_field)
+ : m_opts(opts), m_res(resources), m_profiler(profiler),
+   m_scene(generate_scene(opts.scene)), m_rng(m_scene.seed),
+   m_solver(opts.solver), m_integrator(opts.integrator), m_particles(opts.particles, m_scene.seed)
+{
+    auto scope = m_profiler.scope("scene_init");
+    m_bodies.reserve(std::max<size_t>(2 * m_opts.scene.object_count(), 4096));
+    m_player = this->move_player(PLAYER_START, glm::vec3(0), 0.f);
+    this->build_scene();
+    m_flow_field.reset(new FlowField(m_scene.bounds, 0.5f, 0.3f,
+        threaded_flow_field));
+    const auto& b = m_scene.bounds;
+    m_particles.set_bounds(glm::vec3(b[0][0], b[1][0], b[2][0]),
+        glm::vec3(b[0][1], b[1][1], b[2][1]));
+}
+
+void
+World::build_scene() {
+    const auto& scene = m_scene;
+    // Walls
+    for (const auto& wall : scene.walls) {
+        m_objects.push_back(std::move(std::make_shared<Cuboid>(m_bodies,
+            m_res.cube, m_res.stone_tex, wall.center, wall.size,
+            Motion(false)
+        )));
+    }
+
+    // Table in the middle
+    if (m_res.table_bvh) {
+        m_objects.push_back(std::move(std::make_shared<StaticMesh>(m_bodies,
+            m_res.table, m_res.metal_tex, scene.table.center,
+            scene.table.size, m_res.table_bvh
+        )));
+    } else {
+        m_objects.push_back(std::move(std::make_shared<Cuboid>(m_bodies,
+            m_res.table, m_res.metal_tex, scene.table.center,
+            scene.table.size, Motion(false)
+        )));
+    }
+    m_obstacles.push_back(m_objects.back());
+    // Balls on the table
+    for (const auto& ball : scene.balls) {
+        m_objects.push_back(std::move(std::make_shared<Ball>(m_bodies,
+            m_res.sphere, m_res.ball_tex, ball.center, ball.size.x,
+            Motion(ball.direction, ball.speed)
+        )));
+    }
+    // Boxes
+    for (const auto& box : scene.boxes) {
+        m_objects.push_back(std::move(std::make_shared<Cuboid>(m_bodies,
+            m_res.box, m_res.spike_tex, box.center, box.size,
+            Motion(box.direction, box.speed)
+        )));
+        m_obstacles.push_back(m_objects.back());
+    }
+    MaterialProperties props = {
+        .ambient_color = glm::vec3(0.315f),
+        .diffuse_color = glm::vec3(0.),
+        .specular_color = glm::vec3(0.),
+        .shininess = 0
+    };
+
+    // Make some light bulbs
+    for (const auto& light : scene.lights) {
+        const glm::vec3 center = glm::vec3(light) + glm::vec3(0, 0.2, 0);
+        if (m_res.bulb_bvh) {
+            m_objects.push_back(std::move(std::make_shared<StaticMesh>(m_bodies,
+                m_res.bulb, m_res.glass_tex, center, glm::vec3(0.5, 0.5, 0.5),
+                m_res.bulb_bvh
+            )));
+        } else {
+            m_objects.push_back(std::move(std::make_shared<Cuboid>(m_bodies,
+                m_res.bulb, m_res.glass_tex, center, glm::vec3(0.5, 0.5, 0.5),
+                Motion(false)
+            )));
+        }
+        m_objects.back()->set_material_properties(props);
+    }
+
+    // Create enemies
+    for (const auto& enemy : scene.enemies) {
+        m_enemies.push_back(std::move(std::make_shared<Enemy>(
+            m_res.enemy_textures, m_res.sound, m_bodies, m_res.cube, 0,
+            enemy.center, glm::vec3(enemy.size.x), Motion(false)
+        )));
+    }
+    m_objects.insert(m_objects.end(), m_enemies.begin(), m_enemies.end());
+}
+
+void
+World::step(const float frame_delta, const Input& input) {
+    const float time_delta = m_integrator.clamp(frame_delta);
+    m_time += time_delta;
+    m_player = input.position;
+    m_queries_stale = true;
+    {
+        auto scope = m_profiler.scope("step_game");
+        if (m_player_alive) {
+            for (uint32_t i = 0; i < input.shots; ++i) {
+                this->fire_ball(input.position, input.aim);
+            }
+            if (input.fire && m_last_fired + FIRE_INTERVAL < m_time) {
+                this->fire_ball(input.position, input.aim);
+                m_last_fired = m_time;
+            }
+        }
+        if (m_player_alive) {
+            for (const auto& enemy : m_enemies) {
+                if (std::static_pointer_cast<Enemy>(enemy)->kills_player(m_player)) {
+                    m_player_alive = false;
+                    this->play("audio/death_player.mp3");
+                }
+            }
+        }
+        // Keep the field warm even before the enemies wake up
+        m_flow_field->update(m_player, m_obstacles);
+        if (m_time > m_opts.enemy_delay) {
+            const auto field = m_flow_field->get();
+            m_steering.step(m_enemies, m_player, time_delta, field.get());
+        }
+    }
+    m_flashes.erase(std::remove_if(m_flashes.begin(), m_flashes.end(),
+            [this](const auto& flash) {
+                return flash.second + FLASH_TIME < m_time;
+            }),
+        m_flashes.end());
+    this->clear_expired();
+    {
+        // All of the substeps, the phases below are timed per substep
+        auto scope = m_profiler.scope("physics");
+        const uint32_t substeps = m_integrator.substeps(m_bodies, time_delta);
+        for (uint32_t i = 0; i < substeps; ++i) {
+            this->substep(time_delta / substeps);
+        }
+    }
+    auto scope = m_profiler.scope("particles");
+    m_particles.step(time_delta);
+}
+
+void
+World::substep(const float time_delta) {
+    m_integrator.begin(m_bodies);
+    {
+        auto scope = m_profiler.scope("forces");
+        for (const auto& obj : m_objects) {
+            obj->accelerate(time_delta);
+        }
+    }
+    this->resolve_collisions(time_delta);
+    auto scope = m_profiler.scope("integrate");
+    m_integrator.integrate(m_objects, m_bodies, time_delta);
+}
+
+void
+World::fire_ball(const glm::vec3& position, const glm::vec3& direction) {
+    auto uniform = [this](const float lo, const float hi) {
+        return std::uniform_real_distribution<float>(lo, hi)(m_rng);
+    };
+    const float radius = uniform(0.1, 0.3);
+    const float speed = uniform(5., 17.);
+    auto dir = glm::normalize(direction);
+    dir *= (radius + 0.6);
+
+    m_objects.push_back(std::move(std::make_shared<Ball>(m_bodies, m_res.sphere,
+        m_res.ball_tex, position + dir, radius, Motion(dir, speed)
+    )));
+    m_objects.back()->set_expiration_time(m_time + m_opts.ball_time);
+    m_queries_stale = true;
+    m_flashes.emplace_back(position + dir, m_time);
+    this->play("audio/fire.mp3");
+}
+
+glm::vec3
+World::move_player(const glm::vec3& position, const glm::vec3& direction,
+        const float time_delta) const {
+    glm::vec3 dir(direction.x, 0, direction.z);
+    const float length = glm::length(dir);
+    auto moved = position;
+    if (length > 1e-4f) {
+        moved += std::min(length, 1.f) / length * dir * time_delta * PLAYER_SPEED;
+    }
+    for (uint32_t i = 0; i < 3; ++i) {
+        moved[i] = std::min(std::max(moved[i], m_scene.bounds[i][0] + PLAYER_MARGIN),
+            m_scene.bounds[i][1] - PLAYER_MARGIN);
+    }
+    return moved;
+}
+
+void
+World::clear_expired() {
+    auto clear = [this](auto& objects) {
+        objects.erase(std::remove_if(objects.begin(), objects.end(),
+                [this](const auto& obj) {
+                    return obj->is_expired(m_time);
+                }),
+            objects.end());
+    };
+    clear(m_objects);
+    clear(m_enemies);
+    clear(m_obstacles);
+}
+
+void
+World::resolve_collisions(const float time_delta) {
+    const std::vector<Broadphase::Pair>* pairs;
+    {
+        auto scope = m_profiler.scope("broadphase");
+        pairs = &m_broadphase.find_pairs(m_objects);
+    }
+    {
+        auto scope = m_profiler.scope("narrowphase");
+        m_solver.collide(m_objects, *pairs);
+        // A hit counts once per touch, when the contact begins
+        const auto& contacts = m_solver.get_contacts();
+        for (const auto i : m_solver.get_began()) {
+            const auto& contact = contacts[i];
+            Object& obj_A = *m_bodies.owner[contact.a];
+            Object& obj_B = *m_bodies.owner[contact.b];
+            if (obj_B.is_active()) {
+                this->hit(obj_A, obj_B, contact.point, contact.normal);
+            }
+            if (obj_A.is_active()) {
+                this->hit(obj_B, obj_A, contact.point, -contact.normal);
+            }
+        }
+    }
+    auto scope = m_profiler.scope("solve");
+    m_solver.solve(m_bodies, time_delta);
+}
+
+void
+World::hit(Object& target, const Object& other, const glm::vec3& point,
+        const glm::vec3& away) {
+    if (target.get_kind() != BodyStore::ENEMY) {
+        target.got_hit(other.get_id(), m_time);
+        return;
+    }
+    auto& enemy = static_cast<Enemy&>(target);
+    const bool was_alive = enemy.is_alive();
+    enemy.got_hit(other.get_id(), m_time);
+    if (!was_alive) {
+        return;
+    }
+    ParticleSystem::Burst sparks;
+    sparks.position = point;
+    sparks.velocity = SPARK_SPEED * away;
+    sparks.spread = 0.5f * SPARK_SPEED;
+    sparks.life = 0.6f;
+    sparks.size = 0.04f;
+    sparks.color = SPARK_COLOR;
+    sparks.count = m_opts.particles.sparks_per_hit;
+    m_particles.emit(sparks);
+    if (!enemy.is_alive()) {
+        ParticleSystem::Burst debris;
+        debris.position = enemy.get_center();
+        debris.velocity = glm::vec3(0, DEBRIS_SPEED, 0);
+        debris.spread = DEBRIS_SPEED;
+        debris.life = 2.5f;
+        debris.size = 0.08f;
+        debris.color = DEBRIS_COLOR;
+        debris.count = m_opts.particles.debris_per_death;
+        m_particles.emit(debris);
+    }
+}
+
+uint32_t
+World::alive_enemies() const {
+    return std::count_if(m_enemies.begin(), m_enemies.end(), [](const auto& enemy) {
+        return std::static_pointer_cast<Enemy>(enemy)->is_alive();
+    });
+}
+
+void
+World::describe(std::vector<DrawItem>& items) const {
+    const size_t first = items.size();
+    items.resize(first + m_objects.size());
+    for (size_t i = 0; i < m_objects.size(); ++i) {
+        m_objects[i]->describe(items[first + i]);
+    }
+}
+
+void
+World::describe_lights(std::vector<PointLight>& lights) const {
+    for (const auto& lamp : m_scene.lights) {
+        lights.push_back({glm::vec3(lamp), 40.f, glm::vec3(1.f),
+            PointLight::NO_OWNER});
+    }
+    for (const auto& flash : m_flashes) {
+        const float fade = 1 - (m_time - flash.second) / FLASH_TIME;
+        lights.push_back({flash.first, 6.f, fade * glm::vec3(2.f, 1.6f, 0.8f),
+            PointLight::NO_OWNER});
+    }
+    // Enemies glow redder the more hits they took
+    for (const auto& obj : m_enemies) {
+        const auto enemy = static_cast<const Enemy*>(obj.get());
+        if (enemy->is_alive()) {
+            const float hurt = std::min(enemy->get_hits() / 5.f, 1.f);
+            lights.push_back({enemy->get_center(), 3.f,
+                glm::vec3(0.6f + 0.6f * hurt, 0.5f * (1 - hurt), 0.1f),
+                enemy->get_id()});
+        }
+    }
+}
+
+std::vector<uint32_t>
+World::spawn_balls(const float* positions, const float* velocities,
+        const float* radii, const size_t count) {
+    std::vector<uint32_t> ids;
+    ids.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        m_objects.push_back(std::move(std::make_shared<Ball>(m_bodies,
+            m_res.sphere, m_res.ball_tex, glm::make_vec3(positions + 3*i),
+            radii[i], Motion::with_velocity(glm::make_vec3(velocities + 3*i))
+        )));
+        ids.push_back(m_objects.back()->get_id());
+    }
+    m_queries_stale = true;
+    return ids;
+}
+
+std::vector<uint32_t>
+World::spawn_boxes(const float* positions, const float* velocities,
+        const size_t count) {
+    std::vector<uint32_t> ids;
+    ids.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        m_objects.push_back(std::move(std::make_shared<Cuboid>(m_bodies,
+            m_res.box, m_res.spike_tex,
+            glm::make_vec3(positions + 3*i), glm::vec3(0.5, 0.75, 0.4),
+            Motion::with_velocity(glm::make_vec3(velocities + 3*i))
+        )));
+        m_obstacles.push_back(m_objects.back());
+        ids.push_back(m_objects.back()->get_id());
+    }
+    m_queries_stale = true;
+    return ids;
+}
+
+std::vector<uint32_t>
+World::spawn_enemies(const float* positions, const float* scales,
+        const size_t count) {
+    std::vector<uint32_t> ids;
+    ids.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        m_enemies.push_back(std::move(std::make_shared<Enemy>(
+            m_res.enemy_textures, m_res.sound, m_bodies, m_res.cube, 0,
+            glm::make_vec3(positions + 3*i), glm::vec3(scales[i]), Motion(false)
+        )));
+        m_objects.push_back(m_enemies.back());
+        ids.push_back(m_enemies.back()->get_id());
+    }
+    m_queries_stale = true;
+    return ids;
+}
+
+size_t
+World::despawn(const uint32_t* ids, const size_t count) {
+    const std::unordered_set<uint32_t> doomed(ids, ids + count);
+    auto remove = [&doomed](auto& objects) {
+        const size_t before = objects.size();
+        objects.erase(std::remove_if(objects.begin(), objects.end(),
+                [&doomed](const auto& obj) {
+                    return doomed.count(obj->get_id()) != 0;
+                }),
+            objects.end());
+        return before - objects.size();
+    };
+    remove(m_enemies);
+    remove(m_obstacles);
+    m_queries_stale = true;
+    return remove(m_objects);
+}
+
+const SceneQuery&
+World::queries() {
+    if (m_queries_stale) {
+        auto scope = m_profiler.scope("query_tree");
+        m_queries.build(m_objects);
+        m_queries_stale = false;
+    }
+    return m_queries;
+}
+
+void
+World::play(const char* sound) {
+    if (m_res.sound) {
+        m_res.sound->play2D(sound, GL_FALSE);
+    }
+}
@@ -0,0 +1,34 @@
+"""Plays the game on a scene scaled by the given factors, one process per
+factor, and prints the per-phase timings of each run.
+
+    python3 stress.py 1 10 100 1000
+"""
+import subprocess
+import sys
+
+from game import _game
+
+SEED = 112
+
+
+def run(factor):
+    opts = _game.Options()
+    opts.game_time = 40
+    opts.scene.seed = SEED
+    opts.scene = opts.scene.scaled(factor)
+
+    _game.run(opts)
+    print("---- x%g: %d objects ----" % (factor, opts.scene.object_count()))
+    for phase in _game.timings():
+        print("%-12s avg %9.3f ms  max %9.3f ms" %
+              (phase.name, phase.avg_ms, phase.max_ms))
+
+
+if __name__ == '__main__':
+    factors = [float(f) for f in sys.argv[1:]] or [1, 10, 100, 1000]
+    if len(factors) == 1:
+        run(factors[0])
+    else:
+        # The game keeps global state, start a fresh process for every scene
+        for factor in factors:
+            subprocess.call([sys.executable, __file__, str(factor)])
@@ -13,6 +13,9 @@ out vec3 VS_normal_ws;
 out vec3 VS_position_ws;
 out vec2 VS_tex_coord;
 
+// The depth prepass computes the same position in depth_vertex.glsl
+invariant gl_Position;
+
 void main()
 {
     VS_tex_coord = tex_coord * tex_scale;